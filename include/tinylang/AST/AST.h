@@ -6,6 +6,7 @@
 
 #include "tinylang/Basic/LLVM.h"
 #include "tinylang/Basic/TokenKinds.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/APSInt.h"
 #include "llvm/Support/SMLoc.h"
@@ -14,6 +15,8 @@
 
 
 namespace tinylang {
+    class ASTContext;
+
     class Decl;
 
     class FormalParameterDeclaration;
@@ -22,6 +25,8 @@ namespace tinylang {
 
     class Stmt;
 
+    // The lists are only used while building the AST. The nodes store
+    // their children as arrays in the ASTContext.
     using DeclList = std::vector<Decl *>;
     using FormalParamList = std::vector<FormalParameterDeclaration *>;
     using ExprList = std::vector<Expr *>;
@@ -30,17 +35,21 @@ namespace tinylang {
     class Ident {
         SMLoc Loc;
         StringRef Name;
+        unsigned ID;
     public:
-        Ident(SMLoc Loc, const StringRef &Name)
-                : Loc(Loc), Name(Name) {}
+        Ident(SMLoc Loc, const StringRef &Name, unsigned ID)
+                : Loc(Loc), Name(Name), ID(ID) {}
 
-        SMLoc getLocation() { return Loc; }
+        SMLoc getLocation() const { return Loc; }
+
+        const StringRef &getName() const { return Name; }
 
-        const StringRef &getName() { return Name; }
+        // The interned ID of the name, see IdentifierTable.
+        unsigned getID() const { return ID; }
 
     };
 
-    using IdentList = std::vector<std::pair<SMLoc, StringRef>>;
+    using IdentList = std::vector<Ident>;
 
     class Decl {
     public:
@@ -58,12 +67,13 @@ namespace tinylang {
         Decl *EnclosingDecl;
         SMLoc Loc;
         StringRef Name;
+        unsigned NameID;
     public:
         Decl(DeclKind Kind, Decl *EnclosingDecl,
-             SMLoc Loc, StringRef Name) :
+             const Ident &Id) :
                 Kind(Kind),
-                EnclosingDecl(EnclosingDecl), Loc(Loc),
-                Name(Name) {}
+                EnclosingDecl(EnclosingDecl), Loc(Id.getLocation()),
+                Name(Id.getName()), NameID(Id.getID()) {}
 
         DeclKind getKind() const { return Kind; }
 
@@ -71,31 +81,48 @@ namespace tinylang {
 
         StringRef getName() { return Name; }
 
+        unsigned getNameID() { return NameID; }
+
         Decl *getEnclosingDecl() { return EnclosingDecl; }
 
+        // The names of the enclosing declarations and this one, joined by
+        // dots, e.g. Mod.Proc.
+        std::string getQualifiedName();
     };
 
     class ModuleDeclaration : public Decl {
-        DeclList Decls;
-        StmtList Stmts;
+        ArrayRef<Decl *> Decls;
+        ArrayRef<Stmt *> Stmts;
+        // Open-addressed table of the exported declarations, keyed by the
+        // interned name. The size is a power of two.
+        Decl **Exports{nullptr};
+        unsigned ExportMask{0};
+        // 32 minus the log2 of the size, to take the top bits of the hash.
+        unsigned ExportShift{0};
     public:
         ModuleDeclaration(Decl *EnclosingDecl,
-                          SMLoc Loc, StringRef Name) :
-                Decl(DK_MODULE, EnclosingDecl, Loc, Name) {}
+                          const Ident &Id) :
+                Decl(DK_MODULE, EnclosingDecl, Id) {}
 
         ModuleDeclaration(Decl *EnclosingDecl,
-                          SMLoc Loc, StringRef Name, DeclList &Decls,
-                          StmtList &Stmts) :
-                Decl(DK_MODULE, EnclosingDecl, Loc, Name),
+                          const Ident &Id, ArrayRef<Decl *> Decls,
+                          ArrayRef<Stmt *> Stmts) :
+                Decl(DK_MODULE, EnclosingDecl, Id),
                 Decls(Decls), Stmts(Stmts) {}
 
-        const DeclList &getDecls() { return Decls; }
+        ArrayRef<Decl *> getDecls() { return Decls; }
+
+        ArrayRef<Stmt *> getStmts() { return Stmts; }
+
+        void setDecls(ArrayRef<Decl *> D) { Decls = D; }
 
-        const StmtList &getStmts() { return Stmts; }
+        void setStmts(ArrayRef<Stmt *> S) { Stmts = S; }
 
-        void setDecls(DeclList &D) { Decls = D; }
+        // Builds the export table from the declarations. Called once after
+        // setDecls, when the module is complete.
+        void buildExportIndex(ASTContext &Context);
 
-        void setStmts(StmtList &S) { Stmts = S; }
+        Decl *lookupExport(unsigned NameID) const;
 
         static bool classof(const Decl *D) {
             return D->getKind() == DK_MODULE;
@@ -105,9 +132,9 @@ namespace tinylang {
     class ConstantDeclaration : public Decl {
         Expr *E;
     public:
-        ConstantDeclaration(Decl *EnclosingDecl, SMLoc Loc,
-                            StringRef Name, Expr *E) :
-                Decl(DK_CONST, EnclosingDecl, Loc, Name), E(E) {}
+        ConstantDeclaration(Decl *EnclosingDecl,
+                            const Ident &Id, Expr *E) :
+                Decl(DK_CONST, EnclosingDecl, Id), E(E) {}
 
         Expr *getExpr() { return E; }
 
@@ -118,9 +145,9 @@ namespace tinylang {
 
     class TypeDeclaration : public Decl {
     public:
-        TypeDeclaration(Decl *EnclosingDecl, SMLoc Loc,
-                        StringRef Name) :
-                Decl(DK_TYPE, EnclosingDecl, Loc, Name) {}
+        TypeDeclaration(Decl *EnclosingDecl,
+                        const Ident &Id) :
+                Decl(DK_TYPE, EnclosingDecl, Id) {}
 
         static bool classof(const Decl *D) {
             return D->getKind() == DK_TYPE;
@@ -130,9 +157,9 @@ namespace tinylang {
     class VariableDeclaration : public Decl {
         TypeDeclaration *Ty;
     public:
-        VariableDeclaration(Decl *EnclosingDecl, SMLoc Loc,
-                            StringRef Name, TypeDeclaration *Ty) :
-                Decl(DK_VAR, EnclosingDecl, Loc, Name), Ty(Ty) {}
+        VariableDeclaration(Decl *EnclosingDecl,
+                            const Ident &Id, TypeDeclaration *Ty) :
+                Decl(DK_VAR, EnclosingDecl, Id), Ty(Ty) {}
 
         TypeDeclaration *getType() { return Ty; }
 
@@ -145,9 +172,9 @@ namespace tinylang {
         TypeDeclaration *Ty;
         bool IsVar;
     public:
-        FormalParameterDeclaration(Decl *EnclosingDecl, SMLoc Loc,
-                                   StringRef Name, TypeDeclaration *Ty, bool IsVar) :
-                Decl(DK_PARAM, EnclosingDecl, Loc, Name), Ty(Ty), IsVar(IsVar) {}
+        FormalParameterDeclaration(Decl *EnclosingDecl,
+                                   const Ident &Id, TypeDeclaration *Ty, bool IsVar) :
+                Decl(DK_PARAM, EnclosingDecl, Id), Ty(Ty), IsVar(IsVar) {}
 
         TypeDeclaration *getType() { return Ty; }
 
@@ -159,41 +186,41 @@ namespace tinylang {
     };
 
     class ProcedureDeclaration : public Decl {
-        FormalParamList Params;
-        TypeDeclaration *RetType;
-        DeclList Decls;
-        StmtList Stmts;
+        ArrayRef<FormalParameterDeclaration *> Params;
+        TypeDeclaration *RetType{nullptr};
+        ArrayRef<Decl *> Decls;
+        ArrayRef<Stmt *> Stmts;
 
     public:
-        ProcedureDeclaration(Decl *EnclosingDecl, SMLoc Loc,
-                             StringRef Name) :
-                Decl(DK_PROC, EnclosingDecl, Loc, Name) {}
+        ProcedureDeclaration(Decl *EnclosingDecl,
+                             const Ident &Id) :
+                Decl(DK_PROC, EnclosingDecl, Id) {}
 
-        ProcedureDeclaration(Decl *EnclosingDecl, SMLoc Loc,
-                             StringRef Name,
-                             FormalParamList &Params,
+        ProcedureDeclaration(Decl *EnclosingDecl,
+                             const Ident &Id,
+                             ArrayRef<FormalParameterDeclaration *> Params,
                              TypeDeclaration *RetType,
-                             DeclList &Decls,
-                             StmtList &Stmts) :
-                Decl(DK_PROC, EnclosingDecl, Loc, Name), Params(Params), RetType(RetType),
+                             ArrayRef<Decl *> Decls,
+                             ArrayRef<Stmt *> Stmts) :
+                Decl(DK_PROC, EnclosingDecl, Id), Params(Params), RetType(RetType),
                 Decls(Decls),
                 Stmts(Stmts) {}
 
-        const FormalParamList &getFormalParams() { return Params; }
+        ArrayRef<FormalParameterDeclaration *> getFormalParams() { return Params; }
 
-        void setFormalParams(FormalParamList &FP) { Params = FP; }
+        void setFormalParams(ArrayRef<FormalParameterDeclaration *> FP) { Params = FP; }
 
         TypeDeclaration *getRetType() { return RetType; }
 
         void setRetType(TypeDeclaration *Ty) { RetType = Ty; }
 
-        const DeclList &getDecls() { return Decls; }
+        ArrayRef<Decl *> getDecls() { return Decls; }
 
-        void setDecls(DeclList &D) { Decls = D; }
+        void setDecls(ArrayRef<Decl *> D) { Decls = D; }
 
-        const StmtList &getStmts() { return Stmts; }
+        ArrayRef<Stmt *> getStmts() { return Stmts; }
 
-        void setStmts(StmtList &S) { Stmts = S; }
+        void setStmts(ArrayRef<Stmt *> S) { Stmts = S; }
 
         static bool classof(const Decl *D) {
             return D->getKind() == DK_PROC;
@@ -208,7 +235,7 @@ namespace tinylang {
         OperatorInfo() : Loc(), Kind(tok::unknown), IsUnspecified(true) {}
 
         OperatorInfo(SMLoc Loc, tok::TokenKind Kind, bool isUnspecified = false) :
-                Loc(Loc), Kind(Kind), IsUnspecified(IsUnspecified) {}
+                Loc(Loc), Kind(Kind), IsUnspecified(isUnspecified) {}
 
         SMLoc getLocation() const { return Loc; }
 
@@ -289,15 +316,33 @@ namespace tinylang {
         }
     };
 
+    // Values which fit into an int64_t are stored inline. Only larger
+    // literals use an arbitrary precision integer.
     class IntegerLiteral : public Expr {
         SMLoc Loc;
-        llvm::APSInt Value;
+        int64_t SmallValue;
+        llvm::APSInt *LargeValue;
     public:
-        IntegerLiteral(SMLoc Loc, const llvm::APSInt &Value,
+        IntegerLiteral(SMLoc Loc, int64_t Value,
                        TypeDeclaration *Ty) :
-                Expr(EK_INT, Ty, true), Loc(Loc), Value(Value) {}
+                Expr(EK_INT, Ty, true), Loc(Loc), SmallValue(Value), LargeValue(nullptr) {}
 
-        llvm::APSInt &getValue() { return Value; }
+        IntegerLiteral(SMLoc Loc, llvm::APSInt *Value,
+                       TypeDeclaration *Ty) :
+                Expr(EK_INT, Ty, true), Loc(Loc), SmallValue(0), LargeValue(Value) {}
+
+        bool isSmall() const { return !LargeValue; }
+
+        int64_t getSmallValue() const {
+            assert(isSmall() && "Literal does not fit into int64_t");
+            return SmallValue;
+        }
+
+        llvm::APSInt getValue() const {
+            if (LargeValue)
+                return *LargeValue;
+            return llvm::APSInt(llvm::APInt(64, SmallValue, true), false);
+        }
 
         static bool classof(const Expr *E) {
             return E->getKind() == EK_INT;
@@ -349,13 +394,13 @@ namespace tinylang {
 
     class FunctionCallExpr : public Expr {
         ProcedureDeclaration *Proc;
-        ExprList Params;
+        ArrayRef<Expr *> Params;
     public:
         FunctionCallExpr(ProcedureDeclaration *Proc,
-                         ExprList Params) :
+                         ArrayRef<Expr *> Params) :
                 Expr(EK_FUNC, Proc->getRetType(), false), Proc(Proc), Params(Params) {}
 
-        const ExprList &getParams() { return Params; }
+        ArrayRef<Expr *> getParams() { return Params; }
 
         ProcedureDeclaration *getDecl() { return Proc; }
 
@@ -384,14 +429,15 @@ namespace tinylang {
 
     };
 
+    // The target is a VariableDeclaration or a FormalParameterDeclaration.
     class AssignmentStatement : public Stmt {
-        VariableDeclaration *Var;
+        Decl *Var;
         Expr *E;
     public:
-        AssignmentStatement(VariableDeclaration *Var, Expr *E) :
+        AssignmentStatement(Decl *Var, Expr *E) :
                 Stmt(SK_ASSIGN), Var(Var), E(E) {}
 
-        VariableDeclaration *getVar() { return Var; }
+        Decl *getVar() { return Var; }
 
         Expr *getExpr() { return E; }
 
@@ -402,14 +448,14 @@ namespace tinylang {
 
     class ProcedureCallStatement : public Stmt {
         ProcedureDeclaration *Proc;
-        ExprList Params;
+        ArrayRef<Expr *> Params;
     public:
-        ProcedureCallStatement(ProcedureDeclaration *Proc, ExprList &Params) :
+        ProcedureCallStatement(ProcedureDeclaration *Proc, ArrayRef<Expr *> Params) :
                 Stmt(SK_PROC_CALL), Proc(Proc), Params(Params) {}
 
         ProcedureDeclaration *getProc() { return Proc; }
 
-        const ExprList &getParams() { return Params; }
+        ArrayRef<Expr *> getParams() { return Params; }
 
         static bool classof(const Stmt *S) {
             return S->getKind() == SK_PROC_CALL;
@@ -418,17 +464,17 @@ namespace tinylang {
 
     class IfStatement : public Stmt {
         Expr *Cond;
-        StmtList IfStmts;
-        StmtList ElseStmts;
+        ArrayRef<Stmt *> IfStmts;
+        ArrayRef<Stmt *> ElseStmts;
     public:
-        IfStatement(Expr *Cond, StmtList &IfStmts, StmtList &ElseStmts) : Stmt(SK_IF), Cond(Cond), IfStmts(IfStmts),
-                                                                          ElseStmts(ElseStmts) {}
+        IfStatement(Expr *Cond, ArrayRef<Stmt *> IfStmts, ArrayRef<Stmt *> ElseStmts) :
+                Stmt(SK_IF), Cond(Cond), IfStmts(IfStmts), ElseStmts(ElseStmts) {}
 
         Expr *getCond() { return Cond; }
 
-        const StmtList &getIfStmts() { return IfStmts; }
+        ArrayRef<Stmt *> getIfStmts() { return IfStmts; }
 
-        const StmtList &getElseStmts() { return ElseStmts; }
+        ArrayRef<Stmt *> getElseStmts() { return ElseStmts; }
 
         static bool classof(const Stmt *S) {
             return S->getKind() == SK_IF;
@@ -437,13 +483,13 @@ namespace tinylang {
 
     class WhileStatement : public Stmt {
         Expr *Cond;
-        StmtList Stmts;
+        ArrayRef<Stmt *> Stmts;
     public:
-        WhileStatement(Expr *Cond, StmtList &stmts) : Stmt(SK_WHITE), Cond(Cond), Stmts(stmts) {}
+        WhileStatement(Expr *Cond, ArrayRef<Stmt *> Stmts) : Stmt(SK_WHITE), Cond(Cond), Stmts(Stmts) {}
 
         Expr *getCond() { return Cond; }
 
-        const StmtList &getWhileStmts() { return Stmts; }
+        ArrayRef<Stmt *> getWhileStmts() { return Stmts; }
 
         static bool classof(const Stmt *S) {
             return S->getKind() == SK_WHITE;
@@ -0,0 +1,113 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Allocator.h"
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace tinylang {
+#define AST_NODE(Class) class Class;
+
+#include "tinylang/AST/ASTNodes.def"
+
+    // Owns all AST nodes of a compilation unit. The nodes are bump allocated
+    // and released together when the context is destroyed.
+    class ASTContext {
+    public:
+        enum NodeClass {
+#define AST_NODE(Class) NC_##Class,
+
+#include "tinylang/AST/ASTNodes.def"
+
+            // Other objects, like the values of constants.
+            NC_Other,
+            NUM_NODE_CLASSES
+        };
+
+        // The number and total size of the objects of one kind.
+        struct AllocationStats {
+            size_t Count{0};
+            size_t Bytes{0};
+        };
+
+    private:
+        llvm::BumpPtrAllocator Allocator;
+
+        // Counted for -fmem-report. The lists copied by copyArray are kept
+        // apart from the nodes.
+        AllocationStats NodeStats[NUM_NODE_CLASSES];
+        AllocationStats ListStats;
+
+        template<typename T>
+        static constexpr NodeClass getNodeClass() {
+#define AST_NODE(Class) if constexpr (std::is_same_v<T, Class>) return NC_##Class; else
+
+#include "tinylang/AST/ASTNodes.def"
+
+            return NC_Other;
+        }
+
+        // Objects which need their destructor to run before the memory is
+        // released.
+        std::vector<std::pair<void (*)(void *), void *>> Cleanups;
+    public:
+        ASTContext() = default;
+
+        ASTContext(const ASTContext &) = delete;
+
+        ASTContext &operator=(const ASTContext &) = delete;
+
+        ~ASTContext() {
+            for (auto &Cleanup : llvm::reverse(Cleanups))
+                Cleanup.first(Cleanup.second);
+        }
+
+        void *allocate(size_t Size, size_t Alignment) {
+            return Allocator.Allocate(Size, Alignment);
+        }
+
+        template<typename T, typename... Args>
+        T *create(Args &&... Arguments) {
+            AllocationStats &Stats = NodeStats[getNodeClass<T>()];
+            ++Stats.Count;
+            Stats.Bytes += sizeof(T);
+            T *Obj = new(allocate(sizeof(T), alignof(T)))
+                    T(std::forward<Args>(Arguments)...);
+            if constexpr (!std::is_trivially_destructible_v<T>)
+                Cleanups.emplace_back([](void *P) { static_cast<T *>(P)->~T(); }, Obj);
+            return Obj;
+        }
+
+        // Copies the elements of a list which was built during parsing into
+        // the arena. Empty lists need no memory.
+        template<typename T>
+        llvm::ArrayRef<T> copyArray(llvm::ArrayRef<T> Elems) {
+            static_assert(std::is_trivially_copyable_v<T>, "Only for pointer arrays");
+            if (Elems.empty())
+                return llvm::ArrayRef<T>();
+            ++ListStats.Count;
+            ListStats.Bytes += Elems.size() * sizeof(T);
+            T *Mem = static_cast<T *>(allocate(Elems.size() * sizeof(T), alignof(T)));
+            std::uninitialized_copy(Elems.begin(), Elems.end(), Mem);
+            return llvm::ArrayRef<T>(Mem, Elems.size());
+        }
+
+        size_t getBytesAllocated() const { return Allocator.getBytesAllocated(); }
+
+        // The memory reserved by the arena, including unused parts of slabs.
+        size_t getTotalMemory() const { return Allocator.getTotalMemory(); }
+
+        const AllocationStats &getNodeStats(NodeClass Class) const { return NodeStats[Class]; }
+
+        const AllocationStats &getListStats() const { return ListStats; }
+
+        static const char *getNodeClassName(NodeClass Class);
+    };
+}
@@ -6,12 +6,15 @@
 #define TINYLANG3_DIAGNOSTIC_H
 
 #include "LLVM.h"
+#include "tinylang/Basic/LineTable.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/SMLoc.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
-#include <utility>
+#include <memory>
+#include <type_traits>
+#include <vector>
 
 namespace tinylang {
     namespace diag {
@@ -21,13 +24,47 @@ namespace tinylang {
 #include "tinylang/Basic/Diagnostic.def"
         };
     }
+    // A reported diagnostic, before it is formatted. The arguments are not
+    // copied, so they must outlive the engine. All of them are spellings or
+    // point into the source buffer.
+    struct StoredDiagnostic {
+        static constexpr unsigned MaxArguments = 2;
+
+        SMLoc Loc;
+        unsigned DiagID;
+        StringRef Args[MaxArguments];
+    };
+
+    // Records diagnostics and prints them when flushed, sorted by their
+    // location. A note stays behind the diagnostic before it. Reporting does
+    // not touch the source manager, so every thread can report into its own
+    // engine for the same buffer.
     class DiagnosticEngine {
         static const char *getDiagnosticText(unsigned DiagID);
 
         static SourceMgr::DiagKind getDiagnosticKind(unsigned DiagID);
 
         SourceMgr &SrcMgr;
+        std::vector<StoredDiagnostic> Diagnostics;
+        // Indexed by the buffer ID minus 1, created on first use.
+        std::vector<std::unique_ptr<LineTable>> LineTables;
         unsigned NumErrors;
+        // 0 for no limit. The error after the limit is replaced by
+        // err_too_many_errors, which is printed last, and all later
+        // diagnostics are dropped. The limit counts errors in the order in
+        // which they are reported, not in the order in which they are
+        // printed. The parser reports as it reads, but the lexer reports
+        // the whole buffer first with --prelex, and Sema reports some
+        // errors at the declaration, so the errors shown are not always
+        // the first ones in the file.
+        unsigned ErrorLimit{0};
+        // Only names the file in err_too_many_errors. The message has no
+        // line, as the dropped error is not shown.
+        SMLoc ErrorLimitLoc;
+        bool ErrorLimitReached{false};
+        bool ErrorLimitPrinted{false};
+
+        void print(const StoredDiagnostic &D);
     public:
         DiagnosticEngine(SourceMgr &SrcMgr) : SrcMgr(SrcMgr), NumErrors(0) {}
 
@@ -36,12 +73,32 @@ namespace tinylang {
         template<typename ... Args>
         void report(SMLoc Loc, unsigned DiagID,
                     Args &&... Arguments) {
-            std::string Msg = llvm::formatv(getDiagnosticText(DiagID),
-                                            std::forward<Args>(Arguments)...).str();
-            SourceMgr::DiagKind Kind = getDiagnosticKind(DiagID);
-            SrcMgr.PrintMessage(Loc, Kind, Msg);
-            NumErrors += (Kind == SourceMgr::DK_Error);
+            static_assert(sizeof...(Args) <= StoredDiagnostic::MaxArguments, "Too many arguments");
+            static_assert((std::is_convertible_v<Args, StringRef> && ...), "Arguments must be strings");
+            if (LLVM_UNLIKELY(ErrorLimitReached))
+                return;
+            bool IsError = getDiagnosticKind(DiagID) == SourceMgr::DK_Error;
+            if (IsError && ErrorLimit && NumErrors == ErrorLimit) {
+                ErrorLimitReached = true;
+                ErrorLimitLoc = Loc;
+                ++NumErrors;
+                return;
+            }
+            Diagnostics.push_back({Loc, DiagID, {StringRef(Arguments)...}});
+            NumErrors += IsError;
         }
+
+        void setErrorLimit(unsigned Limit) { ErrorLimit = Limit; }
+
+        bool hasReachedErrorLimit() const { return ErrorLimitReached; }
+
+        // The diagnostics which are not flushed yet, in the order reported.
+        ArrayRef<StoredDiagnostic> getDiagnostics() const { return Diagnostics; }
+
+        // Formats and prints the recorded diagnostics.
+        void flush();
+
+        LineTable &getLineTable(unsigned BufferID);
     };
 }
 #endif //TINYLANG3_DIAGNOSTIC_H
@@ -0,0 +1,41 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#ifndef TINYLANG3_IDENTIFIERTABLE_H
+#define TINYLANG3_IDENTIFIERTABLE_H
+
+#include "tinylang/Basic/LLVM.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include <vector>
+
+namespace tinylang {
+    // Interns identifiers. Each distinct name gets a dense ID, counting up
+    // from 0 in order of first appearance, so that later phases compare and
+    // index IDs instead of hashing names.
+    class IdentifierTable {
+        llvm::StringMap<unsigned, llvm::BumpPtrAllocator> Table;
+        std::vector<StringRef> Names;
+    public:
+        unsigned get(StringRef Name) {
+            auto Result = Table.try_emplace(Name, Names.size());
+            if (Result.second)
+                Names.push_back(Result.first->getKey());
+            return Result.first->second;
+        }
+
+        StringRef getName(unsigned ID) const { return Names[ID]; }
+
+        unsigned size() const { return Names.size(); }
+
+        // The bytes reserved by the hash table, the names and the ID index.
+        size_t getMemorySize() const {
+            return Table.getAllocator().getTotalMemory() +
+                   Table.getNumBuckets() * (sizeof(void *) + sizeof(unsigned)) +
+                   Names.capacity() * sizeof(StringRef);
+        }
+    };
+}
+#endif //TINYLANG3_IDENTIFIERTABLE_H
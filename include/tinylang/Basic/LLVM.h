@@ -9,6 +9,9 @@
 #include "llvm/Support/Casting.h"
 
 namespace llvm {
+    template<typename T>
+    class ArrayRef;
+
     class SMLoc;
 
     class SourceMgr;
@@ -27,6 +30,7 @@ namespace tinylang {
     using llvm::dyn_cast_or_null;
     using llvm::isa;
 
+    using llvm::ArrayRef;
     using llvm::raw_ostream;
     using llvm::SMLoc;
     using llvm::SourceMgr;
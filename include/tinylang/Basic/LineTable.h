@@ -0,0 +1,55 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#ifndef TINYLANG3_LINETABLE_H
+#define TINYLANG3_LINETABLE_H
+
+#include "tinylang/Basic/LLVM.h"
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace tinylang {
+    // Maps positions in a buffer to lines and columns. The offsets of the
+    // line starts are collected on the first query with a vectorized scan
+    // for newlines, after which a lookup is a binary search. Lines and
+    // columns count from 1, like in diagnostics.
+    class LineTable {
+        StringRef Buffer;
+        // The offset of the first character of each line.
+        std::vector<uint32_t> LineStarts;
+
+        void build();
+
+        unsigned findLine(uint32_t Offset);
+
+    public:
+        explicit LineTable(StringRef Buffer) : Buffer(Buffer) {}
+
+        bool contains(const char *Ptr) const {
+            return Ptr >= Buffer.begin() && Ptr <= Buffer.end();
+        }
+
+        unsigned getLineNumber(const char *Ptr) { return findLine(getOffset(Ptr)) + 1; }
+
+        std::pair<unsigned, unsigned> getLineAndColumn(const char *Ptr);
+
+        // The text of a line, without the line break.
+        StringRef getLine(unsigned Line);
+
+        unsigned getNumLines() {
+            if (LineStarts.empty())
+                build();
+            return LineStarts.size();
+        }
+
+    private:
+        uint32_t getOffset(const char *Ptr) const {
+            assert(contains(Ptr) && "Pointer outside of the buffer");
+            return static_cast<uint32_t>(Ptr - Buffer.begin());
+        }
+    };
+}
+#endif //TINYLANG3_LINETABLE_H
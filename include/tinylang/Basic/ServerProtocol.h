@@ -0,0 +1,87 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#ifndef TINYLANG3_SERVERPROTOCOL_H
+#define TINYLANG3_SERVERPROTOCOL_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+
+// The messages between `tinylang --serve` and tinylang-client, over a Unix
+// domain socket. Both ends are on the same host, so integers are sent in
+// the native byte order.
+//
+// The client sends one request: a header with the flags and the number of
+// strings, then each string as its size followed by the bytes. The first
+// string is the working directory of the client, the rest are the
+// arguments, starting with the program name.
+//
+// The server answers with frames: a channel byte, the size of the payload
+// and the payload. The last frame is on the Exit channel and carries the
+// exit code.
+namespace tinylang {
+    namespace server {
+        enum RequestFlags : uint32_t {
+            // The client's stderr is a terminal.
+            ColorsFlag = 1,
+        };
+
+        struct RequestHeader {
+            uint32_t Flags;
+            uint32_t NumStrings;
+        };
+
+        enum Channel : uint8_t {
+            Stdout = 1,
+            Stderr = 2,
+            Exit = 3,
+        };
+
+        // The channel byte and the size of the payload.
+        constexpr size_t FrameHeaderSize = 1 + sizeof(uint32_t);
+
+        // Limits on requests, so a broken client cannot exhaust the server.
+        constexpr uint32_t MaxStrings = 1 << 16;
+        constexpr uint32_t MaxStringSize = 1 << 16;
+
+        inline bool writeAll(int FD, const void *Data, size_t Size) {
+            const char *Ptr = static_cast<const char *>(Data);
+            while (Size) {
+                ssize_t N = ::write(FD, Ptr, Size);
+                if (N < 0 && errno == EINTR)
+                    continue;
+                if (N <= 0)
+                    return false;
+                Ptr += N;
+                Size -= N;
+            }
+            return true;
+        }
+
+        inline bool readAll(int FD, void *Data, size_t Size) {
+            char *Ptr = static_cast<char *>(Data);
+            while (Size) {
+                ssize_t N = ::read(FD, Ptr, Size);
+                if (N < 0 && errno == EINTR)
+                    continue;
+                if (N <= 0)
+                    return false;
+                Ptr += N;
+                Size -= N;
+            }
+            return true;
+        }
+
+        inline bool writeFrame(int FD, Channel Chan, const void *Data, uint32_t Size) {
+            char Header[FrameHeaderSize];
+            Header[0] = static_cast<char>(Chan);
+            std::memcpy(Header + 1, &Size, sizeof(Size));
+            return writeAll(FD, Header, sizeof(Header)) && writeAll(FD, Data, Size);
+        }
+    }
+}
+#endif //TINYLANG3_SERVERPROTOCOL_H
@@ -0,0 +1,159 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#ifndef TINYLANG3_TIMEREPORT_H
+#define TINYLANG3_TIMEREPORT_H
+
+#include "tinylang/Basic/LLVM.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Compiler.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tinylang {
+    // The wall time spent in each phase of the compiler, for -ftime-report,
+    // and the memory used by them, for -fmem-report. A thread records into
+    // the report it installed, so that files compiled in parallel do not
+    // share one. The driver merges the reports of all files in input order.
+    class TimeReport {
+    public:
+        struct Entry {
+            double Seconds{0};
+            unsigned Count{0};
+            // The growth of the heap, and the peak RSS of the process at
+            // the end of the phase. Only with memory tracking.
+            int64_t HeapBytes{0};
+            size_t PeakRSS{0};
+        };
+
+        struct ObjectEntry {
+            size_t Count{0};
+            size_t Bytes{0};
+        };
+
+    private:
+        friend class TimeScope;
+
+        friend class SubPhaseScope;
+
+        static LLVM_THREAD_LOCAL TimeReport *Current;
+
+        bool TrackMemory{false};
+        // In order of first use, which is the order of the pipeline.
+        std::vector<std::pair<std::string, Entry>> Phases;
+        // Keyed by the phase and the name of the procedure.
+        llvm::StringMap<Entry> Procedures;
+        // The objects and tables of the compiler, in order of first use.
+        std::vector<std::pair<std::string, ObjectEntry>> Objects;
+        // The sub-phase timed within the open phase, and its time so far.
+        const char *SubPhase{nullptr};
+        double SubPhaseSeconds{0};
+        bool InSubPhase{false};
+
+        void addPhase(StringRef Phase, double Seconds, int64_t HeapBytes, size_t PeakRSS);
+
+        void addProcedure(StringRef Phase, StringRef Name, double Seconds);
+
+    public:
+        // Makes this the report of the current thread until it is
+        // uninstalled.
+        void install() { Current = this; }
+
+        static void uninstall() { Current = nullptr; }
+
+        static TimeReport *getCurrent() { return Current; }
+
+        // Samples the heap and the RSS around each phase. With threads, the
+        // heap is shared, so the numbers of a phase include the other
+        // threads.
+        void setTrackMemory(bool Track) { TrackMemory = Track; }
+
+        bool tracksMemory() const { return TrackMemory; }
+
+        void addObjects(StringRef Kind, size_t Count, size_t Bytes);
+
+        void merge(const TimeReport &Other);
+
+        // Prints the phases and the slowest procedures.
+        void print(raw_ostream &OS, unsigned MaxProcedures = 20) const;
+
+        // Prints the memory of the phases and the objects.
+        void printMemory(raw_ostream &OS) const;
+    };
+
+    // Times a scope for -ftime-report and -ftime-trace, and measures the
+    // memory of a phase for -fmem-report. Without an installed
+    // report this only loads a thread local pointer, and the name of the
+    // scope is not computed. A procedure scope is part of a phase of the
+    // whole file, so it is only reported per procedure.
+    class TimeScope {
+        const char *Phase;
+        TimeReport *Report;
+        bool IsProcedure;
+        bool Tracing{false};
+        std::string Detail;
+        std::chrono::steady_clock::time_point Start;
+        size_t StartHeap{0};
+
+        void begin(llvm::function_ref<std::string()> GetDetail);
+
+        void end();
+
+    public:
+        TimeScope(const char *Phase, llvm::function_ref<std::string()> GetDetail,
+                  bool IsProcedure = false) :
+                Phase(Phase), Report(TimeReport::Current), IsProcedure(IsProcedure) {
+            if (LLVM_UNLIKELY(Report))
+                begin(GetDetail);
+        }
+
+        ~TimeScope() {
+            if (LLVM_UNLIKELY(Report))
+                end();
+        }
+
+        TimeScope(const TimeScope &) = delete;
+
+        TimeScope &operator=(const TimeScope &) = delete;
+    };
+
+    // Times a part of a phase which runs interleaved with it, like the
+    // actions of Sema while parsing. Its time is taken out of the enclosing
+    // phase and reported as a phase of its own. It is entered for every
+    // action, so it only reads the clock: there are no trace events and no
+    // memory numbers, and a nested scope is not timed again. Without an
+    // installed report this only loads a thread local pointer.
+    class SubPhaseScope {
+        TimeReport *Report;
+        std::chrono::steady_clock::time_point Start;
+
+        void end();
+
+    public:
+        explicit SubPhaseScope(const char *Phase) : Report(TimeReport::Current) {
+            if (LLVM_UNLIKELY(Report)) {
+                if (Report->InSubPhase) {
+                    Report = nullptr;
+                    return;
+                }
+                Report->SubPhase = Phase;
+                Report->InSubPhase = true;
+                Start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~SubPhaseScope() {
+            if (LLVM_UNLIKELY(Report))
+                end();
+        }
+
+        SubPhaseScope(const SubPhaseScope &) = delete;
+
+        SubPhaseScope &operator=(const SubPhaseScope &) = delete;
+    };
+}
+#endif //TINYLANG3_TIMEREPORT_H
@@ -0,0 +1,37 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#ifndef TINYLANG3_TOKENSET_H
+#define TINYLANG3_TOKENSET_H
+
+#include "tinylang/Basic/TokenKinds.h"
+#include <cstdint>
+
+namespace tinylang {
+    // A set of token kinds as a bit mask with one bit per kind in
+    // TokenKinds.def, so a membership test is a shift and a mask instead of
+    // a chain of compares. Sets are constexpr and combine with |.
+    class TokenSet {
+        static_assert(tok::NUM_TOKENS <= 64, "Token kinds do not fit into the mask");
+
+        uint64_t Bits{0};
+
+        static constexpr uint64_t bit(tok::TokenKind Kind) { return uint64_t(1) << Kind; }
+
+    public:
+        constexpr TokenSet() = default;
+
+        template<typename... Ts>
+        constexpr TokenSet(tok::TokenKind Kind, Ts... Kinds) : Bits((bit(Kind) | ... | bit(Kinds))) {}
+
+        constexpr bool contains(tok::TokenKind Kind) const { return (Bits >> Kind) & 1; }
+
+        constexpr TokenSet operator|(TokenSet Other) const {
+            TokenSet Result;
+            Result.Bits = Bits | Other.Bits;
+            return Result;
+        }
+    };
+}
+#endif //TINYLANG3_TOKENSET_H
@@ -5,6 +5,62 @@
 #pragma once
 
 #include "tinylang/AST/AST.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 
+namespace tinylang {
+    class CGModule {
+        llvm::Module *M;
+        ModuleDeclaration *Mod;
+
+        // Global variables of the module.
+        llvm::DenseMap<Decl *, llvm::GlobalObject *> Globals;
+
+        void emitProcedure(ProcedureDeclaration *Proc);
+
+        void emitGlobals(llvm::GlobalValue::LinkageTypes Linkage, bool Define);
+
+    public:
+        llvm::Type *VoidTy;
+        llvm::Type *Int1Ty;
+        llvm::Type *Int32Ty;
+        llvm::Type *Int64Ty;
+        llvm::Constant *Int32Zero;
+
+        CGModule(llvm::Module *M) : M(M), Mod(nullptr) { initialize(); }
+
+        void initialize();
+
+        llvm::LLVMContext &getLLVMCtx() { return M->getContext(); }
+
+        llvm::Module *getModule() { return M; }
+
+        ModuleDeclaration *getModuleDeclaration() { return Mod; }
+
+        llvm::Type *convertType(TypeDeclaration *Ty);
+
+        static std::string mangleName(Decl *D);
+
+        llvm::GlobalObject *getGlobal(Decl *D);
+
+        llvm::FunctionType *getFunctionType(ProcedureDeclaration *Proc);
+
+        // Returns the function for the procedure, declaring it on first use.
+        llvm::Function *getOrCreateFunction(ProcedureDeclaration *Proc);
+
+        // Returns the declaration of the function which reports a runtime
+        // error, see CodeGenerator::getRuntimeErrorName.
+        llvm::Function *getRuntimeError();
+
+        void run(ModuleDeclaration *Mod);
+
+        // Emits the module variables and the module body. The procedures
+        // are only declared.
+        void runModuleInit(ModuleDeclaration *Mod);
+
+        // Emits a single procedure, without its nested procedures. The
+        // module variables are only declared.
+        void runProcedure(ModuleDeclaration *Mod, ProcedureDeclaration *Proc);
+    };
+}
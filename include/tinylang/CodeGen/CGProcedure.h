@@ -3,3 +3,130 @@
 //
 
 #pragma once
+
+#include "tinylang/CodeGen/CGModule.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/ValueHandle.h"
+
+namespace tinylang {
+    // Emits the body of a procedure or of the module. Local variables and
+    // value parameters are kept in SSA form, which is constructed directly
+    // while the statements are walked: a read looks up the definition in
+    // the current block and inserts phis where the control flow joins.
+    // Blocks whose predecessors are not all known yet are unsealed; the
+    // phis in them stay incomplete until the block is sealed.
+    class CGProcedure {
+        CGModule &CGM;
+        llvm::IRBuilder<> Builder;
+
+        llvm::BasicBlock *Curr;
+
+        Decl *Proc;
+        llvm::Function *Fn;
+
+        struct BasicBlockDef {
+            // Maps the variable to its current value in the block.
+            llvm::DenseMap<Decl *, llvm::TrackingVH<llvm::Value>> Defs;
+            // Phis which are waiting for the block to be sealed.
+            llvm::DenseMap<llvm::PHINode *, Decl *> IncompletePhis;
+            unsigned Sealed: 1;
+
+            BasicBlockDef() : Sealed(0) {}
+        };
+
+        llvm::DenseMap<llvm::BasicBlock *, BasicBlockDef> CurrentDef;
+
+        llvm::DenseMap<FormalParameterDeclaration *, llvm::Argument *> FormalParams;
+
+        // Local variables and value parameters which are passed to a VAR
+        // parameter need an address, so they live in a stack slot instead.
+        llvm::DenseMap<Decl *, llvm::AllocaInst *> Slots;
+
+        // The block which reports a division by zero, shared by all
+        // divisions of the function.
+        llvm::BasicBlock *DivisionByZero;
+
+        void writeLocalVariable(llvm::BasicBlock *BB, Decl *Decl, llvm::Value *Val);
+
+        llvm::Value *readLocalVariable(llvm::BasicBlock *BB, Decl *Decl);
+
+        llvm::Value *readLocalVariableRecursive(llvm::BasicBlock *BB, Decl *Decl);
+
+        llvm::PHINode *addEmptyPhi(llvm::BasicBlock *BB, Decl *Decl);
+
+        llvm::Value *addPhiOperands(llvm::BasicBlock *BB, Decl *Decl, llvm::PHINode *Phi);
+
+        llvm::Value *optimizePhi(llvm::PHINode *Phi);
+
+        void sealBlock(llvm::BasicBlock *BB);
+
+        void writeVariable(llvm::BasicBlock *BB, Decl *Decl, llvm::Value *Val);
+
+        llvm::Value *readVariable(llvm::BasicBlock *BB, Decl *Decl);
+
+        llvm::Value *getAddress(Decl *Decl);
+
+        llvm::Type *mapType(Decl *Decl);
+
+        void findAddressTaken(ArrayRef<Stmt *> Stmts, llvm::DenseSet<Decl *> &Vars);
+
+        void findAddressTaken(Expr *E, llvm::DenseSet<Decl *> &Vars);
+
+        bool isUnreachable(llvm::BasicBlock *BB);
+
+        void finishUnreachable();
+
+        void emitBranch(llvm::BasicBlock *Target);
+
+        void emitPrologue(ArrayRef<FormalParameterDeclaration *> Params,
+                          ArrayRef<Decl *> Decls, ArrayRef<Stmt *> Stmts);
+
+        void emitEpilogue(TypeDeclaration *RetType);
+
+        llvm::Value *emitInfixExpr(InfixExpression *E);
+
+        llvm::Value *emitLogicalExpr(InfixExpression *E);
+
+        llvm::Value *emitDivision(bool IsMod, llvm::Value *Left, llvm::Value *Right);
+
+        llvm::Value *emitPrefixExpr(PrefixExpression *E);
+
+        llvm::Value *emitExpr(Expr *E);
+
+        llvm::CallInst *emitCall(ProcedureDeclaration *Callee, ArrayRef<Expr *> Args);
+
+        void emitStmt(AssignmentStatement *Stmt);
+
+        void emitStmt(ProcedureCallStatement *Stmt);
+
+        void emitStmt(IfStatement *Stmt);
+
+        void emitStmt(WhileStatement *Stmt);
+
+        void emitStmt(ReturnStatement *Stmt);
+
+        void emit(ArrayRef<Stmt *> Stmts);
+
+        void setCurr(llvm::BasicBlock *BB) {
+            Curr = BB;
+            Builder.SetInsertPoint(Curr);
+        }
+
+        llvm::BasicBlock *createBasicBlock(const llvm::Twine &Name,
+                                           llvm::BasicBlock *InsertBefore = nullptr) {
+            return llvm::BasicBlock::Create(CGM.getLLVMCtx(), Name, Fn, InsertBefore);
+        }
+
+    public:
+        CGProcedure(CGModule &CGM) :
+                CGM(CGM), Builder(CGM.getLLVMCtx()), Curr(nullptr), Proc(nullptr), Fn(nullptr),
+                DivisionByZero(nullptr) {}
+
+        void run(ProcedureDeclaration *Proc);
+
+        // Emits the statements of the module body into a function which has
+        // the mangled name of the module.
+        void run(ModuleDeclaration *Mod);
+    };
+}
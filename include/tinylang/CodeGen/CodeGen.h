@@ -16,10 +16,29 @@ namespace tinylang {
         CodeGenerator(llvm::LLVMContext &Ctx, llvm::TargetMachine *TM) :
                 Ctx(Ctx), TM(TM), CM(nullptr) {}
 
+        std::unique_ptr<llvm::Module> createModule(std::string FileName);
+
     public:
         static CodeGenerator *create(llvm::LLVMContext &Ctx, llvm::TargetMachine *TM);
 
         std::unique_ptr<llvm::Module> run(ModuleDeclaration *CM, std::string FileName);
 
+        // For lazy compilation, the module body and each procedure can be
+        // generated into separate LLVM modules.
+        std::unique_ptr<llvm::Module> runModuleInit(ModuleDeclaration *CM, std::string FileName);
+
+        std::unique_ptr<llvm::Module> runProcedure(ModuleDeclaration *CM, ProcedureDeclaration *Proc,
+                                                   std::string FileName);
+
+        // The symbol of a procedure, or of the function which runs the
+        // body of a module.
+        static std::string getMangledName(Decl *D);
+
+        // The function which the generated code calls on a runtime error,
+        // e.g. a division by zero, with the message as a C string. It does
+        // not return. The JIT provides it; a program which links an object
+        // file must define it.
+        static StringRef getRuntimeErrorName() { return "tinylang_runtime_error"; }
+
     };
 }
\ No newline at end of file
@@ -0,0 +1,118 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#pragma once
+
+#include "tinylang/AST/AST.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/FunctionExtras.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/LazyReexports.h"
+#include "llvm/Target/TargetMachine.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+namespace tinylang {
+    class ProcedureMaterializationUnit;
+
+    // Runs tinylang modules in-process on top of an LLJIT. The JIT either
+    // compiles a whole module up front, or only the module body, and each
+    // procedure on its first call. In the lazy mode every procedure is
+    // reached through an indirection stub, and its code is generated,
+    // optimized and compiled when the stub is first called.
+    class JIT {
+        friend class ProcedureMaterializationUnit;
+
+    public:
+        enum class Mode {
+            Eager,
+            Lazy,
+            // Lazy, and the callees of a procedure are compiled in the
+            // background as soon as the procedure itself is compiled.
+            Speculative,
+            // Procedures are compiled in the background when the interpreter
+            // asks for them, see TieredEngine.
+            Tiered
+        };
+
+        // Runs the optimization pipeline on a generated module.
+        using OptimizeFunction = std::function<void(llvm::Module &)>;
+
+        // Receives the address of the entry point of a procedure.
+        using ReadyFunction = llvm::unique_function<void(llvm::Expected<llvm::JITTargetAddress>)>;
+
+    private:
+        std::unique_ptr<llvm::orc::LLJIT> LLJ;
+        std::unique_ptr<llvm::orc::LazyCallThroughManager> LCTM;
+        std::unique_ptr<llvm::orc::IndirectStubsManager> ISM;
+        llvm::TargetMachine &TM;
+
+        // The pipeline uses the shared TargetMachine, which is not thread
+        // safe. Background compilation must not run it concurrently.
+        OptimizeFunction Optimize;
+        std::mutex OptimizeMutex;
+
+        Mode Kind;
+
+        // The dylib with the implementations of the procedures of a module.
+        llvm::DenseMap<ModuleDeclaration *, llvm::orc::JITDylib *> ImplDylibs;
+
+        // The dylib of a module added with add, which has its variables.
+        llvm::DenseMap<ModuleDeclaration *, llvm::orc::JITDylib *> Dylibs;
+
+        // Number of background lookups which are still in flight.
+        std::mutex PendingMutex;
+        std::condition_variable PendingCV;
+        unsigned Pending = 0;
+
+        JIT(llvm::TargetMachine &TM, OptimizeFunction Optimize, Mode Kind) :
+                TM(TM), Optimize(std::move(Optimize)), Kind(Kind) {}
+
+        void optimize(llvm::Module &M);
+
+        void emitProcedure(std::unique_ptr<llvm::orc::MaterializationResponsibility> R,
+                           ModuleDeclaration *Mod, ProcedureDeclaration *Proc,
+                           llvm::orc::JITDylib &ImplJD);
+
+        void lookupInBackground(llvm::orc::JITDylib &JD, llvm::orc::SymbolLookupSet Symbols,
+                                llvm::unique_function<void(llvm::Expected<llvm::orc::SymbolMap>)> OnDone);
+
+        void speculateCallees(ProcedureDeclaration *Proc, llvm::orc::JITDylib &ImplJD);
+
+        llvm::Error addLazyProcedures(llvm::orc::JITDylib &JD, ModuleDeclaration *Mod);
+
+    public:
+        static llvm::Expected<std::unique_ptr<JIT>> create(
+                llvm::TargetMachine &TM, OptimizeFunction Optimize, Mode Kind);
+
+        ~JIT();
+
+        // Adds the module and returns the function which runs its body.
+        // The AST must stay alive until waitForCompiles returns.
+        llvm::Expected<void (*)()> add(ModuleDeclaration *Mod, StringRef FileName);
+
+        // The address of a variable of a module added with add.
+        llvm::Expected<void *> getVariableAddress(ModuleDeclaration *Mod, VariableDeclaration *Var);
+
+        // In the tiered mode, adds the procedures of the module without
+        // compiling them. The module variables live at the given addresses.
+        llvm::Error addProcedures(ModuleDeclaration *Mod, StringRef FileName,
+                                  const llvm::DenseMap<Decl *, int64_t *> &Globals);
+
+        // Compiles a procedure added by addProcedures in the background. The
+        // entry point takes the arguments from an array of int64_t and
+        // returns the result as int64_t. OnReady runs on the compile thread.
+        void compileInBackground(ModuleDeclaration *Mod, ProcedureDeclaration *Proc, ReadyFunction OnReady);
+
+        // Blocks until no background compilation is left.
+        void waitForCompiles();
+
+        // Calls Run, which runs native code of the JIT on this thread. A
+        // runtime error in the native code ends Run and is returned. Run must
+        // not hold objects with destructors while the native code runs.
+        static llvm::Error runNative(llvm::function_ref<llvm::Error()> Run);
+    };
+}
@@ -0,0 +1,51 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#pragma once
+
+#include "tinylang/JIT/JIT.h"
+#include "tinylang/VM/Interpreter.h"
+#include <atomic>
+
+namespace tinylang {
+    // Runs a module in the bytecode interpreter, which starts immediately.
+    // Procedures which get hot are compiled by the JIT in the background,
+    // and later calls run the native code. Native code calls other
+    // procedures through the lazy stubs of the JIT, and shares the module
+    // variables with the interpreter.
+    //
+    // A procedure only switches to native code on its next call, a running
+    // activation stays in the interpreter.
+    class TieredEngine {
+        JIT &J;
+        ModuleDeclaration *Mod;
+        std::unique_ptr<vm::Program> P;
+        std::unique_ptr<vm::Interpreter> Interp;
+        std::atomic<unsigned> NumCompiled{0};
+
+        TieredEngine(JIT &J, ModuleDeclaration *Mod) : J(J), Mod(Mod) {}
+
+        void tierUp(unsigned FnIndex);
+
+    public:
+        // A procedure is hot after HotThreshold calls and loop iterations.
+        static llvm::Expected<std::unique_ptr<TieredEngine>> create(
+                JIT &J, ModuleDeclaration *Mod, StringRef FileName, unsigned HotThreshold);
+
+        // Waits for the background compilation.
+        ~TieredEngine();
+
+        // Runs the module body.
+        llvm::Error run();
+
+        // The storage of a module variable, which the interpreter and the
+        // native code share.
+        int64_t *getVariable(VariableDeclaration *Var) {
+            return &Interp->getGlobals()[P->GlobalIndex.lookup(Var)];
+        }
+
+        // Number of procedures which run as native code.
+        unsigned getNumCompiled() const { return NumCompiled; }
+    };
+}
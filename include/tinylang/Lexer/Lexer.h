@@ -6,50 +6,42 @@
 #define TINYLANG3_LEXER_H
 
 #include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/IdentifierTable.h"
 #include "tinylang/Basic/LLVM.h"
 #include "tinylang/Lexer/Token.h"
+#include "tinylang/Lexer/TokenStream.h"
 #include "llvm/ADT/StringRef.h"
-#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/SourceMgr.h"
 
 namespace tinylang {
+    // Keyword lookup through a perfect hash table which is built at compile
+    // time from TokenKinds.def, so there is nothing to set up per Lexer.
     class KeyWordFilter {
-        llvm::StringMap<tok::TokenKind> HashTable;
-
-        void addKeyword(StringRef Keyword,
-                        tok::TokenKind TokenCode);
-
     public:
-        void addKeyWords();
-
-        tok::TokenKind getKeyWord(
+        static tok::TokenKind getKeyWord(
                 StringRef Name,
-                tok::TokenKind DefaultTokenCode = tok::unknown) {
-            auto Result = HashTable.find(Name);
-            if (Result != HashTable.end()) {
-                return Result->second;
-            }
-            return DefaultTokenCode;
-        }
+                tok::TokenKind DefaultTokenCode = tok::unknown);
     };
 
     class Lexer {
         SourceMgr &SrcMgr;
         DiagnosticEngine &Diags;
 
+        // Null while lexing speculatively, see lexParallel().
+        IdentifierTable *Idents;
+
         const char *CurPtr;
         StringRef CurBuf;
 
         unsigned CurBuffer{0};
-        KeyWordFilter Keywords;
     public:
         Lexer(SourceMgr &SrcMgr,
-              DiagnosticEngine &Diags) : SrcMgr(SrcMgr), Diags(Diags) {
+              DiagnosticEngine &Diags,
+              IdentifierTable &Idents) : SrcMgr(SrcMgr), Diags(Diags), Idents(&Idents) {
             CurBuffer = SrcMgr.getMainFileID();
             CurBuf = SrcMgr.getMemoryBuffer(CurBuffer)->getBuffer();
             CurPtr = CurBuf.begin();
-            Keywords.addKeyWords();
         }
 
         DiagnosticEngine &getDiagnostics() const {
@@ -58,6 +50,16 @@ namespace tinylang {
 
         void next(Token &Result);
 
+        // Makes the next token eof, to give up on the rest of the buffer.
+        void skipToEnd() { CurPtr = CurBuf.end(); }
+
+        // Lexes the rest of the buffer into Tokens, including the eof token.
+        void lex(TokenStream &Tokens);
+
+        // Same as lex(), but a large buffer is split into chunks which are
+        // lexed on up to NumThreads threads. The result is identical.
+        void lexParallel(TokenStream &Tokens, unsigned NumThreads);
+
         StringRef getBuffer() const { return CurBuf; }
 
     private:
@@ -69,6 +71,11 @@ namespace tinylang {
 
         void comment();
 
+        // Lexes the tokens starting before Limit into Tokens. Returns the
+        // start of the first token at or after Limit, or nullptr once the eof
+        // token was added. A null Limit lexes up to eof.
+        const char *lexUntil(TokenStream &Tokens, const char *Limit);
+
         SMLoc getLoc() { return SMLoc::getFromPointer(CurPtr); }
 
         void formToken(Token &Result, const char *TokEnd,
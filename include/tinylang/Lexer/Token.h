@@ -7,18 +7,27 @@
 
 #include "tinylang/Basic/LLVM.h"
 #include "tinylang/Basic/TokenKinds.h"
+#include "tinylang/Basic/TokenSet.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/SMLoc.h"
 
 namespace tinylang {
     class Lexer;
 
+    class TokenStream;
+
     class Token {
         friend class Lexer;
 
+        friend class TokenStream;
+
         const char *Ptr;
         size_t Length;
         tok::TokenKind Kind;
+        union {
+            unsigned IdentifierID;
+            int64_t IntegerValue;
+        };
     public:
         tok::TokenKind getKind() const { return Kind; }
 
@@ -37,6 +46,8 @@ namespace tinylang {
             return is(K1) || isOneOf(K2, Ks...);
         }
 
+        bool isOneOf(TokenSet Kinds) const { return Kinds.contains(Kind); }
+
         const char *getName() const {
             return tok::getTokenName(Kind);
         }
@@ -52,6 +63,19 @@ namespace tinylang {
             return StringRef(Ptr, Length);
         }
 
+        // The interned ID of an identifier, see IdentifierTable.
+        unsigned getIdentifierID() const {
+            assert(is(tok::identifier) && "Cannot get identifier ID of non-identifier");
+            return IdentifierID;
+        }
+
+        // The value of an integer literal, or -1 if it does not fit into an
+        // int64_t.
+        int64_t getIntegerValue() const {
+            assert(is(tok::integer_literal) && "Cannot get value of non-integer");
+            return IntegerValue;
+        }
+
         StringRef getLiteralData() {
             assert(isOneOf(tok::integer_literal,
                            tok::string_literal) &&
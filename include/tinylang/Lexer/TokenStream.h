@@ -0,0 +1,130 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#ifndef TINYLANG3_TOKENSTREAM_H
+#define TINYLANG3_TOKENSTREAM_H
+
+#include "tinylang/Basic/IdentifierTable.h"
+#include "tinylang/Basic/LLVM.h"
+#include "tinylang/Basic/TokenKinds.h"
+#include "tinylang/Lexer/Token.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/SMLoc.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace tinylang {
+    // All tokens of a buffer, lexed up front. The tokens are stored as a
+    // structure of arrays: 16-bit kinds and 32-bit offsets and lengths
+    // relative to the start of the buffer, and 32-bit data which holds the
+    // identifier ID of identifiers and the index into IntegerValues of
+    // integer literals. The last token is always eof.
+    class TokenStream {
+        const char *BufferStart;
+        std::vector<uint16_t> Kinds;
+        std::vector<uint32_t> Offsets;
+        std::vector<uint32_t> Lengths;
+        std::vector<uint32_t> Data;
+        std::vector<int64_t> IntegerValues;
+    public:
+        explicit TokenStream(StringRef Buffer) : BufferStart(Buffer.begin()) {
+            assert(Buffer.size() <= UINT32_MAX &&
+                   "Buffer too large for 32-bit token offsets");
+        }
+
+        void reserve(size_t NumTokens) {
+            Kinds.reserve(NumTokens);
+            Offsets.reserve(NumTokens);
+            Lengths.reserve(NumTokens);
+            Data.reserve(NumTokens);
+        }
+
+        void push_back(const Token &Tok) {
+            Kinds.push_back(Tok.Kind);
+            Offsets.push_back(static_cast<uint32_t>(Tok.Ptr - BufferStart));
+            Lengths.push_back(static_cast<uint32_t>(Tok.Length));
+            if (Tok.is(tok::identifier)) {
+                Data.push_back(Tok.IdentifierID);
+            } else if (Tok.is(tok::integer_literal)) {
+                Data.push_back(static_cast<uint32_t>(IntegerValues.size()));
+                IntegerValues.push_back(Tok.IntegerValue);
+            } else
+                Data.push_back(0);
+        }
+
+        // Appends the tokens of Other, which must refer to the same buffer,
+        // starting at index From.
+        void append(const TokenStream &Other, size_t From = 0) {
+            assert(BufferStart == Other.BufferStart && "Different buffers");
+            size_t Start = Kinds.size();
+            Kinds.insert(Kinds.end(), Other.Kinds.begin() + From, Other.Kinds.end());
+            Offsets.insert(Offsets.end(), Other.Offsets.begin() + From, Other.Offsets.end());
+            Lengths.insert(Lengths.end(), Other.Lengths.begin() + From, Other.Lengths.end());
+            Data.insert(Data.end(), Other.Data.begin() + From, Other.Data.end());
+            for (size_t I = Start, E = Kinds.size(); I != E; ++I) {
+                if (Kinds[I] == tok::integer_literal) {
+                    IntegerValues.push_back(Other.IntegerValues[Data[I]]);
+                    Data[I] = static_cast<uint32_t>(IntegerValues.size() - 1);
+                }
+            }
+        }
+
+        // Interns the identifiers from index From on, in order.
+        void internIdentifiers(IdentifierTable &Idents, size_t From) {
+            for (size_t I = From, E = Kinds.size(); I != E; ++I)
+                if (Kinds[I] == tok::identifier)
+                    Data[I] = Idents.get(StringRef(BufferStart + Offsets[I], Lengths[I]));
+        }
+
+        // Index of the first token starting at or after Ptr, or size().
+        size_t lowerBound(const char *Ptr) const {
+            uint32_t Offset = static_cast<uint32_t>(Ptr - BufferStart);
+            return std::lower_bound(Offsets.begin(), Offsets.end(), Offset) -
+                   Offsets.begin();
+        }
+
+        // Index of the first token from index From on whose kind satisfies
+        // Pred, or size(). Only reads the kinds.
+        template<typename Predicate>
+        size_t find(size_t From, Predicate Pred) const {
+            for (size_t I = From, E = Kinds.size(); I < E; ++I)
+                if (Pred(static_cast<tok::TokenKind>(Kinds[I])))
+                    return I;
+            return Kinds.size();
+        }
+
+        size_t size() const { return Kinds.size(); }
+
+        bool empty() const { return Kinds.empty(); }
+
+        // Indices past the end refer to the final eof token.
+        tok::TokenKind getKind(size_t Idx) const {
+            return static_cast<tok::TokenKind>(Kinds[clamp(Idx)]);
+        }
+
+        SMLoc getLocation(size_t Idx) const {
+            return SMLoc::getFromPointer(BufferStart + Offsets[clamp(Idx)]);
+        }
+
+        void get(size_t Idx, Token &Result) const {
+            Idx = clamp(Idx);
+            Result.Ptr = BufferStart + Offsets[Idx];
+            Result.Length = Lengths[Idx];
+            Result.Kind = static_cast<tok::TokenKind>(Kinds[Idx]);
+            if (Result.Kind == tok::integer_literal)
+                Result.IntegerValue = IntegerValues[Data[Idx]];
+            else
+                Result.IdentifierID = Data[Idx];
+        }
+
+    private:
+        size_t clamp(size_t Idx) const {
+            assert(!empty() && "Token stream without eof token");
+            return Idx < Kinds.size() ? Idx : Kinds.size() - 1;
+        }
+    };
+}
+#endif //TINYLANG3_TOKENSTREAM_H
@@ -18,36 +18,102 @@ namespace tinylang {
         Sema &Actions;
         Token Tok;
 
+        // Set if the input was lexed up front. NextToken is the index of
+        // the token after Tok.
+        const TokenStream *Tokens;
+        size_t NextToken;
+
         DiagnosticEngine &getDiagnostics() const {
             return Lex.getDiagnostics();
         }
 
-        void advance() { Lex.next(Tok); }
+        void advance() {
+            if (Tokens)
+                Tokens->get(NextToken++, Tok);
+            else
+                Lex.next(Tok);
+        }
 
-        bool expect(tok::TokenKind ExpectedTok) {
-            if (Tok.is(ExpectedTok)) {
+        // Kind of the N-th token after Tok. Requires a token stream.
+        tok::TokenKind peek(unsigned N = 1) const {
+            assert(Tokens && "Lookahead requires a token stream");
+            return Tokens->getKind(NextToken + N - 1);
+        }
+
+        // Position of Tok, to backtrack to later. Requires a token stream.
+        size_t getPosition() const {
+            assert(Tokens && "Backtracking requires a token stream");
+            return NextToken - 1;
+        }
+
+        void backtrack(size_t Position) {
+            assert(Tokens && "Backtracking requires a token stream");
+            NextToken = Position;
+            advance();
+        }
+
+        // Skips to the next token in Follow, for error recovery. Returns
+        // true if the end of the input comes first. A token stream is
+        // searched in one scan over the kinds. Once the error limit is
+        // reached, the rest of the input is skipped.
+        bool skipUntil(TokenSet Follow) {
+            if (Tok.isOneOf(Follow))
                 return false;
+            if (getDiagnostics().hasReachedErrorLimit()) {
+                if (Tokens)
+                    NextToken = Tokens->size();
+                else
+                    Lex.skipToEnd();
+                advance();
+                return true;
             }
-            const char *Expected = tok::getPunctuatorSpelling(ExpectedTok);
-            if (!Expected) {
-                Expected = tok::getKeywordSpelling(ExpectedTok);
+            TokenSet Stop = Follow | TokenSet(tok::eof);
+            if (Tokens) {
+                NextToken = Tokens->find(NextToken, [Stop](tok::TokenKind Kind) {
+                    return Stop.contains(Kind);
+                });
+                advance();
+            } else {
+                do
+                    advance();
+                while (!Tok.isOneOf(Stop));
             }
+            return Tok.is(tok::eof);
+        }
+
+        // Reports that Tok is not the start of What, e.g. "expression".
+        // Every path that skips input reports an error first, so that no
+        // incomplete AST reaches code generation.
+        void reportExpected(StringRef What) {
             llvm::StringRef Actual(Tok.getLocation().getPointer(),
                                    Tok.getLength());
             getDiagnostics().report(Tok.getLocation(),
-                                    diag::err_expected, Expected, Actual);
-
-            return true;
+                                    diag::err_expected, What, Actual);
         }
 
-        bool consume(tok::TokenKind ExpectedTok) {
+        bool expect(tok::TokenKind ExpectedTok) {
             if (Tok.is(ExpectedTok)) {
-                advance();
                 return false;
             }
+            const char *Expected = tok::getPunctuatorSpelling(ExpectedTok);
+            if (!Expected) {
+                Expected = tok::getKeywordSpelling(ExpectedTok);
+            }
+            if (!Expected) {
+                // An identifier or literal has no spelling.
+                Expected = tok::getTokenName(ExpectedTok);
+            }
+            reportExpected(Expected);
             return true;
         }
 
+        bool consume(tok::TokenKind ExpectedTok) {
+            if (expect(ExpectedTok))
+                return true;
+            advance();
+            return false;
+        }
+
         bool parseCompilationUnit(ModuleDeclaration *&D);
 
         bool parseImport();
@@ -81,17 +147,9 @@ namespace tinylang {
 
         bool parseExpList(ExprList &Exprs);
 
-        bool parseExpression(Expr *&E);
-
-        bool parseRelation(OperatorInfo &Op);
-
-        bool parseSimpleExpression(Expr *&E);
-
-        bool parseAddOperator(OperatorInfo &Op);
-
-        bool parseTerm(Expr *&E);
-
-        bool parseMulOperator(OperatorInfo &Op);
+        // Parses the operators binding at least as tightly as MinPrecedence,
+        // where 1 is a relation and 3 a multiplicative operator.
+        bool parseExpression(Expr *&E, unsigned MinPrecedence = 1);
 
         bool parseFactor(Expr *&E);
 
@@ -102,6 +160,9 @@ namespace tinylang {
     public:
         Parser(Lexer &Lex, Sema &Actions);
 
+        // Parses from a pre-lexed token stream instead of calling the lexer.
+        Parser(Lexer &Lex, const TokenStream &Tokens, Sema &Actions);
+
         ModuleDeclaration *parse();
 
     };
@@ -6,23 +6,54 @@
 #define TINYLANG3_SCOPE_H
 
 #include "tinylang/Basic/LLVM.h"
-#include "llvm/ADT/StringRef.h"
-#include "llvm/ADT/StringMap.h"
+#include <vector>
 
 namespace tinylang {
     class Decl;
 
+    // All open scopes in one flat table. Every interned name maps to its
+    // innermost visible declaration, so a lookup is a single index
+    // operation. Shadowed bindings are saved on an undo stack and restored
+    // in bulk when the scope is left. The vectors keep their capacity, so
+    // entering and leaving a scope does not allocate once they are warm.
     class Scope {
-        Scope *Parent;
-        StringMap<Decl *> Symbols;
+        struct Binding {
+            Decl *D = nullptr;
+            unsigned Depth = 0;
+        };
+
+        struct SavedBinding {
+            unsigned NameID;
+            Binding Previous;
+        };
+
+        std::vector<Binding> Bindings;
+        std::vector<SavedBinding> Shadowed;
+        std::vector<unsigned> Markers;
+
     public:
-        Scope(Scope *Parent = nullptr) : Parent(Parent) {}
+        void enter() { Markers.push_back(Shadowed.size()); }
 
+        void leave();
+
+        unsigned getDepth() const { return Markers.size(); }
+
+        // Returns false if the name is already declared in the innermost scope.
         bool insert(Decl *Declaration);
 
-        Decl *lookup(StringRef Name);
+        Decl *lookup(unsigned NameID) const {
+            return NameID < Bindings.size() ? Bindings[NameID].D : nullptr;
+        }
+
+        // The number of names which had a binding at some point.
+        size_t getNumBindings() const { return Bindings.size(); }
 
-        Scope *getParent() { return Parent; }
+        // The bytes reserved by the tables, which only grow.
+        size_t getMemorySize() const {
+            return Bindings.capacity() * sizeof(Binding) +
+                   Shadowed.capacity() * sizeof(SavedBinding) +
+                   Markers.capacity() * sizeof(unsigned);
+        }
     };
 
 }
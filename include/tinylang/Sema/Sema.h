@@ -6,7 +6,9 @@
 #define TINYLANG3_SEMA_H
 
 #include "tinylang/AST/AST.h"
+#include "tinylang/AST/ASTContext.h"
 #include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/IdentifierTable.h"
 #include "tinylang/Sema/Scope.h"
 #include <memory>
 
@@ -22,12 +24,14 @@ namespace tinylang {
                                TypeDeclaration *Ty);
 
         void checkFormalAndActualParameters(
-                SMLoc Loc, const FormalParamList &Formals,
-                const ExprList &Actuals);
+                SMLoc Loc, ArrayRef<FormalParameterDeclaration *> Formals,
+                ArrayRef<Expr *> Actuals);
 
-        Scope *CurrentScope;
+        Scope Scopes;
         Decl *CurrentDecl;
+        ASTContext &Context;
         DiagnosticEngine &Diags;
+        IdentifierTable &Idents;
 
         TypeDeclaration *IntegerType;
         TypeDeclaration *BooleanType;
@@ -39,21 +43,25 @@ namespace tinylang {
         ConstantDeclaration *FalseConst;
 
     public:
-        Sema(DiagnosticEngine &Diags) : CurrentScope(nullptr), CurrentDecl(nullptr), Diags(Diags) { initialize(); }
+        Sema(ASTContext &Context, DiagnosticEngine &Diags, IdentifierTable &Idents) :
+                CurrentDecl(nullptr), Context(Context), Diags(Diags),
+                Idents(Idents) { initialize(); }
 
         void initialize();
 
-        ModuleDeclaration *actOnModuleDeclaration(SMLoc Loc, StringRef Name);
+        const Scope &getScope() const { return Scopes; }
+
+        ModuleDeclaration *actOnModuleDeclaration(const Ident &Name);
 
         void actOnModuleDeclaration(ModuleDeclaration *ModDecl,
-                                    SMLoc Loc, StringRef Name,
+                                    const Ident &Name,
                                     DeclList &Decls,
                                     StmtList &Stmts);
 
         void actOnImport(StringRef ModuleName, IdentList &Ids);
 
         void actOnConstantDeclaration(DeclList &Decls,
-                                      SMLoc Loc, StringRef Name, Expr *E);
+                                      const Ident &Name, Expr *E);
 
         void actOnVariableDeclaration(DeclList &Decls,
                                       IdentList &Ids, Decl *D);
@@ -61,15 +69,15 @@ namespace tinylang {
         void actOnFormalParameterDeclaration(FormalParamList &Params,
                                              IdentList &IDs, Decl *D, bool IsVar);
 
-        ProcedureDeclaration *actOnProcedureDeclaration(SMLoc Loc, StringRef Name);
+        ProcedureDeclaration *actOnProcedureDeclaration(const Ident &Name);
 
         void actOnProcedureHeading(ProcedureDeclaration *ProcDecl,
                                    FormalParamList &Params,
                                    Decl *RetType);
 
         void actOnProcedureDeclaration(
-                ProcedureDeclaration *ProcDecl, SMLoc Loc,
-                StringRef Name, DeclList &Decls, StmtList &Stmts);
+                ProcedureDeclaration *ProcDecl,
+                const Ident &Name, DeclList &Decls, StmtList &Stmts);
 
         void actOnAssignment(StmtList &Stmts, SMLoc Loc, Decl *D,
                              Expr *E);
@@ -102,14 +110,15 @@ namespace tinylang {
         Expr *actOnPrefixExpression(Expr *E,
                                     const OperatorInfo &Op);
 
-        Expr *actOnIntegerLiteral(SMLoc Loc, StringRef Literal);
+        // Value is the value computed by the lexer, or -1 if Literal must
+        // be parsed with arbitrary precision.
+        Expr *actOnIntegerLiteral(SMLoc Loc, StringRef Literal, int64_t Value);
 
-        Expr *actOnVariable(Decl *D);
+        Expr *actOnVariable(SMLoc Loc, Decl *D);
 
         Expr *actOnFunctionCall(Decl *D, ExprList &Params);
 
-        Decl *actOnQualIdentPart(Decl *Prev, SMLoc Loc,
-                                 StringRef Name);
+        Decl *actOnQualIdentPart(Decl *Prev, const Ident &Name);
 
     };
 
@@ -0,0 +1,80 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#pragma once
+
+#include "tinylang/AST/AST.h"
+#include "llvm/ADT/DenseMap.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tinylang {
+    namespace vm {
+        enum Opcode : uint8_t {
+#define OPCODE(ID) ID,
+
+#include "tinylang/VM/Opcodes.def"
+
+            NUM_OPCODES
+        };
+
+        // Three address code over the registers of a frame. C is a register,
+        // the offset of a jump target, or the index of a global or function.
+        struct Instruction {
+            Opcode Op;
+            uint16_t A;
+            uint16_t B;
+            uint32_t C;
+
+            Instruction(Opcode Op, uint16_t A, uint16_t B, uint32_t C) :
+                    Op(Op), A(A), B(B), C(C) {}
+        };
+
+        // The frame of a function starts with the parameters, followed by the
+        // local variables, the constants and the temporaries. A VAR parameter
+        // holds the address of the variable. The locals are zeroed and the
+        // constants copied into the frame on each call, so that every operand
+        // is a register.
+        struct Function {
+            // The procedure, or the module for the module body.
+            Decl *Proc{nullptr};
+            std::string Name;
+            unsigned NumParams{0};
+            unsigned ConstBase{0};
+            unsigned NumRegs{0};
+            std::vector<int64_t> Constants;
+            std::vector<Instruction> Code;
+        };
+
+        // INTEGER arithmetic wraps around. The divisor must not be zero.
+        inline int64_t addWrap(int64_t L, int64_t R) {
+            return static_cast<int64_t>(static_cast<uint64_t>(L) + static_cast<uint64_t>(R));
+        }
+
+        inline int64_t subWrap(int64_t L, int64_t R) {
+            return static_cast<int64_t>(static_cast<uint64_t>(L) - static_cast<uint64_t>(R));
+        }
+
+        inline int64_t mulWrap(int64_t L, int64_t R) {
+            return static_cast<int64_t>(static_cast<uint64_t>(L) * static_cast<uint64_t>(R));
+        }
+
+        inline int64_t divWrap(int64_t L, int64_t R) {
+            return R == -1 ? subWrap(0, L) : L / R;
+        }
+
+        inline int64_t modWrap(int64_t L, int64_t R) {
+            return R == -1 ? 0 : L % R;
+        }
+
+        // The bytecode of a module. Function 0 runs the module body.
+        struct Program {
+            std::vector<Function> Functions;
+            unsigned NumGlobals{0};
+            llvm::DenseMap<Decl *, unsigned> FunctionIndex;
+            llvm::DenseMap<Decl *, unsigned> GlobalIndex;
+        };
+    }
+}
@@ -0,0 +1,18 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#pragma once
+
+#include "tinylang/VM/Bytecode.h"
+#include <memory>
+
+namespace tinylang {
+    namespace vm {
+        // Translates a checked module into bytecode for the Interpreter.
+        class BytecodeCompiler {
+        public:
+            static std::unique_ptr<Program> compile(ModuleDeclaration *Mod);
+        };
+    }
+}
@@ -0,0 +1,79 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#pragma once
+
+#include "tinylang/VM/Bytecode.h"
+#include "llvm/Support/Error.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace tinylang {
+    namespace vm {
+        // Executes the bytecode of a Program. All frames live in one register
+        // stack of fixed size, so the address of a register stays valid
+        // while its function runs.
+        //
+        // For tiered execution, each function has a budget which calls and
+        // taken loop back edges use up. A function whose budget runs out is
+        // reported as hot once. Calls of a function which has a native entry
+        // run the native code instead. Without a hot threshold, the budgets
+        // are not counted at all.
+        class Interpreter {
+        public:
+            // Takes the arguments in consecutive registers, like the frame of
+            // an interpreted function.
+            using NativeEntry = int64_t (*)(int64_t *Args);
+
+        private:
+            struct Frame {
+                const Instruction *ReturnPC;
+                int64_t *Base;
+                int32_t *Budget;
+            };
+
+            const Program &P;
+            std::vector<int64_t> Globals;
+            std::unique_ptr<int64_t[]> Stack;
+            std::unique_ptr<Frame[]> Frames;
+            size_t StackSize;
+            size_t MaxFrames;
+
+            std::vector<int32_t> Budgets;
+            std::unique_ptr<std::atomic<NativeEntry>[]> NativeEntries;
+            std::function<void(unsigned FnIndex)> OnHot;
+            bool CountBudgets{false};
+
+            void reportHot(unsigned FnIndex);
+
+            // Instantiated with and without the budget accounting, so that
+            // each has its own dispatch table.
+            template <bool Count>
+            llvm::Expected<int64_t> execute(unsigned FnIndex, int64_t *Base);
+
+        public:
+            explicit Interpreter(const Program &P, size_t StackSize = 1 << 18);
+
+            // Runs the module body.
+            llvm::Error run();
+
+            // Calls a function of the program. The argument for a VAR
+            // parameter is the address of the variable.
+            llvm::Expected<int64_t> call(unsigned FnIndex, ArrayRef<int64_t> Args);
+
+            int64_t *getGlobals() { return Globals.data(); }
+
+            // Calls OnHot for a function after Threshold calls and loop
+            // iterations. OnHot runs on the interpreter thread.
+            void setHotThreshold(unsigned Threshold, std::function<void(unsigned FnIndex)> OnHot);
+
+            // Can be called from any thread. Calls which start afterwards run
+            // the native code.
+            void setNativeEntry(unsigned FnIndex, NativeEntry Entry) {
+                NativeEntries[FnIndex].store(Entry, std::memory_order_release);
+            }
+        };
+    }
+}
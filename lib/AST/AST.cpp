@@ -3,3 +3,71 @@
 //
 
 #include "tinylang/AST/AST.h"
+#include "tinylang/AST/ASTContext.h"
+#include "llvm/Support/MathExtras.h"
+#include <cstring>
+
+using namespace tinylang;
+
+const char *ASTContext::getNodeClassName(NodeClass Class) {
+    static const char *const Names[] = {
+#define AST_NODE(Class) #Class,
+
+#include "tinylang/AST/ASTNodes.def"
+
+            "Other",
+    };
+    return Names[Class];
+}
+
+std::string Decl::getQualifiedName() {
+    std::string Name = getName().str();
+    for (Decl *D = EnclosingDecl; D; D = D->getEnclosingDecl())
+        Name = D->getName().str() + "." + Name;
+    return Name;
+}
+
+namespace {
+    // Fibonacci hashing. The low bits of the product depend only on the
+    // low bits of NameID, so the slot is taken from the high bits.
+    inline unsigned hashNameID(unsigned NameID, unsigned Shift) {
+        return (NameID * 0x9E3779B1u) >> Shift;
+    }
+}
+
+void ModuleDeclaration::buildExportIndex(ASTContext &Context) {
+    Exports = nullptr;
+    ExportMask = 0;
+    if (Decls.empty())
+        return;
+    // Keep the load factor at or below one half.
+    unsigned Size = llvm::NextPowerOf2(Decls.size() * 2 - 1);
+    Exports = static_cast<Decl **>(Context.allocate(Size * sizeof(Decl *), alignof(Decl *)));
+    std::memset(Exports, 0, Size * sizeof(Decl *));
+    ExportMask = Size - 1;
+    // Size is at least two, so the shift is less than 32.
+    ExportShift = 32 - llvm::Log2_32(Size);
+    for (Decl *D : Decls) {
+        unsigned Idx = hashNameID(D->getNameID(), ExportShift);
+        while (Exports[Idx]) {
+            // The first declaration of a name wins, as in the linear search.
+            if (Exports[Idx]->getNameID() == D->getNameID())
+                break;
+            Idx = (Idx + 1) & ExportMask;
+        }
+        if (!Exports[Idx])
+            Exports[Idx] = D;
+    }
+}
+
+Decl *ModuleDeclaration::lookupExport(unsigned NameID) const {
+    if (!Exports)
+        return nullptr;
+    unsigned Idx = hashNameID(NameID, ExportShift);
+    while (Decl *D = Exports[Idx]) {
+        if (D->getNameID() == NameID)
+            return D;
+        Idx = (Idx + 1) & ExportMask;
+    }
+    return nullptr;
+}
@@ -3,6 +3,8 @@
 //
 
 #include "tinylang/Basic/Diagnostic.h"
+#include <algorithm>
+#include <functional>
 
 using namespace tinylang;
 
@@ -26,3 +28,70 @@ const char *DiagnosticEngine::getDiagnosticText(unsigned int DiagID) {
 SourceMgr::DiagKind DiagnosticEngine::getDiagnosticKind(unsigned int DiagID) {
     return DiagnosticKind[DiagID];
 }
+
+void DiagnosticEngine::flush() {
+    // A note is sorted with the diagnostic it belongs to. Diagnostics at
+    // the same place keep the order in which they were reported.
+    struct SortKey {
+        unsigned Buffer;
+        const char *Ptr;
+        size_t Index;
+    };
+    std::vector<SortKey> Order;
+    Order.reserve(Diagnostics.size());
+    SortKey Leader{0, nullptr, 0};
+    for (size_t I = 0, E = Diagnostics.size(); I != E; ++I) {
+        SMLoc Loc = Diagnostics[I].Loc;
+        if (getDiagnosticKind(Diagnostics[I].DiagID) != SourceMgr::DK_Note || I == 0) {
+            Leader.Buffer = Loc.isValid() ? SrcMgr.FindBufferContainingLoc(Loc) : 0;
+            Leader.Ptr = Loc.getPointer();
+        }
+        Order.push_back({Leader.Buffer, Leader.Ptr, I});
+    }
+    std::sort(Order.begin(), Order.end(), [](const SortKey &L, const SortKey &R) {
+        if (L.Buffer != R.Buffer)
+            return L.Buffer < R.Buffer;
+        if (L.Ptr != R.Ptr)
+            return std::less<const char *>()(L.Ptr, R.Ptr);
+        return L.Index < R.Index;
+    });
+
+    for (const SortKey &Key : Order)
+        print(Diagnostics[Key.Index]);
+    Diagnostics.clear();
+    if (ErrorLimitReached && !ErrorLimitPrinted) {
+        unsigned BufferID = ErrorLimitLoc.isValid() ? SrcMgr.FindBufferContainingLoc(ErrorLimitLoc) : 0;
+        StringRef FileName = BufferID ? SrcMgr.getMemoryBuffer(BufferID)->getBufferIdentifier() : "";
+        llvm::SMDiagnostic Diag(FileName, getDiagnosticKind(diag::err_too_many_errors),
+                                getDiagnosticText(diag::err_too_many_errors));
+        SrcMgr.PrintMessage(llvm::errs(), Diag);
+        ErrorLimitPrinted = true;
+    }
+}
+
+LineTable &DiagnosticEngine::getLineTable(unsigned BufferID) {
+    assert(BufferID >= 1 && BufferID <= SrcMgr.getNumBuffers() && "Invalid buffer");
+    if (LineTables.size() < BufferID)
+        LineTables.resize(BufferID);
+    std::unique_ptr<LineTable> &Table = LineTables[BufferID - 1];
+    if (!Table)
+        Table = std::make_unique<LineTable>(SrcMgr.getMemoryBuffer(BufferID)->getBuffer());
+    return *Table;
+}
+
+// Same as SourceMgr::PrintMessage, but the line is found with the line
+// table instead of scanning the buffer around the location.
+void DiagnosticEngine::print(const StoredDiagnostic &D) {
+    SourceMgr::DiagKind Kind = getDiagnosticKind(D.DiagID);
+    std::string Msg = llvm::formatv(getDiagnosticText(D.DiagID), D.Args[0], D.Args[1]).str();
+    unsigned BufferID = D.Loc.isValid() ? SrcMgr.FindBufferContainingLoc(D.Loc) : 0;
+    if (!BufferID) {
+        SrcMgr.PrintMessage(D.Loc, Kind, Msg);
+        return;
+    }
+    LineTable &Lines = getLineTable(BufferID);
+    auto [Line, Column] = Lines.getLineAndColumn(D.Loc.getPointer());
+    llvm::SMDiagnostic Diag(SrcMgr, D.Loc, SrcMgr.getMemoryBuffer(BufferID)->getBufferIdentifier(),
+                            Line, Column - 1, Kind, Msg, Lines.getLine(Line), llvm::None);
+    SrcMgr.PrintMessage(llvm::errs(), Diag);
+}
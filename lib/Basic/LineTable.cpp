@@ -0,0 +1,74 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#include "tinylang/Basic/LineTable.h"
+#include "llvm/Support/MathExtras.h"
+#include <algorithm>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace tinylang;
+
+namespace {
+    // Appends the offset after each '\n' in [Begin, End) to Starts. A block
+    // of characters is compared at once, and every set bit of the mask is
+    // a line break.
+    void findLineStarts(const char *Base, const char *Begin, const char *End,
+                        std::vector<uint32_t> &Starts) {
+        const char *Ptr = Begin;
+#if defined(__AVX2__)
+        const __m256i Newline = _mm256_set1_epi8('\n');
+        for (; End - Ptr >= 32; Ptr += 32) {
+            __m256i V = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Ptr));
+            uint32_t Mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(V, Newline)));
+            for (; Mask; Mask &= Mask - 1)
+                Starts.push_back(Ptr - Base + llvm::countTrailingZeros(Mask) + 1);
+        }
+#elif defined(__SSE2__)
+        const __m128i Newline = _mm_set1_epi8('\n');
+        for (; End - Ptr >= 16; Ptr += 16) {
+            __m128i V = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Ptr));
+            uint32_t Mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(V, Newline)));
+            for (; Mask; Mask &= Mask - 1)
+                Starts.push_back(Ptr - Base + llvm::countTrailingZeros(Mask) + 1);
+        }
+#endif
+        for (; Ptr != End; ++Ptr)
+            if (*Ptr == '\n')
+                Starts.push_back(Ptr - Base + 1);
+    }
+}
+
+void LineTable::build() {
+    assert(Buffer.size() < std::numeric_limits<uint32_t>::max() && "Buffer too large");
+    // Source files have roughly one line per 30 characters.
+    LineStarts.reserve(Buffer.size() / 32 + 1);
+    LineStarts.push_back(0);
+    findLineStarts(Buffer.begin(), Buffer.begin(), Buffer.end(), LineStarts);
+}
+
+unsigned LineTable::findLine(uint32_t Offset) {
+    if (LineStarts.empty())
+        build();
+    return std::upper_bound(LineStarts.begin(), LineStarts.end(), Offset) - LineStarts.begin() - 1;
+}
+
+std::pair<unsigned, unsigned> LineTable::getLineAndColumn(const char *Ptr) {
+    uint32_t Offset = getOffset(Ptr);
+    unsigned Line = findLine(Offset);
+    return {Line + 1, Offset - LineStarts[Line] + 1};
+}
+
+StringRef LineTable::getLine(unsigned Line) {
+    if (LineStarts.empty())
+        build();
+    assert(Line >= 1 && Line <= LineStarts.size() && "Line out of range");
+    StringRef Text = Buffer.substr(LineStarts[Line - 1]);
+    return Text.take_until([](char Ch) { return Ch == '\n' || Ch == '\r'; });
+}
@@ -0,0 +1,192 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#include "tinylang/Basic/TimeReport.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+#if LLVM_ON_UNIX
+#include <sys/resource.h>
+#endif
+
+using namespace tinylang;
+
+LLVM_THREAD_LOCAL TimeReport *TimeReport::Current = nullptr;
+
+namespace {
+    // The peak resident set size of the process in bytes, or 0 if unknown.
+    size_t getPeakRSS() {
+#if LLVM_ON_UNIX
+        struct rusage Usage;
+        if (getrusage(RUSAGE_SELF, &Usage) == 0) {
+#if defined(__APPLE__)
+            return Usage.ru_maxrss;
+#else
+            return static_cast<size_t>(Usage.ru_maxrss) * 1024;
+#endif
+        }
+#endif
+        return 0;
+    }
+
+    template<typename T>
+    T &findOrAdd(std::vector<std::pair<std::string, T>> &Entries, StringRef Name) {
+        auto I = std::find_if(Entries.begin(), Entries.end(),
+                              [Name](const auto &E) { return E.first == Name; });
+        if (I == Entries.end())
+            I = Entries.insert(I, {Name.str(), T()});
+        return I->second;
+    }
+}
+
+void TimeReport::addPhase(StringRef Phase, double Seconds, int64_t HeapBytes, size_t PeakRSS) {
+    Entry &E = findOrAdd(Phases, Phase);
+    E.Seconds += Seconds;
+    ++E.Count;
+    E.HeapBytes += HeapBytes;
+    E.PeakRSS = std::max(E.PeakRSS, PeakRSS);
+}
+
+void TimeReport::addObjects(StringRef Kind, size_t Count, size_t Bytes) {
+    ObjectEntry &E = findOrAdd(Objects, Kind);
+    E.Count += Count;
+    E.Bytes += Bytes;
+}
+
+void TimeReport::addProcedure(StringRef Phase, StringRef Name, double Seconds) {
+    Entry &E = Procedures[(Phase + "\t" + Name).str()];
+    E.Seconds += Seconds;
+    ++E.Count;
+}
+
+void TimeReport::merge(const TimeReport &Other) {
+    for (const auto &P : Other.Phases) {
+        Entry &E = findOrAdd(Phases, P.first);
+        E.Seconds += P.second.Seconds;
+        E.Count += P.second.Count;
+        E.HeapBytes += P.second.HeapBytes;
+        E.PeakRSS = std::max(E.PeakRSS, P.second.PeakRSS);
+    }
+    for (const auto &O : Other.Objects)
+        addObjects(O.first, O.second.Count, O.second.Bytes);
+    for (const auto &P : Other.Procedures) {
+        Entry &E = Procedures[P.getKey()];
+        E.Seconds += P.getValue().Seconds;
+        E.Count += P.getValue().Count;
+    }
+}
+
+void TimeReport::print(raw_ostream &OS, unsigned MaxProcedures) const {
+    double Total = 0;
+    for (const auto &P : Phases)
+        Total += P.second.Seconds;
+    auto percent = [Total](double Seconds) {
+        return Total > 0 ? 100 * Seconds / Total : 0.0;
+    };
+
+    OS << "===" << std::string(73, '-') << "===\n"
+       << "                          Tinylang time report\n"
+       << "===" << std::string(73, '-') << "===\n"
+       << llvm::format("  Total wall time: %.4f seconds\n\n", Total)
+       << "   Wall (ms)      %   Count  Phase\n";
+    for (const auto &P : Phases)
+        OS << llvm::format("  %10.3f  %5.1f%%  %6u  ", P.second.Seconds * 1000,
+                           percent(P.second.Seconds), P.second.Count)
+           << P.first << "\n";
+    OS << llvm::format("  %10.3f  %5.1f%%          Total\n", Total * 1000, percent(Total));
+
+    if (Procedures.empty())
+        return;
+    std::vector<const llvm::StringMapEntry<Entry> *> Sorted;
+    for (const auto &P : Procedures)
+        Sorted.push_back(&P);
+    // Ties are broken by name, so the order does not depend on the hash.
+    std::sort(Sorted.begin(), Sorted.end(), [](const auto *L, const auto *R) {
+        if (L->getValue().Seconds != R->getValue().Seconds)
+            return L->getValue().Seconds > R->getValue().Seconds;
+        return L->getKey() < R->getKey();
+    });
+    if (Sorted.size() > MaxProcedures)
+        Sorted.resize(MaxProcedures);
+
+    OS << "\n  Slowest procedures (Parse includes Sema and nested procedures)\n"
+       << "   Wall (ms)      %   Count  Phase     Procedure\n";
+    for (const auto *P : Sorted) {
+        auto [Phase, Name] = P->getKey().split('\t');
+        OS << llvm::format("  %10.3f  %5.1f%%  %6u  %-8s  ", P->getValue().Seconds * 1000,
+                           percent(P->getValue().Seconds), P->getValue().Count,
+                           Phase.str().c_str())
+           << Name << "\n";
+    }
+}
+
+void TimeReport::printMemory(raw_ostream &OS) const {
+    auto KB = [](int64_t Bytes) { return static_cast<double>(Bytes) / 1024; };
+
+    OS << "===" << std::string(73, '-') << "===\n"
+       << "                         Tinylang memory report\n"
+       << "===" << std::string(73, '-') << "===\n"
+       << llvm::format("  Peak RSS: %.1f KB\n\n", KB(getPeakRSS()))
+       << "   Heap (KB)  Peak RSS (KB)   Count  Phase\n";
+    int64_t TotalHeap = 0;
+    for (const auto &P : Phases) {
+        OS << llvm::format("  %10.1f  %13.1f  %6u  ", KB(P.second.HeapBytes),
+                           KB(P.second.PeakRSS), P.second.Count)
+           << P.first << "\n";
+        TotalHeap += P.second.HeapBytes;
+    }
+    OS << llvm::format("  %10.1f                         Total\n", KB(TotalHeap));
+
+    if (Objects.empty())
+        return;
+    OS << "\n  Objects and tables\n"
+       << "  Size (KB)      Count  Kind\n";
+    for (const auto &O : Objects)
+        OS << llvm::format("  %9.1f  %9zu  ", KB(O.second.Bytes), O.second.Count)
+           << O.first << "\n";
+}
+
+void TimeScope::begin(llvm::function_ref<std::string()> GetDetail) {
+    Detail = GetDetail();
+    Tracing = llvm::timeTraceProfilerEnabled();
+    if (Tracing)
+        llvm::timeTraceProfilerBegin(Phase, Detail);
+    if (!IsProcedure) {
+        if (Report->TrackMemory)
+            StartHeap = llvm::sys::Process::GetMallocUsage();
+        Report->SubPhaseSeconds = 0;
+    }
+    Start = std::chrono::steady_clock::now();
+}
+
+void TimeScope::end() {
+    double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    if (IsProcedure) {
+        Report->addProcedure(Phase, Detail, Seconds);
+    } else {
+        // The heap of the sub-phase stays with the phase.
+        double SubSeconds = Report->SubPhaseSeconds;
+        Report->SubPhaseSeconds = 0;
+        if (Report->TrackMemory) {
+            int64_t HeapBytes = static_cast<int64_t>(llvm::sys::Process::GetMallocUsage()) -
+                                static_cast<int64_t>(StartHeap);
+            Report->addPhase(Phase, Seconds - SubSeconds, HeapBytes, getPeakRSS());
+        } else {
+            Report->addPhase(Phase, Seconds - SubSeconds, 0, 0);
+        }
+        if (SubSeconds > 0)
+            Report->addPhase(Report->SubPhase, SubSeconds, 0, 0);
+    }
+    if (Tracing)
+        llvm::timeTraceProfilerEnd();
+}
+
+void SubPhaseScope::end() {
+    Report->SubPhaseSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    Report->InSubPhase = false;
+}
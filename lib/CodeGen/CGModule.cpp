@@ -0,0 +1,136 @@
+//
+// Created by jewoo on 2021-06-30.
+//
+
+#include "tinylang/CodeGen/CGModule.h"
+#include "tinylang/Basic/TimeReport.h"
+#include "tinylang/CodeGen/CGProcedure.h"
+#include "tinylang/CodeGen/CodeGen.h"
+#include "llvm/ADT/StringExtras.h"
+
+using namespace tinylang;
+
+void CGModule::initialize() {
+    VoidTy = llvm::Type::getVoidTy(getLLVMCtx());
+    Int1Ty = llvm::Type::getInt1Ty(getLLVMCtx());
+    Int32Ty = llvm::Type::getInt32Ty(getLLVMCtx());
+    Int64Ty = llvm::Type::getInt64Ty(getLLVMCtx());
+    Int32Zero = llvm::ConstantInt::get(Int32Ty, 0, /*isSigned*/ true);
+}
+
+llvm::Type *CGModule::convertType(TypeDeclaration *Ty) {
+    if (Ty->getName() == "INTEGER")
+        return Int64Ty;
+    if (Ty->getName() == "BOOLEAN")
+        return Int1Ty;
+    llvm::report_fatal_error("Unsupported type");
+}
+
+// The mangled name starts with _t, followed by the length and the name of
+// each enclosing declaration, e.g. _t3Gcd3GCD.
+std::string CGModule::mangleName(Decl *D) {
+    std::string Mangled;
+    llvm::SmallString<16> Tmp;
+    while (D) {
+        StringRef Name = D->getName();
+        Tmp.clear();
+        Tmp.append(llvm::itostr(Name.size()));
+        Tmp.append(Name);
+        Mangled.insert(0, Tmp.c_str());
+        D = D->getEnclosingDecl();
+    }
+    Mangled.insert(0, "_t");
+    return Mangled;
+}
+
+llvm::GlobalObject *CGModule::getGlobal(Decl *D) {
+    return Globals.lookup(D);
+}
+
+llvm::FunctionType *CGModule::getFunctionType(ProcedureDeclaration *Proc) {
+    llvm::Type *ResultTy = VoidTy;
+    if (Proc->getRetType())
+        ResultTy = convertType(Proc->getRetType());
+    llvm::SmallVector<llvm::Type *, 8> ParamTypes;
+    for (FormalParameterDeclaration *FP : Proc->getFormalParams()) {
+        llvm::Type *Ty = convertType(FP->getType());
+        // VAR parameters are passed by reference.
+        if (FP->isVar())
+            Ty = Ty->getPointerTo();
+        ParamTypes.push_back(Ty);
+    }
+    return llvm::FunctionType::get(ResultTy, ParamTypes, /*IsVarArgs*/ false);
+}
+
+llvm::Function *CGModule::getOrCreateFunction(ProcedureDeclaration *Proc) {
+    std::string Name = mangleName(Proc);
+    if (llvm::Function *Fn = M->getFunction(Name))
+        return Fn;
+    return llvm::Function::Create(getFunctionType(Proc),
+                                  llvm::GlobalValue::ExternalLinkage,
+                                  Name, M);
+}
+
+llvm::Function *CGModule::getRuntimeError() {
+    StringRef Name = CodeGenerator::getRuntimeErrorName();
+    if (llvm::Function *Fn = M->getFunction(Name))
+        return Fn;
+    auto *FTy = llvm::FunctionType::get(VoidTy, {llvm::Type::getInt8PtrTy(getLLVMCtx())}, /*IsVarArgs*/ false);
+    llvm::Function *Fn = llvm::Function::Create(FTy, llvm::GlobalValue::ExternalLinkage, Name, M);
+    // The error paths are unlikely, and the callers need not save anything.
+    Fn->addFnAttr(llvm::Attribute::NoReturn);
+    Fn->addFnAttr(llvm::Attribute::NoUnwind);
+    Fn->addFnAttr(llvm::Attribute::Cold);
+    return Fn;
+}
+
+void CGModule::emitProcedure(ProcedureDeclaration *Proc) {
+    {
+        TimeScope Timer("CodeGen", [Proc] { return Proc->getQualifiedName(); }, /*IsProcedure*/ true);
+        CGProcedure CGP(*this);
+        CGP.run(Proc);
+    }
+    for (Decl *D : Proc->getDecls()) {
+        if (auto *Nested = dyn_cast<ProcedureDeclaration>(D))
+            emitProcedure(Nested);
+    }
+}
+
+// Creates the module variables. Without a definition, the variables are
+// only declared, because another LLVM module defines them.
+void CGModule::emitGlobals(llvm::GlobalValue::LinkageTypes Linkage, bool Define) {
+    for (Decl *D : Mod->getDecls()) {
+        if (auto *Var = dyn_cast<VariableDeclaration>(D)) {
+            llvm::Type *Ty = convertType(Var->getType());
+            auto *V = new llvm::GlobalVariable(*M, Ty, /*isConstant*/ false, Linkage,
+                                               Define ? llvm::Constant::getNullValue(Ty) : nullptr,
+                                               mangleName(Var));
+            Globals[Var] = V;
+        }
+    }
+}
+
+void CGModule::run(ModuleDeclaration *Mod) {
+    this->Mod = Mod;
+    emitGlobals(llvm::GlobalValue::PrivateLinkage, /*Define*/ true);
+    for (Decl *D : Mod->getDecls()) {
+        if (auto *Proc = dyn_cast<ProcedureDeclaration>(D))
+            emitProcedure(Proc);
+    }
+    CGProcedure CGP(*this);
+    CGP.run(Mod);
+}
+
+void CGModule::runModuleInit(ModuleDeclaration *Mod) {
+    this->Mod = Mod;
+    emitGlobals(llvm::GlobalValue::ExternalLinkage, /*Define*/ true);
+    CGProcedure CGP(*this);
+    CGP.run(Mod);
+}
+
+void CGModule::runProcedure(ModuleDeclaration *Mod, ProcedureDeclaration *Proc) {
+    this->Mod = Mod;
+    emitGlobals(llvm::GlobalValue::ExternalLinkage, /*Define*/ false);
+    CGProcedure CGP(*this);
+    CGP.run(Proc);
+}
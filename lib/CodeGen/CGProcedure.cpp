@@ -0,0 +1,538 @@
+//
+// Created by jewoo on 2021-06-30.
+//
+
+#include "tinylang/CodeGen/CGProcedure.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/Support/Casting.h"
+
+using namespace tinylang;
+
+void CGProcedure::writeLocalVariable(llvm::BasicBlock *BB, Decl *Decl, llvm::Value *Val) {
+    assert(BB && "Basic block is nullptr");
+    assert((llvm::isa<VariableDeclaration>(Decl) ||
+            llvm::isa<FormalParameterDeclaration>(Decl)) &&
+           "Declaration must be variable or formal parameter");
+    assert(Val && "Value is nullptr");
+    CurrentDef[BB].Defs[Decl] = Val;
+}
+
+llvm::Value *CGProcedure::readLocalVariable(llvm::BasicBlock *BB, Decl *Decl) {
+    assert(BB && "Basic block is nullptr");
+    auto Val = CurrentDef[BB].Defs.find(Decl);
+    if (Val != CurrentDef[BB].Defs.end())
+        return Val->second;
+    return readLocalVariableRecursive(BB, Decl);
+}
+
+llvm::Value *CGProcedure::readLocalVariableRecursive(llvm::BasicBlock *BB, Decl *Decl) {
+    llvm::Value *Val = nullptr;
+    if (!CurrentDef[BB].Sealed) {
+        // Not all predecessors are known yet.
+        llvm::PHINode *Phi = addEmptyPhi(BB, Decl);
+        CurrentDef[BB].IncompletePhis[Phi] = Decl;
+        Val = Phi;
+    } else if (auto *PredBB = BB->getSinglePredecessor()) {
+        // No phi is needed if there is only one predecessor.
+        Val = readLocalVariable(PredBB, Decl);
+    } else {
+        // Break a possible cycle by writing the phi before the operands
+        // are looked up.
+        llvm::PHINode *Phi = addEmptyPhi(BB, Decl);
+        writeLocalVariable(BB, Decl, Phi);
+        Val = addPhiOperands(BB, Decl, Phi);
+    }
+    writeLocalVariable(BB, Decl, Val);
+    return Val;
+}
+
+llvm::PHINode *CGProcedure::addEmptyPhi(llvm::BasicBlock *BB, Decl *Decl) {
+    return BB->empty()
+           ? llvm::PHINode::Create(mapType(Decl), 0, "", BB)
+           : llvm::PHINode::Create(mapType(Decl), 0, "", &BB->front());
+}
+
+llvm::Value *CGProcedure::addPhiOperands(llvm::BasicBlock *BB, Decl *Decl, llvm::PHINode *Phi) {
+    for (auto *PredBB : llvm::predecessors(BB))
+        Phi->addIncoming(readLocalVariable(PredBB, Decl), PredBB);
+    return optimizePhi(Phi);
+}
+
+// Removes the phi if all its operands are the same value or the phi
+// itself. The phis using the removed one may become trivial, too.
+llvm::Value *CGProcedure::optimizePhi(llvm::PHINode *Phi) {
+    llvm::Value *Same = nullptr;
+    for (llvm::Value *V : Phi->incoming_values()) {
+        if (V == Same || V == Phi)
+            continue;
+        if (Same && V != Same)
+            return Phi;
+        Same = V;
+    }
+    if (Same == nullptr)
+        Same = llvm::UndefValue::get(Phi->getType());
+    llvm::SmallVector<llvm::WeakVH, 8> CandidatePhis;
+    for (llvm::Use &U : Phi->uses()) {
+        if (auto *P = llvm::dyn_cast<llvm::PHINode>(U.getUser()))
+            if (P != Phi)
+                CandidatePhis.push_back(P);
+    }
+    Phi->replaceAllUsesWith(Same);
+    Phi->eraseFromParent();
+    // Same may be one of the candidates, so it follows their replacement.
+    llvm::TrackingVH<llvm::Value> Result(Same);
+    for (llvm::WeakVH &VH : CandidatePhis) {
+        // The phi may already be gone, or still be waiting for operands.
+        auto *P = llvm::dyn_cast_or_null<llvm::PHINode>(VH);
+        if (P && P->getNumIncomingValues() == llvm::pred_size(P->getParent()))
+            optimizePhi(P);
+    }
+    return Result;
+}
+
+void CGProcedure::sealBlock(llvm::BasicBlock *BB) {
+    assert(!CurrentDef[BB].Sealed && "Attempt to seal already sealed block");
+    // Adding the operands may grow CurrentDef, so take the list out first.
+    llvm::DenseMap<llvm::PHINode *, Decl *> IncompletePhis;
+    std::swap(IncompletePhis, CurrentDef[BB].IncompletePhis);
+    for (auto PhiDecl : IncompletePhis)
+        addPhiOperands(BB, PhiDecl.second, PhiDecl.first);
+    CurrentDef[BB].Sealed = 1;
+}
+
+void CGProcedure::writeVariable(llvm::BasicBlock *BB, Decl *D, llvm::Value *Val) {
+    if (auto *V = llvm::dyn_cast<VariableDeclaration>(D)) {
+        if (llvm::GlobalObject *G = CGM.getGlobal(V))
+            Builder.CreateStore(Val, G);
+        else if (V->getEnclosingDecl() != Proc)
+            llvm::report_fatal_error("Access to variables of enclosing procedures not yet supported");
+        else if (llvm::AllocaInst *Slot = Slots.lookup(V))
+            Builder.CreateStore(Val, Slot);
+        else
+            writeLocalVariable(BB, V, Val);
+    } else if (auto *FP = llvm::dyn_cast<FormalParameterDeclaration>(D)) {
+        if (FP->getEnclosingDecl() != Proc)
+            llvm::report_fatal_error("Access to parameters of enclosing procedures not yet supported");
+        if (FP->isVar())
+            Builder.CreateStore(Val, FormalParams[FP]);
+        else if (llvm::AllocaInst *Slot = Slots.lookup(FP))
+            Builder.CreateStore(Val, Slot);
+        else
+            writeLocalVariable(BB, FP, Val);
+    } else
+        llvm::report_fatal_error("Unsupported declaration");
+}
+
+llvm::Value *CGProcedure::readVariable(llvm::BasicBlock *BB, Decl *D) {
+    if (auto *V = llvm::dyn_cast<VariableDeclaration>(D)) {
+        if (llvm::GlobalObject *G = CGM.getGlobal(V))
+            return Builder.CreateLoad(mapType(V), G);
+        if (V->getEnclosingDecl() != Proc)
+            llvm::report_fatal_error("Access to variables of enclosing procedures not yet supported");
+        if (llvm::AllocaInst *Slot = Slots.lookup(V))
+            return Builder.CreateLoad(mapType(V), Slot);
+        return readLocalVariable(BB, V);
+    } else if (auto *FP = llvm::dyn_cast<FormalParameterDeclaration>(D)) {
+        if (FP->getEnclosingDecl() != Proc)
+            llvm::report_fatal_error("Access to parameters of enclosing procedures not yet supported");
+        if (FP->isVar())
+            return Builder.CreateLoad(CGM.convertType(FP->getType()), FormalParams[FP]);
+        if (llvm::AllocaInst *Slot = Slots.lookup(FP))
+            return Builder.CreateLoad(mapType(FP), Slot);
+        return readLocalVariable(BB, FP);
+    }
+    llvm::report_fatal_error("Unsupported declaration");
+}
+
+// Returns the address of a variable which is passed to a VAR parameter.
+llvm::Value *CGProcedure::getAddress(Decl *D) {
+    if (llvm::GlobalObject *G = CGM.getGlobal(D))
+        return G;
+    if (D->getEnclosingDecl() != Proc)
+        llvm::report_fatal_error("Access to variables of enclosing procedures not yet supported");
+    if (auto *FP = llvm::dyn_cast<FormalParameterDeclaration>(D))
+        if (FP->isVar())
+            return FormalParams[FP];
+    llvm::AllocaInst *Slot = Slots.lookup(D);
+    assert(Slot && "Variable passed by reference has no stack slot");
+    return Slot;
+}
+
+llvm::Type *CGProcedure::mapType(Decl *Decl) {
+    if (auto *FP = llvm::dyn_cast<FormalParameterDeclaration>(Decl)) {
+        llvm::Type *Ty = CGM.convertType(FP->getType());
+        if (FP->isVar())
+            Ty = Ty->getPointerTo();
+        return Ty;
+    }
+    if (auto *V = llvm::dyn_cast<VariableDeclaration>(Decl))
+        return CGM.convertType(V->getType());
+    return CGM.convertType(llvm::cast<TypeDeclaration>(Decl));
+}
+
+void CGProcedure::findAddressTaken(ArrayRef<Stmt *> Stmts, llvm::DenseSet<Decl *> &Vars) {
+    for (Stmt *S : Stmts) {
+        if (auto *Assign = llvm::dyn_cast<AssignmentStatement>(S))
+            findAddressTaken(Assign->getExpr(), Vars);
+        else if (auto *Call = llvm::dyn_cast<ProcedureCallStatement>(S)) {
+            auto Formals = Call->getProc()->getFormalParams();
+            auto Args = Call->getParams();
+            for (size_t I = 0, E = Args.size(); I != E; ++I) {
+                if (Formals[I]->isVar()) {
+                    if (auto *Var = llvm::dyn_cast<VariableAccess>(Args[I]))
+                        Vars.insert(Var->getDecl());
+                } else
+                    findAddressTaken(Args[I], Vars);
+            }
+        } else if (auto *If = llvm::dyn_cast<IfStatement>(S)) {
+            findAddressTaken(If->getCond(), Vars);
+            findAddressTaken(If->getIfStmts(), Vars);
+            findAddressTaken(If->getElseStmts(), Vars);
+        } else if (auto *While = llvm::dyn_cast<WhileStatement>(S)) {
+            findAddressTaken(While->getCond(), Vars);
+            findAddressTaken(While->getWhileStmts(), Vars);
+        } else if (auto *Return = llvm::dyn_cast<ReturnStatement>(S)) {
+            if (Return->getRetVal())
+                findAddressTaken(Return->getRetVal(), Vars);
+        }
+    }
+}
+
+void CGProcedure::findAddressTaken(Expr *E, llvm::DenseSet<Decl *> &Vars) {
+    assert(E && "Expression is nullptr, the module has errors");
+    if (auto *Infix = llvm::dyn_cast<InfixExpression>(E)) {
+        findAddressTaken(Infix->getLeft(), Vars);
+        findAddressTaken(Infix->getRight(), Vars);
+    } else if (auto *Prefix = llvm::dyn_cast<PrefixExpression>(E)) {
+        findAddressTaken(Prefix->getExpr(), Vars);
+    } else if (auto *Call = llvm::dyn_cast<FunctionCallExpr>(E)) {
+        auto Formals = Call->getDecl()->getFormalParams();
+        auto Args = Call->getParams();
+        for (size_t I = 0, E = Args.size(); I != E; ++I) {
+            if (Formals[I]->isVar()) {
+                if (auto *Var = llvm::dyn_cast<VariableAccess>(Args[I]))
+                    Vars.insert(Var->getDecl());
+            } else
+                findAddressTaken(Args[I], Vars);
+        }
+    }
+}
+
+void CGProcedure::emitPrologue(ArrayRef<FormalParameterDeclaration *> Params,
+                               ArrayRef<Decl *> Decls, ArrayRef<Stmt *> Stmts) {
+    llvm::BasicBlock *Entry = createBasicBlock("entry");
+    setCurr(Entry);
+    sealBlock(Entry);
+
+    llvm::DenseSet<Decl *> AddressTaken;
+    findAddressTaken(Stmts, AddressTaken);
+
+    for (FormalParameterDeclaration *FP : Params) {
+        llvm::Argument *Arg = FormalParams[FP];
+        if (FP->isVar())
+            continue;
+        if (AddressTaken.count(FP)) {
+            llvm::AllocaInst *Slot = Builder.CreateAlloca(mapType(FP), nullptr, FP->getName());
+            Builder.CreateStore(Arg, Slot);
+            Slots[FP] = Slot;
+        } else
+            writeLocalVariable(Entry, FP, Arg);
+    }
+    // Local variables start out as zero.
+    for (Decl *D : Decls) {
+        auto *V = llvm::dyn_cast<VariableDeclaration>(D);
+        if (!V)
+            continue;
+        llvm::Type *Ty = mapType(V);
+        if (AddressTaken.count(V)) {
+            llvm::AllocaInst *Slot = Builder.CreateAlloca(Ty, nullptr, V->getName());
+            Builder.CreateStore(llvm::Constant::getNullValue(Ty), Slot);
+            Slots[V] = Slot;
+        } else
+            writeLocalVariable(Entry, V, llvm::Constant::getNullValue(Ty));
+    }
+}
+
+// Only the block after a RETURN has no predecessors when it is current.
+bool CGProcedure::isUnreachable(llvm::BasicBlock *BB) {
+    return BB != &Fn->getEntryBlock() && llvm::pred_empty(BB);
+}
+
+// Ends an unreachable block without adding it as a predecessor, so that
+// it contributes no operands to the phis of the successor.
+void CGProcedure::finishUnreachable() {
+    if (Curr->empty()) {
+        CurrentDef.erase(Curr);
+        Curr->eraseFromParent();
+        Curr = nullptr;
+    } else
+        Builder.CreateUnreachable();
+}
+
+void CGProcedure::emitBranch(llvm::BasicBlock *Target) {
+    if (isUnreachable(Curr))
+        finishUnreachable();
+    else
+        Builder.CreateBr(Target);
+}
+
+void CGProcedure::emitEpilogue(TypeDeclaration *RetType) {
+    if (isUnreachable(Curr))
+        finishUnreachable();
+    else if (!RetType)
+        Builder.CreateRetVoid();
+    else
+        Builder.CreateRet(llvm::Constant::getNullValue(CGM.convertType(RetType)));
+}
+
+llvm::Value *CGProcedure::emitInfixExpr(InfixExpression *E) {
+    tok::TokenKind Kind = E->getOperatorInfo().getKind();
+    if (Kind == tok::kw_AND || Kind == tok::kw_OR)
+        return emitLogicalExpr(E);
+    llvm::Value *Left = emitExpr(E->getLeft());
+    llvm::Value *Right = emitExpr(E->getRight());
+    switch (Kind) {
+        case tok::plus:
+            return Builder.CreateAdd(Left, Right);
+        case tok::minus:
+            return Builder.CreateSub(Left, Right);
+        case tok::star:
+            return Builder.CreateMul(Left, Right);
+        case tok::slash:
+        case tok::kw_DIV:
+            return emitDivision(/*IsMod*/ false, Left, Right);
+        case tok::kw_MOD:
+            return emitDivision(/*IsMod*/ true, Left, Right);
+        case tok::equal:
+            return Builder.CreateICmpEQ(Left, Right);
+        case tok::hash:
+            return Builder.CreateICmpNE(Left, Right);
+        case tok::less:
+            return Builder.CreateICmpSLT(Left, Right);
+        case tok::lessequal:
+            return Builder.CreateICmpSLE(Left, Right);
+        case tok::greater:
+            return Builder.CreateICmpSGT(Left, Right);
+        case tok::greaterequal:
+            return Builder.CreateICmpSGE(Left, Right);
+        default:
+            llvm_unreachable("Wrong operator");
+    }
+}
+
+// AND and OR only evaluate the right operand if the left one does not
+// already decide the result.
+llvm::Value *CGProcedure::emitLogicalExpr(InfixExpression *E) {
+    bool IsAnd = E->getOperatorInfo().getKind() == tok::kw_AND;
+    llvm::Value *Left = emitExpr(E->getLeft());
+    llvm::BasicBlock *LeftBB = Curr;
+    llvm::BasicBlock *RightBB = createBasicBlock(IsAnd ? "and.rhs" : "or.rhs");
+    llvm::BasicBlock *EndBB = createBasicBlock(IsAnd ? "and.end" : "or.end");
+    if (IsAnd)
+        Builder.CreateCondBr(Left, RightBB, EndBB);
+    else
+        Builder.CreateCondBr(Left, EndBB, RightBB);
+
+    setCurr(RightBB);
+    sealBlock(RightBB);
+    llvm::Value *Right = emitExpr(E->getRight());
+    llvm::BasicBlock *RightEndBB = Curr;
+    Builder.CreateBr(EndBB);
+
+    setCurr(EndBB);
+    sealBlock(EndBB);
+    llvm::PHINode *Phi = Builder.CreatePHI(CGM.Int1Ty, 2);
+    Phi->addIncoming(llvm::ConstantInt::getBool(CGM.Int1Ty, !IsAnd), LeftBB);
+    Phi->addIncoming(Right, RightEndBB);
+    return Phi;
+}
+
+// Division has the semantics of the interpreter, see divWrap and modWrap:
+// a zero divisor is a runtime error, and a divisor of -1 gives the wrapped
+// negation and 0, where sdiv and srem would be undefined for MIN. Constant
+// divisors other than 0 and -1 need no checks.
+llvm::Value *CGProcedure::emitDivision(bool IsMod, llvm::Value *Left, llvm::Value *Right) {
+    auto *Divisor = llvm::dyn_cast<llvm::ConstantInt>(Right);
+    if (Divisor && !Divisor->isZero() && !Divisor->isMinusOne())
+        return IsMod ? Builder.CreateSRem(Left, Right) : Builder.CreateSDiv(Left, Right);
+
+    if (!DivisionByZero) {
+        DivisionByZero = createBasicBlock("div.zero");
+        llvm::IRBuilder<> ErrorBuilder(DivisionByZero);
+        ErrorBuilder.CreateCall(CGM.getRuntimeError(),
+                                {ErrorBuilder.CreateGlobalStringPtr("division by zero")});
+        ErrorBuilder.CreateUnreachable();
+    }
+    llvm::BasicBlock *ContBB = createBasicBlock("div.cont");
+    Builder.CreateCondBr(Builder.CreateICmpEQ(Right, llvm::ConstantInt::get(Right->getType(), 0)),
+                         DivisionByZero, ContBB);
+    setCurr(ContBB);
+    sealBlock(ContBB);
+
+    llvm::Value *IsMinusOne = Builder.CreateICmpEQ(Right, llvm::ConstantInt::getSigned(Right->getType(), -1));
+    llvm::Value *SafeRight = Builder.CreateSelect(IsMinusOne, llvm::ConstantInt::get(Right->getType(), 1), Right);
+    if (IsMod)
+        return Builder.CreateSelect(IsMinusOne, llvm::ConstantInt::get(Right->getType(), 0),
+                                    Builder.CreateSRem(Left, SafeRight));
+    return Builder.CreateSelect(IsMinusOne, Builder.CreateNeg(Left), Builder.CreateSDiv(Left, SafeRight));
+}
+
+llvm::Value *CGProcedure::emitPrefixExpr(PrefixExpression *E) {
+    llvm::Value *Val = emitExpr(E->getExpr());
+    switch (E->getOperatorInfo().getKind()) {
+        case tok::plus:
+            return Val;
+        case tok::minus:
+            return Builder.CreateNeg(Val);
+        case tok::kw_NOT:
+            return Builder.CreateNot(Val);
+        default:
+            llvm_unreachable("Wrong operator");
+    }
+}
+
+llvm::Value *CGProcedure::emitExpr(Expr *E) {
+    assert(E && "Expression is nullptr, the module has errors");
+    if (auto *Infix = llvm::dyn_cast<InfixExpression>(E))
+        return emitInfixExpr(Infix);
+    if (auto *Prefix = llvm::dyn_cast<PrefixExpression>(E))
+        return emitPrefixExpr(Prefix);
+    if (auto *Var = llvm::dyn_cast<VariableAccess>(E))
+        return readVariable(Curr, Var->getDecl());
+    if (auto *Const = llvm::dyn_cast<ConstantAccess>(E))
+        return emitExpr(Const->getDecl()->getExpr());
+    if (auto *IntLit = llvm::dyn_cast<IntegerLiteral>(E)) {
+        if (IntLit->isSmall())
+            return llvm::ConstantInt::get(CGM.Int64Ty, IntLit->getSmallValue(), /*isSigned*/ true);
+        return llvm::ConstantInt::get(CGM.Int64Ty, IntLit->getValue().zextOrTrunc(64));
+    }
+    if (auto *BoolLit = llvm::dyn_cast<BooleanLiteral>(E))
+        return llvm::ConstantInt::getBool(CGM.Int1Ty, BoolLit->getValue());
+    if (auto *Call = llvm::dyn_cast<FunctionCallExpr>(E))
+        return emitCall(Call->getDecl(), Call->getParams());
+    llvm::report_fatal_error("Unsupported expression");
+}
+
+llvm::CallInst *CGProcedure::emitCall(ProcedureDeclaration *Callee, ArrayRef<Expr *> Args) {
+    llvm::Function *F = CGM.getOrCreateFunction(Callee);
+    auto Formals = Callee->getFormalParams();
+    llvm::SmallVector<llvm::Value *, 8> ArgValues;
+    for (size_t I = 0, E = Args.size(); I != E; ++I) {
+        if (Formals[I]->isVar())
+            ArgValues.push_back(getAddress(llvm::cast<VariableAccess>(Args[I])->getDecl()));
+        else
+            ArgValues.push_back(emitExpr(Args[I]));
+    }
+    return Builder.CreateCall(F, ArgValues);
+}
+
+void CGProcedure::emitStmt(AssignmentStatement *Stmt) {
+    llvm::Value *Val = emitExpr(Stmt->getExpr());
+    writeVariable(Curr, Stmt->getVar(), Val);
+}
+
+void CGProcedure::emitStmt(ProcedureCallStatement *Stmt) {
+    emitCall(Stmt->getProc(), Stmt->getParams());
+}
+
+void CGProcedure::emitStmt(IfStatement *Stmt) {
+    bool HasElse = !Stmt->getElseStmts().empty();
+
+    llvm::BasicBlock *IfBB = createBasicBlock("if.body");
+    llvm::BasicBlock *ElseBB = HasElse ? createBasicBlock("else.body") : nullptr;
+    llvm::BasicBlock *AfterIfBB = createBasicBlock("after.if");
+
+    llvm::Value *Cond = emitExpr(Stmt->getCond());
+    Builder.CreateCondBr(Cond, IfBB, HasElse ? ElseBB : AfterIfBB);
+
+    setCurr(IfBB);
+    sealBlock(IfBB);
+    emit(Stmt->getIfStmts());
+    emitBranch(AfterIfBB);
+
+    if (HasElse) {
+        setCurr(ElseBB);
+        sealBlock(ElseBB);
+        emit(Stmt->getElseStmts());
+        emitBranch(AfterIfBB);
+    }
+
+    setCurr(AfterIfBB);
+    sealBlock(AfterIfBB);
+}
+
+void CGProcedure::emitStmt(WhileStatement *Stmt) {
+    llvm::BasicBlock *WhileCondBB = createBasicBlock("while.cond");
+    llvm::BasicBlock *WhileBodyBB = createBasicBlock("while.body");
+    llvm::BasicBlock *AfterWhileBB = createBasicBlock("after.while");
+
+    emitBranch(WhileCondBB);
+    // The back edge is not known yet, so the condition block stays unsealed.
+    setCurr(WhileCondBB);
+    llvm::Value *Cond = emitExpr(Stmt->getCond());
+    Builder.CreateCondBr(Cond, WhileBodyBB, AfterWhileBB);
+
+    setCurr(WhileBodyBB);
+    sealBlock(WhileBodyBB);
+    emit(Stmt->getWhileStmts());
+    emitBranch(WhileCondBB);
+    sealBlock(WhileCondBB);
+
+    setCurr(AfterWhileBB);
+    sealBlock(AfterWhileBB);
+}
+
+void CGProcedure::emitStmt(ReturnStatement *Stmt) {
+    if (Stmt->getRetVal())
+        Builder.CreateRet(emitExpr(Stmt->getRetVal()));
+    else
+        Builder.CreateRetVoid();
+    // Statements after the RETURN go into an unreachable block.
+    llvm::BasicBlock *DeadBB = createBasicBlock("after.return");
+    setCurr(DeadBB);
+    sealBlock(DeadBB);
+}
+
+void CGProcedure::emit(ArrayRef<Stmt *> Stmts) {
+    for (Stmt *S : Stmts) {
+        if (auto *Assign = llvm::dyn_cast<AssignmentStatement>(S))
+            emitStmt(Assign);
+        else if (auto *Call = llvm::dyn_cast<ProcedureCallStatement>(S))
+            emitStmt(Call);
+        else if (auto *If = llvm::dyn_cast<IfStatement>(S))
+            emitStmt(If);
+        else if (auto *While = llvm::dyn_cast<WhileStatement>(S))
+            emitStmt(While);
+        else if (auto *Return = llvm::dyn_cast<ReturnStatement>(S))
+            emitStmt(Return);
+        else
+            llvm_unreachable("Unknown statement");
+    }
+}
+
+void CGProcedure::run(ProcedureDeclaration *Proc) {
+    this->Proc = Proc;
+    Fn = CGM.getOrCreateFunction(Proc);
+
+    auto Arg = Fn->arg_begin();
+    for (FormalParameterDeclaration *FP : Proc->getFormalParams()) {
+        Arg->setName(FP->getName());
+        FormalParams[FP] = &*Arg;
+        ++Arg;
+    }
+    emitPrologue(Proc->getFormalParams(), Proc->getDecls(), Proc->getStmts());
+    emit(Proc->getStmts());
+    emitEpilogue(Proc->getRetType());
+}
+
+void CGProcedure::run(ModuleDeclaration *Mod) {
+    this->Proc = Mod;
+    auto *FTy = llvm::FunctionType::get(CGM.VoidTy, /*IsVarArgs*/ false);
+    Fn = llvm::Function::Create(FTy, llvm::GlobalValue::ExternalLinkage,
+                                CGM.mangleName(Mod), CGM.getModule());
+
+    // The variables of the module are globals, there are no locals.
+    emitPrologue({}, {}, Mod->getStmts());
+    emit(Mod->getStmts());
+    emitEpilogue(nullptr);
+}
@@ -2,3 +2,46 @@
 // Created by jewoo on 2021-06-28.
 //
 
+#include "tinylang/CodeGen/CodeGen.h"
+#include "tinylang/CodeGen/CGModule.h"
+
+using namespace tinylang;
+
+CodeGenerator *CodeGenerator::create(llvm::LLVMContext &Ctx, llvm::TargetMachine *TM) {
+    return new CodeGenerator(Ctx, TM);
+}
+
+std::unique_ptr<llvm::Module> CodeGenerator::createModule(std::string FileName) {
+    std::unique_ptr<llvm::Module> M = std::make_unique<llvm::Module>(FileName, Ctx);
+    if (TM) {
+        M->setTargetTriple(TM->getTargetTriple().getTriple());
+        M->setDataLayout(TM->createDataLayout());
+    }
+    return M;
+}
+
+std::unique_ptr<llvm::Module> CodeGenerator::run(ModuleDeclaration *Mod, std::string FileName) {
+    std::unique_ptr<llvm::Module> M = createModule(FileName);
+    CGModule CGM(M.get());
+    CGM.run(Mod);
+    return M;
+}
+
+std::unique_ptr<llvm::Module> CodeGenerator::runModuleInit(ModuleDeclaration *Mod, std::string FileName) {
+    std::unique_ptr<llvm::Module> M = createModule(FileName);
+    CGModule CGM(M.get());
+    CGM.runModuleInit(Mod);
+    return M;
+}
+
+std::unique_ptr<llvm::Module> CodeGenerator::runProcedure(ModuleDeclaration *Mod, ProcedureDeclaration *Proc,
+                                                          std::string FileName) {
+    std::unique_ptr<llvm::Module> M = createModule(FileName);
+    CGModule CGM(M.get());
+    CGM.runProcedure(Mod, Proc);
+    return M;
+}
+
+std::string CodeGenerator::getMangledName(Decl *D) {
+    return CGModule::mangleName(D);
+}
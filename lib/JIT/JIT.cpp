@@ -0,0 +1,367 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#include "tinylang/JIT/JIT.h"
+#include "tinylang/CodeGen/CodeGen.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/Support/ErrorHandling.h"
+#include <csetjmp>
+
+using namespace tinylang;
+
+namespace tinylang {
+    // Generates and compiles a single procedure when its symbol is looked up
+    // for the first time.
+    class ProcedureMaterializationUnit : public llvm::orc::MaterializationUnit {
+        JIT &J;
+        ModuleDeclaration *Mod;
+        ProcedureDeclaration *Proc;
+        llvm::orc::JITDylib &ImplJD;
+
+    public:
+        ProcedureMaterializationUnit(JIT &J, ModuleDeclaration *Mod, ProcedureDeclaration *Proc,
+                                     llvm::orc::SymbolFlagsMap Symbols, llvm::orc::JITDylib &ImplJD) :
+                MaterializationUnit(Interface(std::move(Symbols), nullptr)),
+                J(J), Mod(Mod), Proc(Proc), ImplJD(ImplJD) {}
+
+        StringRef getName() const override { return "ProcedureMaterializationUnit"; }
+
+        void materialize(std::unique_ptr<llvm::orc::MaterializationResponsibility> R) override {
+            J.emitProcedure(std::move(R), Mod, Proc, ImplJD);
+        }
+
+    private:
+        void discard(const llvm::orc::JITDylib &JD, const llvm::orc::SymbolStringPtr &Name) override {
+            llvm_unreachable("Procedures are defined only once");
+        }
+    };
+}
+
+namespace {
+    struct NativeRun {
+        std::jmp_buf Env;
+        const char *Error;
+    };
+
+    LLVM_THREAD_LOCAL NativeRun *CurrentRun = nullptr;
+
+    // Called by the generated code on a runtime error. Only native code
+    // and frames without destructors lie between here and runNative.
+    void handleRuntimeError(const char *Msg) {
+        NativeRun *Run = CurrentRun;
+        if (!Run)
+            llvm::report_fatal_error(llvm::Twine("Runtime error outside of JIT::runNative: ") + Msg);
+        Run->Error = Msg;
+        std::longjmp(Run->Env, 1);
+    }
+
+    void handleLazyCallThroughError() {
+        llvm::report_fatal_error("Lazy compilation of a procedure failed");
+    }
+
+    std::string getEntryName(ProcedureDeclaration *Proc) {
+        return CodeGenerator::getMangledName(Proc) + ".entry";
+    }
+
+    // The entry point takes the arguments from an array of int64_t and
+    // returns the result as int64_t, so that the interpreter can call any
+    // procedure the same way.
+    void addEntryPoint(llvm::Module &M, ProcedureDeclaration *Proc) {
+        llvm::Function *Fn = M.getFunction(CodeGenerator::getMangledName(Proc));
+        llvm::LLVMContext &Ctx = M.getContext();
+        llvm::Type *Int64Ty = llvm::Type::getInt64Ty(Ctx);
+        auto *EntryTy = llvm::FunctionType::get(Int64Ty, {Int64Ty->getPointerTo()}, /*IsVarArgs*/ false);
+        auto *Entry = llvm::Function::Create(EntryTy, llvm::GlobalValue::ExternalLinkage,
+                                             getEntryName(Proc), M);
+        llvm::IRBuilder<> Builder(llvm::BasicBlock::Create(Ctx, "entry", Entry));
+        llvm::SmallVector<llvm::Value *, 8> Args;
+        for (llvm::Argument &Param : Fn->args()) {
+            llvm::Value *Val = Builder.CreateLoad(
+                    Int64Ty, Builder.CreateConstGEP1_64(Int64Ty, Entry->getArg(0), Param.getArgNo()));
+            // VAR parameters get an address, BOOLEAN parameters 0 or 1.
+            if (Param.getType()->isPointerTy())
+                Val = Builder.CreateIntToPtr(Val, Param.getType());
+            else
+                Val = Builder.CreateTrunc(Val, Param.getType());
+            Args.push_back(Val);
+        }
+        llvm::Value *Result = Builder.CreateCall(Fn, Args);
+        if (Result->getType()->isVoidTy())
+            Builder.CreateRet(llvm::ConstantInt::get(Int64Ty, 0));
+        else
+            Builder.CreateRet(Builder.CreateZExt(Result, Int64Ty));
+    }
+
+    void collectProcedures(ArrayRef<Decl *> Decls,
+                           llvm::SmallVectorImpl<ProcedureDeclaration *> &Procs) {
+        for (Decl *D : Decls) {
+            if (auto *Proc = dyn_cast<ProcedureDeclaration>(D)) {
+                Procs.push_back(Proc);
+                collectProcedures(Proc->getDecls(), Procs);
+            }
+        }
+    }
+
+    void collectCallees(Expr *E, llvm::SmallPtrSetImpl<ProcedureDeclaration *> &Callees) {
+        if (!E)
+            return;
+        if (auto *Infix = dyn_cast<InfixExpression>(E)) {
+            collectCallees(Infix->getLeft(), Callees);
+            collectCallees(Infix->getRight(), Callees);
+        } else if (auto *Prefix = dyn_cast<PrefixExpression>(E)) {
+            collectCallees(Prefix->getExpr(), Callees);
+        } else if (auto *Call = dyn_cast<FunctionCallExpr>(E)) {
+            Callees.insert(Call->getDecl());
+            for (Expr *Arg : Call->getParams())
+                collectCallees(Arg, Callees);
+        }
+    }
+
+    void collectCallees(ArrayRef<Stmt *> Stmts, llvm::SmallPtrSetImpl<ProcedureDeclaration *> &Callees) {
+        for (Stmt *S : Stmts) {
+            if (auto *Assign = dyn_cast<AssignmentStatement>(S))
+                collectCallees(Assign->getExpr(), Callees);
+            else if (auto *Call = dyn_cast<ProcedureCallStatement>(S)) {
+                Callees.insert(Call->getProc());
+                for (Expr *Arg : Call->getParams())
+                    collectCallees(Arg, Callees);
+            } else if (auto *If = dyn_cast<IfStatement>(S)) {
+                collectCallees(If->getCond(), Callees);
+                collectCallees(If->getIfStmts(), Callees);
+                collectCallees(If->getElseStmts(), Callees);
+            } else if (auto *While = dyn_cast<WhileStatement>(S)) {
+                collectCallees(While->getCond(), Callees);
+                collectCallees(While->getWhileStmts(), Callees);
+            } else if (auto *Return = dyn_cast<ReturnStatement>(S))
+                collectCallees(Return->getRetVal(), Callees);
+        }
+    }
+}
+
+llvm::Expected<std::unique_ptr<JIT>> JIT::create(llvm::TargetMachine &TM, OptimizeFunction Optimize,
+                                                 Mode Kind) {
+    std::unique_ptr<JIT> J(new JIT(TM, std::move(Optimize), Kind));
+
+    // Compile for the same target as the shared TargetMachine.
+    llvm::orc::JITTargetMachineBuilder JTMB(TM.getTargetTriple());
+    JTMB.setCPU(TM.getTargetCPU().str());
+    JTMB.addFeatures(llvm::SubtargetFeatures(TM.getTargetFeatureString()).getFeatures());
+    JTMB.setCodeGenOptLevel(TM.getOptLevel());
+    JTMB.setRelocationModel(TM.getRelocationModel());
+
+    llvm::orc::LLJITBuilder Builder;
+    Builder.setJITTargetMachineBuilder(std::move(JTMB));
+    // Materialization runs on a background thread, so that speculative
+    // and tiered compilation do not block the caller.
+    if (Kind == Mode::Speculative || Kind == Mode::Tiered)
+        Builder.setNumCompileThreads(1);
+    auto LLJ = Builder.create();
+    if (!LLJ)
+        return LLJ.takeError();
+    J->LLJ = std::move(*LLJ);
+
+    auto &MainJD = J->LLJ->getMainJITDylib();
+    llvm::orc::SymbolMap Runtime;
+    Runtime[J->LLJ->mangleAndIntern(CodeGenerator::getRuntimeErrorName())] = llvm::JITEvaluatedSymbol(
+            llvm::pointerToJITTargetAddress(&handleRuntimeError),
+            llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable);
+    if (llvm::Error Err = MainJD.define(llvm::orc::absoluteSymbols(std::move(Runtime))))
+        return std::move(Err);
+
+    if (Kind != Mode::Eager) {
+        const llvm::Triple &TT = J->LLJ->getTargetTriple();
+        auto LCTM = llvm::orc::createLocalLazyCallThroughManager(
+                TT, J->LLJ->getExecutionSession(),
+                llvm::pointerToJITTargetAddress(&handleLazyCallThroughError));
+        if (!LCTM)
+            return LCTM.takeError();
+        J->LCTM = std::move(*LCTM);
+        J->ISM = llvm::orc::createLocalIndirectStubsManagerBuilder(TT)();
+    }
+    return std::move(J);
+}
+
+JIT::~JIT() {
+    waitForCompiles();
+}
+
+void JIT::optimize(llvm::Module &M) {
+    std::lock_guard<std::mutex> Lock(OptimizeMutex);
+    Optimize(M);
+}
+
+void JIT::emitProcedure(std::unique_ptr<llvm::orc::MaterializationResponsibility> R,
+                        ModuleDeclaration *Mod, ProcedureDeclaration *Proc,
+                        llvm::orc::JITDylib &ImplJD) {
+    auto Ctx = std::make_unique<llvm::LLVMContext>();
+    std::unique_ptr<CodeGenerator> CG(CodeGenerator::create(*Ctx, &TM));
+    std::unique_ptr<llvm::Module> M = CG->runProcedure(Mod, Proc, CodeGenerator::getMangledName(Proc));
+    if (Kind == Mode::Tiered)
+        addEntryPoint(*M, Proc);
+    optimize(*M);
+    if (Kind == Mode::Speculative)
+        speculateCallees(Proc, ImplJD);
+    LLJ->getIRCompileLayer().emit(std::move(R),
+                                  llvm::orc::ThreadSafeModule(std::move(M), std::move(Ctx)));
+}
+
+// The lookup materializes the symbols on the compile thread. The AST must
+// stay alive until OnDone has run.
+void JIT::lookupInBackground(llvm::orc::JITDylib &JD, llvm::orc::SymbolLookupSet Symbols,
+                             llvm::unique_function<void(llvm::Expected<llvm::orc::SymbolMap>)> OnDone) {
+    {
+        std::lock_guard<std::mutex> Lock(PendingMutex);
+        ++Pending;
+    }
+    LLJ->getExecutionSession().lookup(
+            llvm::orc::LookupKind::Static, llvm::orc::makeJITDylibSearchOrder(&JD),
+            std::move(Symbols), llvm::orc::SymbolState::Ready,
+            [this, OnDone = std::move(OnDone)](llvm::Expected<llvm::orc::SymbolMap> Result) mutable {
+                OnDone(std::move(Result));
+                std::lock_guard<std::mutex> Lock(PendingMutex);
+                if (--Pending == 0)
+                    PendingCV.notify_all();
+            },
+            llvm::orc::NoDependenciesToRegister);
+}
+
+// Requests the implementations of the direct callees without waiting for
+// them.
+void JIT::speculateCallees(ProcedureDeclaration *Proc, llvm::orc::JITDylib &ImplJD) {
+    llvm::SmallPtrSet<ProcedureDeclaration *, 8> Callees;
+    collectCallees(Proc->getStmts(), Callees);
+    Callees.erase(Proc);
+    if (Callees.empty())
+        return;
+
+    llvm::orc::SymbolLookupSet Symbols;
+    for (ProcedureDeclaration *Callee : Callees)
+        Symbols.add(LLJ->mangleAndIntern(CodeGenerator::getMangledName(Callee)));
+    lookupInBackground(ImplJD, std::move(Symbols), [](llvm::Expected<llvm::orc::SymbolMap> Result) {
+        // An error shows up again when the procedure is called.
+        if (!Result)
+            llvm::consumeError(Result.takeError());
+    });
+}
+
+void JIT::compileInBackground(ModuleDeclaration *Mod, ProcedureDeclaration *Proc, ReadyFunction OnReady) {
+    llvm::orc::JITDylib *ImplJD = ImplDylibs.lookup(Mod);
+    assert(Kind == Mode::Tiered && ImplJD && "Procedures were not added for tiered execution");
+    auto Name = LLJ->mangleAndIntern(getEntryName(Proc));
+    lookupInBackground(*ImplJD, llvm::orc::SymbolLookupSet(Name),
+                       [Name, OnReady = std::move(OnReady)](llvm::Expected<llvm::orc::SymbolMap> Result) mutable {
+                           if (!Result)
+                               OnReady(Result.takeError());
+                           else
+                               OnReady((*Result)[Name].getAddress());
+                       });
+}
+
+llvm::Error JIT::runNative(llvm::function_ref<llvm::Error()> Run) {
+    NativeRun State;
+    NativeRun *Outer = CurrentRun;
+    CurrentRun = &State;
+    if (setjmp(State.Env) == 0) {
+        llvm::Error Err = Run();
+        CurrentRun = Outer;
+        return Err;
+    }
+    CurrentRun = Outer;
+    return llvm::createStringError(llvm::inconvertibleErrorCode(), State.Error);
+}
+
+void JIT::waitForCompiles() {
+    std::unique_lock<std::mutex> Lock(PendingMutex);
+    PendingCV.wait(Lock, [this] { return Pending == 0; });
+}
+
+// The procedures are defined in an implementation dylib. JD only holds
+// a lazy reexport, i.e. a stub, for each procedure.
+llvm::Error JIT::addLazyProcedures(llvm::orc::JITDylib &JD, ModuleDeclaration *Mod) {
+    auto ImplJD = LLJ->createJITDylib(JD.getName() + ".impl");
+    if (!ImplJD)
+        return ImplJD.takeError();
+    ImplDylibs[Mod] = &*ImplJD;
+    // Calls between procedures must go through the stubs, so the
+    // implementation dylib does not resolve against itself first.
+    ImplJD->setLinkOrder({{&JD, llvm::orc::JITDylibLookupFlags::MatchAllSymbols},
+                          {&LLJ->getMainJITDylib(), llvm::orc::JITDylibLookupFlags::MatchExportedSymbolsOnly}},
+                         /*LinkAgainstThisJITDylibFirst*/ false);
+
+    llvm::SmallVector<ProcedureDeclaration *, 16> Procs;
+    collectProcedures(Mod->getDecls(), Procs);
+    llvm::orc::SymbolAliasMap Reexports;
+    for (ProcedureDeclaration *Proc : Procs) {
+        auto Name = LLJ->mangleAndIntern(CodeGenerator::getMangledName(Proc));
+        auto Flags = llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable;
+        llvm::orc::SymbolFlagsMap Symbols({{Name, Flags}});
+        if (Kind == Mode::Tiered)
+            Symbols[LLJ->mangleAndIntern(getEntryName(Proc))] = Flags;
+        if (llvm::Error Err = ImplJD->define(
+                std::make_unique<ProcedureMaterializationUnit>(*this, Mod, Proc, std::move(Symbols), *ImplJD)))
+            return Err;
+        Reexports[Name] = llvm::orc::SymbolAliasMapEntry(Name, Flags);
+    }
+    return JD.define(llvm::orc::lazyReexports(*LCTM, *ISM, *ImplJD, std::move(Reexports)));
+}
+
+llvm::Error JIT::addProcedures(ModuleDeclaration *Mod, StringRef FileName,
+                               const llvm::DenseMap<Decl *, int64_t *> &Globals) {
+    assert(Kind == Mode::Tiered && "Only for tiered execution");
+    auto JD = LLJ->createJITDylib(FileName.str());
+    if (!JD)
+        return JD.takeError();
+    llvm::orc::SymbolMap Symbols;
+    for (auto &G : Globals)
+        Symbols[LLJ->mangleAndIntern(CodeGenerator::getMangledName(G.first))] =
+                llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(G.second), llvm::JITSymbolFlags::Exported);
+    if (llvm::Error Err = JD->define(llvm::orc::absoluteSymbols(std::move(Symbols))))
+        return Err;
+    return addLazyProcedures(*JD, Mod);
+}
+
+llvm::Expected<void (*)()> JIT::add(ModuleDeclaration *Mod, StringRef FileName) {
+    auto JD = LLJ->createJITDylib(FileName.str());
+    if (!JD)
+        return JD.takeError();
+    Dylibs[Mod] = &*JD;
+    // For the runtime functions.
+    JD->addToLinkOrder(LLJ->getMainJITDylib());
+    if (Kind != Mode::Eager) {
+        if (llvm::Error Err = addLazyProcedures(*JD, Mod))
+            return std::move(Err);
+        auto Ctx = std::make_unique<llvm::LLVMContext>();
+        std::unique_ptr<CodeGenerator> CG(CodeGenerator::create(*Ctx, &TM));
+        std::unique_ptr<llvm::Module> M = CG->runModuleInit(Mod, FileName.str());
+        optimize(*M);
+        if (llvm::Error Err = LLJ->addIRModule(
+                *JD, llvm::orc::ThreadSafeModule(std::move(M), std::move(Ctx))))
+            return std::move(Err);
+    } else {
+        auto Ctx = std::make_unique<llvm::LLVMContext>();
+        std::unique_ptr<CodeGenerator> CG(CodeGenerator::create(*Ctx, &TM));
+        std::unique_ptr<llvm::Module> M = CG->run(Mod, FileName.str());
+        optimize(*M);
+        if (llvm::Error Err = LLJ->addIRModule(
+                *JD, llvm::orc::ThreadSafeModule(std::move(M), std::move(Ctx))))
+            return std::move(Err);
+    }
+    // The lookup materializes the module body.
+    auto Sym = LLJ->lookup(*JD, CodeGenerator::getMangledName(Mod));
+    if (!Sym)
+        return Sym.takeError();
+    return llvm::jitTargetAddressToFunction<void (*)()>(Sym->getAddress());
+}
+
+llvm::Expected<void *> JIT::getVariableAddress(ModuleDeclaration *Mod, VariableDeclaration *Var) {
+    llvm::orc::JITDylib *JD = Dylibs.lookup(Mod);
+    assert(JD && "The module was not added");
+    auto Sym = LLJ->lookup(*JD, CodeGenerator::getMangledName(Var));
+    if (!Sym)
+        return Sym.takeError();
+    return llvm::jitTargetAddressToPointer<void *>(Sym->getAddress());
+}
@@ -0,0 +1,51 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#include "tinylang/JIT/TieredEngine.h"
+#include "tinylang/VM/BytecodeCompiler.h"
+
+using namespace tinylang;
+
+llvm::Expected<std::unique_ptr<TieredEngine>> TieredEngine::create(
+        JIT &J, ModuleDeclaration *Mod, StringRef FileName, unsigned HotThreshold) {
+    std::unique_ptr<TieredEngine> E(new TieredEngine(J, Mod));
+    E->P = vm::BytecodeCompiler::compile(Mod);
+    E->Interp = std::make_unique<vm::Interpreter>(*E->P);
+
+    llvm::DenseMap<Decl *, int64_t *> Globals;
+    for (auto &G : E->P->GlobalIndex)
+        Globals[G.first] = &E->Interp->getGlobals()[G.second];
+    if (llvm::Error Err = J.addProcedures(Mod, FileName, Globals))
+        return std::move(Err);
+
+    TieredEngine *Engine = E.get();
+    E->Interp->setHotThreshold(HotThreshold, [Engine](unsigned FnIndex) { Engine->tierUp(FnIndex); });
+    return std::move(E);
+}
+
+TieredEngine::~TieredEngine() {
+    J.waitForCompiles();
+}
+
+void TieredEngine::tierUp(unsigned FnIndex) {
+    // The module body runs only once.
+    auto *Proc = llvm::dyn_cast<ProcedureDeclaration>(P->Functions[FnIndex].Proc);
+    if (!Proc)
+        return;
+    J.compileInBackground(Mod, Proc, [this, FnIndex](llvm::Expected<llvm::JITTargetAddress> Entry) {
+        // If the compilation fails, the procedure stays in the interpreter.
+        if (!Entry) {
+            llvm::consumeError(Entry.takeError());
+            return;
+        }
+        Interp->setNativeEntry(FnIndex, llvm::jitTargetAddressToFunction<vm::Interpreter::NativeEntry>(*Entry));
+        ++NumCompiled;
+    });
+}
+
+// The interpreter holds nothing with a destructor while it calls native
+// code, so a runtime error in there may unwind it.
+llvm::Error TieredEngine::run() {
+    return JIT::runNative([this] { return Interp->run(); });
+}
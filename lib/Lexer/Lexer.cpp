@@ -3,18 +3,108 @@
 //
 
 #include "tinylang/Lexer/Lexer.h"
+#include "llvm/Support/MathExtras.h"
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace tinylang;
 
-void KeyWordFilter::addKeyword(StringRef Keyword, tok::TokenKind TokenCode) {
-    HashTable.insert(std::make_pair(Keyword, TokenCode));
-}
+namespace {
+    struct KeywordEntry {
+        const char *Name;
+        unsigned Length;
+        tok::TokenKind Kind;
+    };
 
-void KeyWordFilter::addKeyWords() {
-#define KEYWORD(NAME, FLAGS) \
-  addKeyword(StringRef(#NAME), tok::kw_##NAME);
+    constexpr KeywordEntry Keywords[] = {
+#define KEYWORD(NAME, FLAGS) {#NAME, sizeof(#NAME) - 1, tok::kw_##NAME},
 
 #include "tinylang/Basic/TokenKinds.def"
+    };
+
+    constexpr unsigned KeywordTableSize = 64;
+
+    constexpr unsigned minKeywordLength() {
+        unsigned Min = ~0U;
+        for (const KeywordEntry &K : Keywords)
+            Min = K.Length < Min ? K.Length : Min;
+        return Min;
+    }
+
+    constexpr unsigned maxKeywordLength() {
+        unsigned Max = 0;
+        for (const KeywordEntry &K : Keywords)
+            Max = K.Length > Max ? K.Length : Max;
+        return Max;
+    }
+
+    constexpr unsigned MinKeywordLength = minKeywordLength();
+    constexpr unsigned MaxKeywordLength = maxKeywordLength();
+    static_assert(MinKeywordLength >= 2,
+                  "keyword hash looks at the first two characters");
+
+    // The hash mixes the length with the first two characters. Only the
+    // multiplier is searched for; the first one without collisions wins.
+    constexpr unsigned keywordHash(size_t Length, const char *Name,
+                                   unsigned Multiplier) {
+        return (Length + static_cast<unsigned char>(Name[0]) +
+                Multiplier * static_cast<unsigned char>(Name[1])) &
+               (KeywordTableSize - 1);
+    }
+
+    constexpr bool isCollisionFree(unsigned Multiplier) {
+        bool Used[KeywordTableSize] = {};
+        for (const KeywordEntry &K : Keywords) {
+            unsigned Slot = keywordHash(K.Length, K.Name, Multiplier);
+            if (Used[Slot])
+                return false;
+            Used[Slot] = true;
+        }
+        return true;
+    }
+
+    constexpr unsigned findMultiplier() {
+        for (unsigned Multiplier = 1; Multiplier < 1024; ++Multiplier)
+            if (isCollisionFree(Multiplier))
+                return Multiplier;
+        return 0;
+    }
+
+    constexpr unsigned KeywordMultiplier = findMultiplier();
+    static_assert(KeywordMultiplier != 0,
+                  "no perfect keyword hash found, increase KeywordTableSize");
+
+    struct KeywordTable {
+        KeywordEntry Slots[KeywordTableSize];
+    };
+
+    constexpr KeywordTable buildKeywordTable() {
+        KeywordTable Table{};
+        for (KeywordEntry &Slot : Table.Slots)
+            Slot = {"", 0, tok::unknown};
+        for (const KeywordEntry &K : Keywords)
+            Table.Slots[keywordHash(K.Length, K.Name, KeywordMultiplier)] = K;
+        return Table;
+    }
+
+    constexpr KeywordTable KeywordSlots = buildKeywordTable();
+}
+
+tok::TokenKind KeyWordFilter::getKeyWord(StringRef Name,
+                                         tok::TokenKind DefaultTokenCode) {
+    size_t Length = Name.size();
+    if (Length < MinKeywordLength || Length > MaxKeywordLength)
+        return DefaultTokenCode;
+    const KeywordEntry &Slot =
+            KeywordSlots.Slots[keywordHash(Length, Name.data(), KeywordMultiplier)];
+    if (Slot.Length == Length && !memcmp(Slot.Name, Name.data(), Length))
+        return Slot.Kind;
+    return DefaultTokenCode;
 }
 
 namespace charinfo {
@@ -39,7 +129,12 @@ namespace charinfo {
     }
 
     LLVM_READNONE inline bool isHexDigit(char Ch) {
-        return isASCII(Ch) && (isDigit(Ch) || (Ch >= 'A' || Ch <= 'F'));
+        return isASCII(Ch) && (isDigit(Ch) || (Ch >= 'A' && Ch <= 'F'));
+    }
+
+    // Value of a decimal or upper case hex digit.
+    LLVM_READNONE inline unsigned hexDigitValue(char Ch) {
+        return isDigit(Ch) ? Ch - '0' : Ch - 'A' + 10;
     }
 
     LLVM_READNONE inline bool isIdentifierHead(char Ch) {
@@ -52,12 +147,109 @@ namespace charinfo {
     }
 }
 
-void Lexer::next(Token &Result) {
-    while (*CurPtr && charinfo::isWhiteSpace(*CurPtr)) {
-        ++CurPtr;
+// The scanners below look at a whole vector of characters per step. They
+// never load past End, the remaining characters are handled one at a time.
+namespace scan {
+#if defined(__AVX2__)
+    constexpr unsigned VectorSize = 32;
+    using Vector = __m256i;
+
+    inline Vector load(const char *Ptr) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Ptr));
+    }
+
+    inline Vector splat(char Ch) { return _mm256_set1_epi8(Ch); }
+
+    inline Vector cmpeq(Vector A, Vector B) { return _mm256_cmpeq_epi8(A, B); }
+
+    inline Vector cmpgt(Vector A, Vector B) { return _mm256_cmpgt_epi8(A, B); }
+
+    inline Vector both(Vector A, Vector B) { return _mm256_and_si256(A, B); }
+
+    inline Vector either(Vector A, Vector B) { return _mm256_or_si256(A, B); }
+
+    inline uint32_t mask(Vector V) {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(V));
+    }
+#elif defined(__SSE2__)
+    constexpr unsigned VectorSize = 16;
+    using Vector = __m128i;
+
+    inline Vector load(const char *Ptr) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(Ptr));
+    }
+
+    inline Vector splat(char Ch) { return _mm_set1_epi8(Ch); }
+
+    inline Vector cmpeq(Vector A, Vector B) { return _mm_cmpeq_epi8(A, B); }
+
+    inline Vector cmpgt(Vector A, Vector B) { return _mm_cmpgt_epi8(A, B); }
+
+    inline Vector both(Vector A, Vector B) { return _mm_and_si128(A, B); }
+
+    inline Vector either(Vector A, Vector B) { return _mm_or_si128(A, B); }
+
+    inline uint32_t mask(Vector V) {
+        return static_cast<uint32_t>(_mm_movemask_epi8(V));
+    }
+#else
+    constexpr unsigned VectorSize = 0;
+#endif
+
+    constexpr uint32_t AllSet =
+            VectorSize == 32 ? 0xFFFFFFFFu : (1u << VectorSize) - 1;
+
+    // Returns the first character in [Ptr, End) which is not white space.
+    inline const char *skipWhiteSpace(const char *Ptr, const char *End) {
+#if defined(__AVX2__) || defined(__SSE2__)
+        // '\t', '\n', '\v', '\f' and '\r' are the range 9..13. The signed
+        // compare keeps non-ASCII characters out of the range.
+        const Vector Below = splat('\t' - 1);
+        const Vector Above = splat('\r' + 1);
+        const Vector Blank = splat(' ');
+        while (End - Ptr >= static_cast<ptrdiff_t>(VectorSize)) {
+            Vector V = load(Ptr);
+            Vector IsSpace = either(
+                    both(cmpgt(V, Below), cmpgt(Above, V)),
+                    cmpeq(V, Blank));
+            if (uint32_t NonSpace = mask(IsSpace) ^ AllSet)
+                return Ptr + llvm::countTrailingZeros(NonSpace);
+            Ptr += VectorSize;
+        }
+#endif
+        while (Ptr != End && charinfo::isWhiteSpace(*Ptr))
+            ++Ptr;
+        return Ptr;
+    }
+
+    // Returns the first character in [Ptr, End) which may start or end a
+    // comment, that is '(', ')' or the terminating NUL. The '*' of a
+    // delimiter is checked by the caller, so a run of '*' in a comment
+    // does not stop the scan.
+    inline const char *findCommentDelimiter(const char *Ptr, const char *End) {
+#if defined(__AVX2__) || defined(__SSE2__)
+        const Vector LParen = splat('(');
+        const Vector RParen = splat(')');
+        const Vector Nul = splat('\0');
+        while (End - Ptr >= static_cast<ptrdiff_t>(VectorSize)) {
+            Vector V = load(Ptr);
+            Vector Hit = either(either(cmpeq(V, LParen), cmpeq(V, RParen)),
+                                cmpeq(V, Nul));
+            if (uint32_t Mask = mask(Hit))
+                return Ptr + llvm::countTrailingZeros(Mask);
+            Ptr += VectorSize;
+        }
+#endif
+        while (Ptr != End && *Ptr && *Ptr != '(' && *Ptr != ')')
+            ++Ptr;
+        return Ptr;
     }
+}
+
+void Lexer::next(Token &Result) {
+    CurPtr = scan::skipWhiteSpace(CurPtr, CurBuf.end());
     if (!*CurPtr) {
-        Result.setKind(tok::eof);
+        formToken(Result, CurPtr, tok::eof);
         return;
     }
     if (charinfo::isIdentifierHead(*CurPtr)) {
@@ -105,12 +297,33 @@ void Lexer::next(Token &Result) {
                 else formToken(Result, CurPtr + 1, tok::greater);
                 break;
             default:
-                Result.setKind(tok::unknown);
+                formToken(Result, CurPtr + 1, tok::unknown);
         }
         return;
     }
 }
 
+void Lexer::lex(TokenStream &Tokens) {
+    // Roughly one token per five characters in typical sources.
+    Tokens.reserve(Tokens.size() + (CurBuf.end() - CurPtr) / 5 + 1);
+    Token Tok;
+    do {
+        next(Tok);
+        Tokens.push_back(Tok);
+    } while (Tok.isNot(tok::eof));
+}
+
+const char *Lexer::lexUntil(TokenStream &Tokens, const char *Limit) {
+    Token Tok;
+    for (;;) {
+        next(Tok);
+        if (Limit && Tok.Ptr >= Limit)
+            return Tok.Ptr;
+        Tokens.push_back(Tok);
+        if (Tok.is(tok::eof))
+            return nullptr;
+    }
+}
 
 void Lexer::identifier(Token &Result) {
     const char *Start{CurPtr};
@@ -118,8 +331,10 @@ void Lexer::identifier(Token &Result) {
     while (charinfo::isIdentifierBody(*End))
         ++End;
     StringRef Name(Start, End - Start);
-    formToken(Result, End,
-              Keywords.getKeyWord(Name, tok::identifier));
+    tok::TokenKind Kind = KeyWordFilter::getKeyWord(Name, tok::identifier);
+    if (Kind == tok::identifier && Idents)
+        Result.IdentifierID = Idents->get(Name);
+    formToken(Result, End, Kind);
 }
 
 void Lexer::number(Token &Result) {
@@ -127,17 +342,29 @@ void Lexer::number(Token &Result) {
     const char *End{CurPtr + 1};
     tok::TokenKind Kind = tok::unknown;
 
+    // The value is computed in both radixes while scanning, the suffix
+    // decides which one is used.
+    int64_t Decimal = charinfo::hexDigitValue(*Start);
+    int64_t Hex = Decimal;
+    bool DecimalOverflow{false};
+    bool HexOverflow{false};
     bool IsHex{false};
     while (*End) {
         if (!charinfo::isHexDigit(*End))
             break;
         if (!charinfo::isDigit(*End))
             IsHex = true;
+        int64_t Digit = charinfo::hexDigitValue(*End);
+        DecimalOverflow |= llvm::MulOverflow(Decimal, int64_t(10), Decimal) ||
+                           llvm::AddOverflow(Decimal, Digit, Decimal);
+        HexOverflow |= llvm::MulOverflow(Hex, int64_t(16), Hex) ||
+                       llvm::AddOverflow(Hex, Digit, Hex);
         ++End;
     }
     switch (*End) {
         case 'H':
             Kind = tok::integer_literal;
+            Result.IntegerValue = HexOverflow ? -1 : Hex;
             ++End;
             break;
         default:
@@ -146,6 +373,8 @@ void Lexer::number(Token &Result) {
                              diag::err_hex_digit_in_decimal);
             }
             Kind = tok::integer_literal;
+            // The error is already reported, so the value does not matter.
+            Result.IntegerValue = IsHex ? 0 : DecimalOverflow ? -1 : Decimal;
             break;
     }
     formToken(Result, End, Kind);
@@ -167,18 +396,26 @@ void Lexer::string(Token &Result) {
 
 void Lexer::comment() {
     const char *End{CurPtr + 2};
+    // The start of the text after the last delimiter. A '*' before it
+    // belongs to that delimiter, as in "(*)".
+    const char *Text{End};
     unsigned Level{1};
-    while (*End && Level) {
+    while (Level) {
+        End = scan::findCommentDelimiter(End, CurBuf.end());
+        if (!*End)
+            break;
         if (*End == '(' && *(End + 1) == '*') {
             End += 2;
+            Text = End;
             Level++;
-        } else if (*End == '*' && *(End + 1) == ')') {
-            End += 2;
+        } else if (*End == ')' && End > Text && *(End - 1) == '*') {
+            ++End;
+            Text = End;
             Level--;
         } else
             ++End;
     }
-    if (!*End) {
+    if (Level) {
         Diags.report(getLoc(),
                      diag::err_unterminated_block_comment);
     }
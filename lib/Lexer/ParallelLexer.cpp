@@ -0,0 +1,107 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#include "tinylang/Lexer/Lexer.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include <cstring>
+
+using namespace tinylang;
+
+namespace {
+    // Smaller chunks are not worth a thread.
+    constexpr size_t MinChunkSize = 1 << 20;
+
+    // One chunk of the buffer, lexed on a worker thread as if no comment
+    // was open at its beginning.
+    struct Chunk {
+        const char *Begin;
+        const char *Limit;
+        TokenStream Tokens;
+        const char *Stop;
+        std::vector<const char *> DiagLocs;
+
+        Chunk(StringRef Buffer, const char *Begin, const char *Limit) :
+                Begin(Begin), Limit(Limit), Tokens(Buffer), Stop(nullptr) {}
+    };
+}
+
+void Lexer::lexParallel(TokenStream &Tokens, unsigned NumThreads) {
+    size_t Size = CurBuf.end() - CurPtr;
+    size_t NumChunks = std::min<size_t>(NumThreads, Size / MinChunkSize);
+    if (NumChunks <= 1) {
+        lex(Tokens);
+        return;
+    }
+
+    // Chunks begin at the start of a line. A string literal never spans a
+    // line, so a chunk can only start in the wrong state if a comment is open.
+    std::vector<const char *> Bounds{CurPtr};
+    for (size_t I = 1; I < NumChunks; ++I) {
+        const char *Ptr = CurPtr + Size * I / NumChunks;
+        if (Ptr <= Bounds.back())
+            continue;
+        Ptr = static_cast<const char *>(
+                memchr(Ptr, '\n', CurBuf.end() - Ptr));
+        if (!Ptr)
+            break;
+        Bounds.push_back(Ptr + 1);
+    }
+
+    std::vector<Chunk> Chunks;
+    Chunks.reserve(Bounds.size());
+    for (size_t I = 0, E = Bounds.size(); I != E; ++I)
+        Chunks.emplace_back(CurBuf, Bounds[I],
+                            I + 1 != E ? Bounds[I + 1] : nullptr);
+
+    {
+        llvm::ThreadPool Pool(llvm::hardware_concurrency(NumThreads));
+        for (Chunk &C : Chunks) {
+            Pool.async([this, &C] {
+                // The worker reports into a private engine, which is never
+                // flushed. Only the locations of its diagnostics are used.
+                DiagnosticEngine WorkerDiags(SrcMgr);
+                IdentifierTable WorkerIdents;
+                Lexer Worker(SrcMgr, WorkerDiags, WorkerIdents);
+                // Identifiers are interned when the chunk is taken over, to
+                // keep the IDs in the order of the serial lexer.
+                Worker.Idents = nullptr;
+                Worker.CurPtr = C.Begin;
+                C.Stop = Worker.lexUntil(C.Tokens, C.Limit);
+                for (const StoredDiagnostic &D : WorkerDiags.getDiagnostics())
+                    C.DiagLocs.push_back(D.Loc.getPointer());
+            });
+        }
+        Pool.wait();
+    }
+
+    // Stitch the chunks together. Expected is where the serial lexer would
+    // start the next token. Lexing only depends on the position, so once a
+    // chunk has a token starting there, the rest of the chunk is correct.
+    // Otherwise, or if the part taken over reported a diagnostic, the chunk
+    // is lexed again from Expected with the real diagnostics engine.
+    const char *Expected = CurPtr;
+    for (Chunk &C : Chunks) {
+        if (!Expected)
+            break;
+        if (C.Limit && Expected >= C.Limit)
+            continue;
+        size_t First = C.Tokens.lowerBound(Expected);
+        bool InSync = First < C.Tokens.size() &&
+                      C.Tokens.getLocation(First).getPointer() == Expected;
+        bool HasDiags = std::any_of(
+                C.DiagLocs.begin(), C.DiagLocs.end(),
+                [Expected](const char *Loc) { return Loc >= Expected; });
+        if (InSync && !HasDiags) {
+            size_t Start = Tokens.size();
+            Tokens.append(C.Tokens, First);
+            Tokens.internIdentifiers(*Idents, Start);
+            Expected = C.Stop;
+        } else {
+            CurPtr = Expected;
+            Expected = lexUntil(Tokens, C.Limit);
+        }
+    }
+    CurPtr = Tokens.getLocation(Tokens.size() - 1).getPointer();
+}
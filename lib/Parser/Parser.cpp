@@ -2,8 +2,10 @@
 // Created by jewoo on 2021-06-28.
 //
 
+#include "tinylang/Basic/TimeReport.h"
 #include "tinylang/Basic/TokenKinds.h"
 #include "tinylang/Parser/Parser.h"
+#include <array>
 
 using namespace tinylang;
 
@@ -11,10 +13,75 @@ namespace {
     OperatorInfo fromTok(Token Tok) {
         return OperatorInfo(Tok.getLocation(), Tok.getKind());
     }
+
+    Ident toIdent(Token Tok) {
+        return Ident(Tok.getLocation(), Tok.getIdentifier(), Tok.getIdentifierID());
+    }
+
+    // The FIRST sets pick the alternatives of a rule. Error recovery in a
+    // rule skips to a token of its FOLLOW set.
+    constexpr TokenSet FirstImport(tok::kw_FROM, tok::kw_IMPORT);
+    constexpr TokenSet FirstDeclaration(tok::kw_CONST, tok::kw_PROCEDURE, tok::kw_VAR);
+    constexpr TokenSet FirstFormalParameter(tok::kw_VAR, tok::identifier);
+    constexpr TokenSet FirstFactor(tok::l_paren, tok::kw_NOT, tok::identifier, tok::integer_literal);
+    constexpr TokenSet FirstExpression = FirstFactor | TokenSet(tok::plus, tok::minus);
+
+    constexpr TokenSet RelationOperators(tok::hash, tok::less, tok::lessequal,
+                                         tok::equal, tok::greater, tok::greaterequal);
+    constexpr TokenSet AddOperators(tok::plus, tok::minus, tok::kw_OR);
+    constexpr TokenSet MulOperators(tok::star, tok::slash, tok::kw_AND, tok::kw_DIV, tok::kw_MOD);
+
+    namespace prec {
+        enum Level : unsigned {
+            Unknown = 0,
+            Relational = 1,
+            Additive = 2,
+            Multiplicative = 3,
+        };
+    }
+
+    // The precedence of each binary operator.
+    constexpr auto BinaryPrecedence = [] {
+        std::array<unsigned char, tok::NUM_TOKENS> Table{};
+        for (unsigned Kind = 0; Kind != tok::NUM_TOKENS; ++Kind) {
+            auto K = static_cast<tok::TokenKind>(Kind);
+            if (RelationOperators.contains(K))
+                Table[Kind] = prec::Relational;
+            else if (AddOperators.contains(K))
+                Table[Kind] = prec::Additive;
+            else if (MulOperators.contains(K))
+                Table[Kind] = prec::Multiplicative;
+        }
+        return Table;
+    }();
+
+    constexpr TokenSet FollowCompilationUnit(tok::eof);
+    constexpr TokenSet FollowImport = FirstImport | FirstDeclaration | TokenSet(tok::kw_BEGIN, tok::kw_END);
+    constexpr TokenSet FollowBlock(tok::identifier);
+    constexpr TokenSet FollowDeclaration = FirstDeclaration | TokenSet(tok::kw_BEGIN, tok::kw_END);
+    constexpr TokenSet FollowConstantDeclaration(tok::semi);
+    constexpr TokenSet FollowVariableDeclaration(tok::semi);
+    constexpr TokenSet FollowProcedureDeclaration(tok::semi);
+    constexpr TokenSet FollowFormalParameters(tok::semi);
+    constexpr TokenSet FollowFormalParameterList(tok::r_paren);
+    constexpr TokenSet FollowFormalParameter(tok::r_paren, tok::semi);
+    constexpr TokenSet FollowStatementSequence(tok::kw_ELSE, tok::kw_END);
+    constexpr TokenSet FollowStatement = FollowStatementSequence | TokenSet(tok::semi);
+    constexpr TokenSet FollowExpList(tok::r_paren);
+    constexpr TokenSet FollowExpression(tok::r_paren, tok::comma, tok::semi, tok::kw_DO,
+                                        tok::kw_ELSE, tok::kw_END, tok::kw_THEN);
+    constexpr TokenSet FollowFactor = FollowExpression | RelationOperators | AddOperators | MulOperators;
+    constexpr TokenSet FollowQualident = FollowFactor | TokenSet(tok::l_paren, tok::colonequal);
+    constexpr TokenSet FollowIdentList(tok::colon, tok::semi);
 }
 
 Parser::Parser(Lexer &Lex, Sema &Actions) :
-        Lex(Lex), Actions(Actions) {
+        Lex(Lex), Actions(Actions), Tokens(nullptr), NextToken(0) {
+    advance();
+}
+
+Parser::Parser(Lexer &Lex, const TokenStream &Tokens, Sema &Actions) :
+        Lex(Lex), Actions(Actions), Tokens(&Tokens), NextToken(0) {
     advance();
 }
 
@@ -30,14 +97,13 @@ bool Parser::parseCompilationUnit(ModuleDeclaration *&D) {
             goto _error;
         if (expect(tok::identifier))
             goto _error;
-        D = Actions.actOnModuleDeclaration(Tok.getLocation(),
-                                           Tok.getIdentifier());
+        D = Actions.actOnModuleDeclaration(toIdent(Tok));
 
         EnterDeclScope S(Actions, D);
         advance();
         if (consume(tok::semi))
             goto _error;
-        while (Tok.isOneOf(tok::kw_FROM, tok::kw_IMPORT)) {
+        while (Tok.isOneOf(FirstImport)) {
             if (parseImport())
                 goto _error;
         }
@@ -48,8 +114,7 @@ bool Parser::parseCompilationUnit(ModuleDeclaration *&D) {
         if (expect(tok::identifier))
             goto _error;
 
-        Actions.actOnModuleDeclaration(D, Tok.getLocation(),
-                                       Tok.getIdentifier(),
+        Actions.actOnModuleDeclaration(D, toIdent(Tok),
                                        Decls, Stmts);
         advance();
         if (consume(tok::period))
@@ -57,9 +122,7 @@ bool Parser::parseCompilationUnit(ModuleDeclaration *&D) {
         return false;
     }
     _error:
-    while (!Tok.is(tok::eof)) {
-        advance();
-    }
+    skipUntil(FollowCompilationUnit);
     return false;
 }
 
@@ -85,21 +148,15 @@ bool Parser::parseImport() {
         return false;
     }
     _error:
-    while (!Tok.isOneOf(tok::kw_BEGIN, tok::kw_CONST,
-                        tok::kw_END, tok::kw_FROM,
-                        tok::kw_IMPORT, tok::kw_PROCEDURE,
-                        tok::kw_VAR)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowImport);
 }
 
 bool Parser::parseBlock(DeclList &Decls, StmtList &Stmts) {
     {
-        while (Tok.isOneOf(tok::kw_CONST, tok::kw_PROCEDURE,
-                           tok::kw_VAR)) {
+        while (Tok.isOneOf(FirstDeclaration)) {
+            // Nothing more is reported, so stop parsing.
+            if (getDiagnostics().hasReachedErrorLimit())
+                goto _error;
             if (parseDeclaration(Decls))
                 goto _error;
         }
@@ -113,12 +170,7 @@ bool Parser::parseBlock(DeclList &Decls, StmtList &Stmts) {
         return false;
     }
     _error:
-    while (!Tok.is(tok::identifier)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowBlock);
 }
 
 bool Parser::parseDeclaration(DeclList &Decls) {
@@ -147,27 +199,21 @@ bool Parser::parseDeclaration(DeclList &Decls) {
 
             if (consume(tok::semi))
                 goto _error;
-        } else goto _error;
+        } else {
+            reportExpected("declaration");
+            goto _error;
+        }
         return false;
     }
     _error:
-    while (!Tok.isOneOf(tok::kw_BEGIN, tok::kw_CONST,
-                        tok::kw_END,
-                        tok::kw_PROCEDURE,
-                        tok::kw_VAR)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowDeclaration);
 }
 
 bool Parser::parseConstantDeclaration(DeclList &Decls) {
     {
         if (expect(tok::identifier))
             goto _error;
-        SMLoc Loc = Tok.getLocation();
-        StringRef Name = Tok.getIdentifier();
+        Ident Name = toIdent(Tok);
         advance();
 
         if (expect(tok::equal))
@@ -176,16 +222,11 @@ bool Parser::parseConstantDeclaration(DeclList &Decls) {
         advance();
         if (parseExpression(E))
             goto _error;
-        Actions.actOnConstantDeclaration(Decls, Loc, Name, E);
+        Actions.actOnConstantDeclaration(Decls, Name, E);
         return false;
     }
     _error:
-    while (!Tok.is(tok::semi)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowConstantDeclaration);
 
 }
 
@@ -203,12 +244,7 @@ bool Parser::parseVariableDeclaration(DeclList &Decls) {
         return false;
     }
     _error:
-    while (!Tok.is(tok::semi)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowVariableDeclaration);
 }
 
 bool Parser::parseProcedureDeclaration(DeclList &ParentDecls) {
@@ -218,8 +254,8 @@ bool Parser::parseProcedureDeclaration(DeclList &ParentDecls) {
         if (expect(tok::identifier))
             goto _error;
         ProcedureDeclaration *D =
-                Actions.actOnProcedureDeclaration(
-                        Tok.getLocation(), Tok.getIdentifier());
+                Actions.actOnProcedureDeclaration(toIdent(Tok));
+        TimeScope Timer("Parse", [D] { return D->getQualifiedName(); }, /*IsProcedure*/ true);
         EnterDeclScope S(Actions, D);
         FormalParamList Params;
         Decl *RetType = nullptr;
@@ -239,26 +275,20 @@ bool Parser::parseProcedureDeclaration(DeclList &ParentDecls) {
         }
         if (expect(tok::identifier))
             goto _error;
-        Actions.actOnProcedureDeclaration(D, Tok.getLocation(),
-                                          Tok.getIdentifier(), Decls, Stmts);
+        Actions.actOnProcedureDeclaration(D, toIdent(Tok), Decls, Stmts);
         ParentDecls.push_back(D);
         advance();
         return false;
     }
     _error:
-    while (!Tok.is(tok::semi)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowProcedureDeclaration);
 }
 
 bool Parser::parseFormalParameters(FormalParamList &Params, Decl *&RetType) {
     {
         if (consume(tok::l_paren))
             goto _error;
-        if (Tok.isOneOf(tok::kw_VAR, tok::identifier)) {
+        if (Tok.isOneOf(FirstFormalParameter)) {
             if (parseFormalParameterList(Params))
                 goto _error;
         }
@@ -272,12 +302,7 @@ bool Parser::parseFormalParameters(FormalParamList &Params, Decl *&RetType) {
         return false;
     }
     _error:
-    while (!Tok.is(tok::semi)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowFormalParameters);
 }
 
 bool Parser::parseFormalParameterList(FormalParamList &Params) {
@@ -292,12 +317,7 @@ bool Parser::parseFormalParameterList(FormalParamList &Params) {
         return false;
     }
     _error:
-    while (!Tok.is(tok::r_paren)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowFormalParameterList);
 }
 
 
@@ -320,12 +340,7 @@ bool Parser::parseFormalParameter(FormalParamList &Params) {
         return false;
     }
     _error:
-    while (!Tok.isOneOf(tok::r_paren, tok::semi)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowFormalParameter);
 }
 
 bool Parser::parseStatementSequence(StmtList &Stmts) {
@@ -333,6 +348,8 @@ bool Parser::parseStatementSequence(StmtList &Stmts) {
         if (parseStatement(Stmts))
             goto _error;
         while (Tok.is(tok::semi)) {
+            if (getDiagnostics().hasReachedErrorLimit())
+                goto _error;
             advance();
             if (parseStatement(Stmts))
                 goto _error;
@@ -340,12 +357,7 @@ bool Parser::parseStatementSequence(StmtList &Stmts) {
         return false;
     }
     _error:
-    while (!Tok.isOneOf(tok::kw_ELSE, tok::kw_END)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowStatementSequence);
 }
 
 bool Parser::parseStatement(StmtList &Stmts) {
@@ -365,12 +377,7 @@ bool Parser::parseStatement(StmtList &Stmts) {
                 ExprList Exprs;
                 if (Tok.is(tok::l_paren)) {
                     advance();
-                    if (Tok.isOneOf(tok::l_paren,
-                                    tok::plus,
-                                    tok::minus,
-                                    tok::kw_NOT,
-                                    tok::identifier,
-                                    tok::integer_literal)) {
+                    if (Tok.isOneOf(FirstExpression)) {
                         if (parseExpList(Exprs))
                             goto _error;
                     }
@@ -389,18 +396,15 @@ bool Parser::parseStatement(StmtList &Stmts) {
         } else if (Tok.is(tok::kw_RETURN)) {
             if (parseReturnStatement(Stmts))
                 goto _error;
-        } else {
+        } else if (!Tok.isOneOf(FollowStatement)) {
+            // Anything else in FOLLOW is an empty statement.
+            reportExpected("statement");
             goto _error;
         }
         return false;
     }
     _error:
-    while (!Tok.isOneOf(tok::semi, tok::kw_ELSE, tok::kw_END)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowStatement);
 }
 
 bool Parser::parseIfStatement(StmtList &Stmts) {
@@ -429,12 +433,7 @@ bool Parser::parseIfStatement(StmtList &Stmts) {
         return false;
     }
     _error:
-    while (!Tok.isOneOf(tok::semi, tok::kw_ELSE, tok::kw_END)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowStatement);
 }
 
 bool Parser::parseWhileStatement(StmtList &Stmts) {
@@ -457,12 +456,7 @@ bool Parser::parseWhileStatement(StmtList &Stmts) {
         return false;
     }
     _error:
-    while (!Tok.isOneOf(tok::semi, tok::kw_ELSE, tok::kw_END)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowStatement);
 }
 
 bool Parser::parseReturnStatement(StmtList &Stmts) {
@@ -471,11 +465,7 @@ bool Parser::parseReturnStatement(StmtList &Stmts) {
         SMLoc Loc = Tok.getLocation();
         if (consume(tok::kw_RETURN))
             goto _error;
-        if (Tok.isOneOf(tok::l_paren,
-                        tok::plus,
-                        tok::minus, tok::kw_NOT,
-                        tok::identifier,
-                        tok::integer_literal)) {
+        if (Tok.isOneOf(FirstExpression)) {
             if (parseExpression(E))
                 goto _error;
         }
@@ -483,12 +473,7 @@ bool Parser::parseReturnStatement(StmtList &Stmts) {
         return false;
     }
     _error:
-    while (!Tok.isOneOf(tok::semi, tok::kw_ELSE, tok::kw_END)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowStatement);
 }
 
 bool Parser::parseExpList(ExprList &Exprs) {
@@ -509,229 +494,70 @@ bool Parser::parseExpList(ExprList &Exprs) {
         return false;
     }
     _error:
-    while (!Tok.is(tok::r_paren)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowExpList);
 }
 
-bool Parser::parseExpression(Expr *&E) {
+// Precedence climbing: the operand is parsed first, then each operator
+// binding at least as tightly as MinPrecedence with its right operand,
+// which only takes operators binding more tightly. The Sema hooks are
+// called in the same order as by a descent through the levels.
+bool Parser::parseExpression(Expr *&E, unsigned MinPrecedence) {
     {
-        if (parseSimpleExpression(E))
-            goto _error;
-        if (Tok.isOneOf(tok::hash,
-                        tok::less,
-                        tok::lessequal,
-                        tok::equal,
-                        tok::greater,
-                        tok::greaterequal)) {
-            OperatorInfo Op;
-            Expr *Right = nullptr;
-            if (parseRelation(Op))
-                goto _error;
-            if (parseSimpleExpression(Right))
-                goto _error;
-            E = Actions.actOnExpression(E, Right, Op);
-        }
-        return false;
-    }
-    _error:
-    while (!Tok.isOneOf(
-            tok::r_paren,
-            tok::comma, tok::semi, tok::kw_DO, tok::kw_ELSE, tok::kw_END,
-            tok::kw_THEN)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
-}
-
-bool Parser::parseRelation(OperatorInfo &Op) {
-    {
-        if (Tok.is(tok::equal)) {
-            Op = fromTok(Tok);
-            advance();
-        } else if (Tok.is(tok::hash)) {
-            Op = fromTok(Tok);
-            advance();
-        } else if (Tok.is(tok::less)) {
-            Op = fromTok(Tok);
-            advance();
-        } else if (Tok.is(tok::lessequal)) {
-            Op = fromTok(Tok);
+        // The sign of a simple expression applies to all of its terms.
+        OperatorInfo Sign;
+        if (MinPrecedence <= prec::Additive && Tok.isOneOf(tok::plus, tok::minus)) {
+            Sign = fromTok(Tok);
             advance();
-        } else if (Tok.is(tok::greater)) {
-            Op = fromTok(Tok);
-            advance();
-        } else if (Tok.is(tok::greaterequal)) {
-            Op = fromTok(Tok);
-            advance();
-        } else
-            goto _error;
-        return false;
-    }
-    _error:
-    while (!Tok.isOneOf(
-            tok::l_paren,
-            tok::plus, tok::minus, tok::kw_NOT, tok::identifier, tok::integer_literal)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
-}
-
-bool Parser::parseSimpleExpression(Expr *&E) {
-    {
-        OperatorInfo PrefixOp;
-        if (Tok.isOneOf(tok::plus, tok::minus)) {
-            if (Tok.is(tok::plus)) {
-                PrefixOp = fromTok(Tok);
-                advance();
-            } else if (Tok.is(tok::minus)) {
-                PrefixOp = fromTok(Tok);
-                advance();
-            }
-        }
-        if (parseTerm(E))
-            goto _error;
-        while (Tok.isOneOf(tok::plus, tok::minus, tok::kw_OR)) {
-            OperatorInfo Op;
-            Expr *Right = nullptr;
-            if (parseAddOperator(Op)) {
-                goto _error;
-            }
-            if (parseTerm(Right))
-                goto _error;
-            E = Actions.actOnSimpleExpression(E, Right, Op);
-        }
-        if (!PrefixOp.isUnspecified()) {
-            E = Actions.actOnPrefixExpression(E, PrefixOp);
         }
-        return false;
-    }
-    _error:
-    while (!Tok.isOneOf(
-            tok::hash, tok::r_paren, tok::comma, tok::semi, tok::lessequal, tok::less,
-            tok::equal, tok::greater, tok::greaterequal,
-            tok::kw_DO, tok::kw_ELSE, tok::kw_END, tok::kw_THEN)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
-}
-
-bool Parser::parseAddOperator(OperatorInfo &Op) {
-    {
-        if (Tok.is(tok::plus)) {
-            Op = fromTok(Tok);
-            advance();
-        } else if (Tok.is(tok::minus)) {
-            Op = fromTok(Tok);
-            advance();
-        } else if (Tok.is(tok::kw_OR)) {
-            Op = fromTok(Tok);
-            advance();
-        } else {
-            goto _error;
-        }
-        return false;
-    }
-    _error:
-    while (!Tok.isOneOf(tok::l_paren,
-                        tok::kw_NOT,
-                        tok::identifier,
-                        tok::integer_literal)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
-}
-
-bool Parser::parseTerm(Expr *&E) {
-    {
         if (parseFactor(E))
             goto _error;
-        while (Tok.isOneOf(tok::star,
-                           tok::slash, tok::kw_AND, tok::kw_DIV, tok::kw_MOD)) {
-            OperatorInfo Op;
+        for (;;) {
+            unsigned Precedence = BinaryPrecedence[Tok.getKind()];
+            // Unknown is below every minimum.
+            if (Precedence < MinPrecedence)
+                break;
+            if (Precedence == prec::Relational && !Sign.isUnspecified()) {
+                E = Actions.actOnPrefixExpression(E, Sign);
+                Sign = OperatorInfo();
+            }
+            OperatorInfo Op = fromTok(Tok);
             Expr *Right = nullptr;
-            if (parseMulOperator(Op))
-                goto _error;
-            if (parseFactor(Right))
-                goto _error;
-            E = Actions.actOnTerm(E, Right, Op);
-
-        }
-        return false;
-    }
-    _error:
-    while (!Tok.isOneOf(
-            tok::hash, tok::r_paren, tok::plus, tok::minus,
-            tok::comma, tok::semi, tok::lessequal, tok::less,
-            tok::equal, tok::greater, tok::greaterequal,
-            tok::kw_OR, tok::kw_DO, tok::kw_ELSE, tok::kw_END, tok::kw_THEN)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
-}
-
-bool Parser::parseMulOperator(OperatorInfo &Op) {
-    {
-        if (Tok.is(tok::star)) {
-            Op = fromTok(Tok);
-            advance();
-        } else if (Tok.is(tok::slash)) {
-            Op = fromTok(Tok);
-            advance();
-        } else if (Tok.is(tok::kw_DIV)) {
-            Op = fromTok(Tok);
             advance();
-        } else if (Tok.is(tok::kw_MOD)) {
-            Op = fromTok(Tok);
-            advance();
-        } else if (Tok.is(tok::kw_AND)) {
-            Op = fromTok(Tok);
-            advance();
-        } else {
-            goto _error;
+            if (parseExpression(Right, Precedence + 1))
+                goto _error;
+            if (Precedence == prec::Multiplicative) {
+                E = Actions.actOnTerm(E, Right, Op);
+            } else if (Precedence == prec::Additive) {
+                E = Actions.actOnSimpleExpression(E, Right, Op);
+            } else {
+                E = Actions.actOnExpression(E, Right, Op);
+                // Relations do not associate.
+                break;
+            }
         }
+        if (!Sign.isUnspecified())
+            E = Actions.actOnPrefixExpression(E, Sign);
         return false;
     }
     _error:
-    while (!Tok.isOneOf(tok::l_paren,
-                        tok::kw_NOT,
-                        tok::identifier,
-                        tok::integer_literal)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowExpression);
 }
 
 bool Parser::parseFactor(Expr *&E) {
     {
         if (Tok.is(tok::integer_literal)) {
-            E = Actions.actOnIntegerLiteral(Tok.getLocation(), Tok.getLiteralData());
+            E = Actions.actOnIntegerLiteral(Tok.getLocation(), Tok.getLiteralData(),
+                                            Tok.getIntegerValue());
             advance();
         } else if (Tok.is(tok::identifier)) {
+            SMLoc Loc = Tok.getLocation();
             Decl *D;
             ExprList Exprs;
             if (parseQualident(D))
                 goto _error;
             if (Tok.is(tok::l_paren)) {
                 advance();
-                if (Tok.isOneOf(tok::l_paren, tok::plus, tok::minus,
-                                tok::kw_NOT, tok::identifier,
-                                tok::integer_literal)) {
+                if (Tok.isOneOf(FirstExpression)) {
                     if (parseExpList(Exprs))
                         goto _error;
 
@@ -740,13 +566,10 @@ bool Parser::parseFactor(Expr *&E) {
                     goto _error;
                 E = Actions.actOnFunctionCall(D, Exprs);
                 advance();
-            } else if (Tok.isOneOf(
-                    tok::hash, tok::r_paren, tok::plus, tok::minus, tok::star, tok::slash,
-                    tok::comma, tok::semi, tok::lessequal, tok::less,
-                    tok::equal, tok::greater, tok::greaterequal,
-                    tok::kw_OR, tok::kw_DO, tok::kw_ELSE, tok::kw_END, tok::kw_THEN,
-                    tok::kw_AND, tok::kw_DIV, tok::kw_MOD)) {
-                E = Actions.actOnVariable(D);
+            } else {
+                // A token that cannot follow a factor is reported by the
+                // caller.
+                E = Actions.actOnVariable(Loc, D);
             }
         } else if (Tok.is(tok::l_paren)) {
             advance();
@@ -761,22 +584,13 @@ bool Parser::parseFactor(Expr *&E) {
                 goto _error;
             E = Actions.actOnPrefixExpression(E, Op);
         } else {
+            reportExpected("expression");
             goto _error;
         }
         return false;
     }
     _error:
-    while (!Tok.isOneOf(
-            tok::hash, tok::r_paren, tok::plus, tok::minus, tok::star, tok::slash,
-            tok::comma, tok::semi, tok::lessequal, tok::less,
-            tok::equal, tok::greater, tok::greaterequal,
-            tok::kw_OR, tok::kw_DO, tok::kw_ELSE, tok::kw_END, tok::kw_THEN,
-            tok::kw_AND, tok::kw_DIV, tok::kw_MOD)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowFactor);
 }
 
 bool Parser::parseQualident(Decl *&D) {
@@ -785,57 +599,39 @@ bool Parser::parseQualident(Decl *&D) {
         if (expect(tok::identifier))
             goto _error;
 
-        D = Actions.actOnQualIdentPart(D, Tok.getLocation(), Tok.getIdentifier());
+        D = Actions.actOnQualIdentPart(D, toIdent(Tok));
         advance();
         while (Tok.is(tok::period) &&
-               (isa<ModuleDeclaration>(D))) {
+               llvm::isa_and_nonnull<ModuleDeclaration>(D)) {
             advance();
             if (expect(tok::identifier))
                 goto _error;
 
-            D = Actions.actOnQualIdentPart(D, Tok.getLocation(), Tok.getIdentifier());
+            D = Actions.actOnQualIdentPart(D, toIdent(Tok));
             advance();
         }
         return false;
     }
     _error:
-    while (!Tok.isOneOf(
-            tok::hash, tok::r_paren,
-            tok::l_paren, tok::colonequal,
-            tok::plus, tok::minus, tok::star, tok::slash,
-            tok::comma, tok::semi, tok::lessequal, tok::less,
-            tok::equal, tok::greater, tok::greaterequal,
-            tok::kw_OR, tok::kw_DO, tok::kw_ELSE, tok::kw_END, tok::kw_THEN,
-            tok::kw_AND, tok::kw_DIV, tok::kw_MOD)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowQualident);
 }
 
 bool Parser::parseIdentList(IdentList &Ids) {
     {
         if (expect(tok::identifier))
             goto _error;
-        Ids.push_back(std::pair<SMLoc, StringRef>(Tok.getLocation(), Tok.getIdentifier()));
+        Ids.push_back(toIdent(Tok));
         advance();
         while (Tok.is(tok::comma)) {
             advance();
             if (expect(tok::identifier))
                 goto _error;
-            Ids.push_back(std::pair<SMLoc, StringRef>(Tok.getLocation(), Tok.getIdentifier()));
+            Ids.push_back(toIdent(Tok));
             advance();
         }
         return false;
     }
     _error:
-    while (!Tok.isOneOf(
-            tok::colon, tok::semi)) {
-        advance();
-        if (Tok.is(tok::eof))
-            return true;
-    }
-    return false;
+    return skipUntil(FollowIdentList);
 }
 
@@ -7,19 +7,27 @@
 
 using namespace tinylang;
 
-
-bool Scope::insert(Decl *Declaration) {
-    return Symbols.insert(std::pair<StringRef, Decl *>(Declaration->getName(), Declaration)).second;
-}
-
-Decl *Scope::lookup(StringRef Name) {
-    Scope *S = this;
-    while (S) {
-        StringMap<Decl *>::const_iterator I = S->Symbols.find(Name);
-        if (I != S->Symbols.end())
-            return I->second;
-        S = S->getParent();
+void Scope::leave() {
+    assert(!Markers.empty() && "Can't leave non-existing scope");
+    unsigned Marker = Markers.back();
+    Markers.pop_back();
+    while (Shadowed.size() > Marker) {
+        const SavedBinding &S = Shadowed.back();
+        Bindings[S.NameID] = S.Previous;
+        Shadowed.pop_back();
     }
-    return nullptr;
 }
 
+bool Scope::insert(Decl *Declaration) {
+    assert(!Markers.empty() && "No scope to insert into");
+    unsigned NameID = Declaration->getNameID();
+    if (NameID >= Bindings.size())
+        Bindings.resize(NameID + 1);
+    Binding &B = Bindings[NameID];
+    if (B.D && B.Depth == getDepth())
+        return false;
+    Shadowed.push_back({NameID, B});
+    B.D = Declaration;
+    B.Depth = getDepth();
+    return true;
+}
@@ -3,20 +3,21 @@
 //
 
 #include "tinylang/Sema/Sema.h"
+#include "tinylang/Basic/TimeReport.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 
 using namespace tinylang;
 
 void Sema::enterScope(Decl *D) {
-    CurrentScope = new Scope(CurrentScope);
+    SubPhaseScope Timer("Sema");
+    Scopes.enter();
     CurrentDecl = D;
 }
 
 void Sema::leaveScope() {
-    assert(CurrentScope && "Can't leave non-existing scope");
-    Scope *Parent = CurrentScope->getParent();
-    delete CurrentScope;
-    CurrentScope = Parent;
+    SubPhaseScope Timer("Sema");
+    Scopes.leave();
     CurrentDecl = CurrentDecl->getEnclosingDecl();
 }
 
@@ -40,8 +41,8 @@ bool Sema::isOperatorForType(tok::TokenKind Op, TypeDeclaration *Ty) {
 }
 
 void Sema::checkFormalAndActualParameters(SMLoc Loc,
-                                          const FormalParamList &Formals,
-                                          const ExprList &Actuals) {
+                                          ArrayRef<FormalParameterDeclaration *> Formals,
+                                          ArrayRef<Expr *> Actuals) {
     if (Formals.size() != Actuals.size()) {
         Diags.report(Loc, diag::err_wrong_number_of_parameters);
         return;
@@ -55,109 +56,115 @@ void Sema::checkFormalAndActualParameters(SMLoc Loc,
             Diags.report(
                     Loc,
                     diag::err_type_of_formal_and_actual_parameter_not_compatible);
-        if (F->isVar() && isa<VariableAccess>(Arg))
+        if (F->isVar() && !isa<VariableAccess>(Arg))
             Diags.report(Loc,
                          diag::err_var_parameter_requires_var);
     }
 }
 
 void Sema::initialize() {
-    CurrentScope = new Scope;
+    // The builtin declarations live in the outermost scope.
+    Scopes.enter();
     CurrentDecl = nullptr;
-    IntegerType = new TypeDeclaration(CurrentDecl, SMLoc(), "INTEGER");
-    BooleanType = new TypeDeclaration(CurrentDecl, SMLoc(), "BOOLEAN");
-    TrueLiteral = new BooleanLiteral(true, BooleanType);
-    FalseLiteral = new BooleanLiteral(false, BooleanType);
-
-    TrueConst = new ConstantDeclaration(CurrentDecl, SMLoc(), "TRUE", TrueLiteral);
-    FalseConst = new ConstantDeclaration(CurrentDecl, SMLoc(), "FALSE", FalseLiteral);
-
-    CurrentScope->insert(IntegerType);
-    CurrentScope->insert(BooleanType);
-    CurrentScope->insert(TrueConst);
-    CurrentScope->insert(FalseConst);
+    auto builtin = [this](StringRef Name) {
+        return Ident(SMLoc(), Name, Idents.get(Name));
+    };
+    IntegerType = Context.create<TypeDeclaration>(CurrentDecl, builtin("INTEGER"));
+    BooleanType = Context.create<TypeDeclaration>(CurrentDecl, builtin("BOOLEAN"));
+    TrueLiteral = Context.create<BooleanLiteral>(true, BooleanType);
+    FalseLiteral = Context.create<BooleanLiteral>(false, BooleanType);
+
+    TrueConst = Context.create<ConstantDeclaration>(CurrentDecl, builtin("TRUE"), TrueLiteral);
+    FalseConst = Context.create<ConstantDeclaration>(CurrentDecl, builtin("FALSE"), FalseLiteral);
+
+    Scopes.insert(IntegerType);
+    Scopes.insert(BooleanType);
+    Scopes.insert(TrueConst);
+    Scopes.insert(FalseConst);
 }
 
-ModuleDeclaration *Sema::actOnModuleDeclaration(SMLoc Loc, StringRef Name) {
-    return new ModuleDeclaration(CurrentDecl, Loc, Name);
+ModuleDeclaration *Sema::actOnModuleDeclaration(const Ident &Name) {
+    SubPhaseScope Timer("Sema");
+    return Context.create<ModuleDeclaration>(CurrentDecl, Name);
 }
 
-void Sema::actOnModuleDeclaration(ModuleDeclaration *ModDecl, SMLoc Loc, StringRef Name,
+void Sema::actOnModuleDeclaration(ModuleDeclaration *ModDecl, const Ident &Name,
                                   DeclList &Decls, StmtList &Stmts) {
-    if (Name != ModDecl->getName()) {
-        Diags.report(Loc,
+    SubPhaseScope Timer("Sema");
+    if (Name.getID() != ModDecl->getNameID()) {
+        Diags.report(Name.getLocation(),
                      diag::err_module_identifier_not_equal);
         Diags.report(ModDecl->getLocation(),
                      diag::note_module_identifier_declaration);
     }
-    ModDecl->setDecls(Decls);
-    ModDecl->setStmts(Stmts);
+    ModDecl->setDecls(Context.copyArray<Decl *>(Decls));
+    ModDecl->setStmts(Context.copyArray<Stmt *>(Stmts));
+    ModDecl->buildExportIndex(Context);
 }
 
 void Sema::actOnImport(StringRef ModuleName, IdentList &Ids) {
+    SubPhaseScope Timer("Sema");
     Diags.report(SMLoc(), diag::err_not_yet_implemented);
 }
 
-void Sema::actOnConstantDeclaration(DeclList &Decls, SMLoc Loc, StringRef Name, Expr *E) {
-    assert(CurrentScope && "CurrentScope not set");
-    auto *Decl = new ConstantDeclaration(CurrentDecl,
-                                         Loc, Name, E);
-    if (CurrentScope->insert(Decl)) {
+void Sema::actOnConstantDeclaration(DeclList &Decls, const Ident &Name, Expr *E) {
+    SubPhaseScope Timer("Sema");
+    auto *Decl = Context.create<ConstantDeclaration>(CurrentDecl,
+                                         Name, E);
+    if (Scopes.insert(Decl)) {
         Decls.push_back(Decl);
     } else
-        Diags.report(Loc, diag::err_symbold_declared, Name);
+        Diags.report(Name.getLocation(), diag::err_symbold_declared, Name.getName());
 }
 
 void Sema::actOnVariableDeclaration(DeclList &Decls, IdentList &Ids, Decl *D) {
-    assert(CurrentScope && "CurrentScope not set");
-    if (auto *Ty = dyn_cast<TypeDeclaration>(D)) {
+    SubPhaseScope Timer("Sema");
+    if (auto *Ty = dyn_cast_or_null<TypeDeclaration>(D)) {
         for (auto I = Ids.begin(), E = Ids.end(); I != E; ++I) {
 
-            SMLoc Loc = I->first;
-            StringRef Name = I->second;
-            auto *Decl = new VariableDeclaration(CurrentDecl, Loc, Name, Ty);
-            if (CurrentScope->insert(Decl)) {
+            auto *Decl = Context.create<VariableDeclaration>(CurrentDecl, *I, Ty);
+            if (Scopes.insert(Decl)) {
                 Decls.push_back(Decl);
             } else
-                Diags.report(Loc, diag::err_symbold_declared, Name);
+                Diags.report(I->getLocation(), diag::err_symbold_declared, I->getName());
         }
-    } else if (!Ids.empty()) {
-        SMLoc Loc = Ids.front().first;
+    } else if (D && !Ids.empty()) {
+        SMLoc Loc = Ids.front().getLocation();
         Diags.report(Loc, diag::err_vardecl_requires_type);
     }
 }
 
 void Sema::actOnFormalParameterDeclaration(FormalParamList &Params, IdentList &IDs, Decl *D, bool IsVar) {
-    assert(CurrentScope && "CurrentScope not set");
-    if (auto *Ty = dyn_cast<TypeDeclaration>(D)) {
+    SubPhaseScope Timer("Sema");
+    if (auto *Ty = dyn_cast_or_null<TypeDeclaration>(D)) {
         for (auto I = IDs.begin(), E = IDs.end(); I != E; ++I) {
 
-            SMLoc Loc = I->first;
-            StringRef Name = I->second;
-            auto *Decl = new FormalParameterDeclaration(CurrentDecl, Loc, Name, Ty, IsVar);
+            auto *Decl = Context.create<FormalParameterDeclaration>(CurrentDecl, *I, Ty, IsVar);
 
-            if (CurrentScope->insert(Decl)) {
+            if (Scopes.insert(Decl)) {
                 Params.push_back(Decl);
             } else
-                Diags.report(Loc, diag::err_symbold_declared, Name);
+                Diags.report(I->getLocation(), diag::err_symbold_declared, I->getName());
         }
-    } else if (!IDs.empty()) {
-        SMLoc Loc = IDs.front().first;
+    } else if (D && !IDs.empty()) {
+        SMLoc Loc = IDs.front().getLocation();
         Diags.report(Loc, diag::err_vardecl_requires_type);
     }
 }
 
-ProcedureDeclaration *Sema::actOnProcedureDeclaration(SMLoc Loc, StringRef Name) {
-    auto *P = new ProcedureDeclaration(CurrentDecl, Loc, Name);
-    if (!CurrentScope->insert(P)) {
-        Diags.report(Loc, diag::err_symbold_declared, Name);
+ProcedureDeclaration *Sema::actOnProcedureDeclaration(const Ident &Name) {
+    SubPhaseScope Timer("Sema");
+    auto *P = Context.create<ProcedureDeclaration>(CurrentDecl, Name);
+    if (!Scopes.insert(P)) {
+        Diags.report(Name.getLocation(), diag::err_symbold_declared, Name.getName());
     }
     return P;
 }
 
 void Sema::actOnProcedureHeading(ProcedureDeclaration *ProcDecl,
                                  FormalParamList &Params, Decl *RetType) {
-    ProcDecl->setFormalParams(Params);
+    SubPhaseScope Timer("Sema");
+    ProcDecl->setFormalParams(Context.copyArray<FormalParameterDeclaration *>(Params));
     auto RetTypeDecl = dyn_cast_or_null<TypeDeclaration>(RetType);
     if (!RetTypeDecl && RetType)
         Diags.report(RetType->getLocation(),
@@ -167,40 +174,50 @@ void Sema::actOnProcedureHeading(ProcedureDeclaration *ProcDecl,
 }
 
 void Sema::actOnProcedureDeclaration(ProcedureDeclaration *ProcDecl,
-                                     SMLoc Loc, StringRef Name, DeclList &Decls,
+                                     const Ident &Name, DeclList &Decls,
                                      StmtList &Stmts) {
-    if (Name != ProcDecl->getName()) {
-        Diags.report(Loc, diag::err_proc_identifier_not_equal);
+    SubPhaseScope Timer("Sema");
+    if (Name.getID() != ProcDecl->getNameID()) {
+        Diags.report(Name.getLocation(), diag::err_proc_identifier_not_equal);
         Diags.report(ProcDecl->getLocation(),
                      diag::note_proc_identifier_declaration);
     }
-    ProcDecl->setDecls(Decls);
-    ProcDecl->setStmts(Stmts);
+    ProcDecl->setDecls(Context.copyArray<Decl *>(Decls));
+    ProcDecl->setStmts(Context.copyArray<Stmt *>(Stmts));
 }
 
 void Sema::actOnAssignment(StmtList &Stmts, SMLoc Loc, Decl *D, Expr *E) {
-    if (auto Var = dyn_cast<VariableDeclaration>(D)) {
-        if (Var->getType() != E->getType()) {
-            Diags.report(
-                    Loc, diag::err_types_for_operator_not_compatible,
-                    tok::getPunctuatorSpelling(tok::colonequal));
-        }
-        Stmts.push_back(new AssignmentStatement(Var, E));
-    } else if (D) {
-        // TODO Emit error
+    SubPhaseScope Timer("Sema");
+    TypeDeclaration *Ty;
+    if (auto *Var = dyn_cast_or_null<VariableDeclaration>(D))
+        Ty = Var->getType();
+    else if (auto *Param = dyn_cast_or_null<FormalParameterDeclaration>(D))
+        Ty = Param->getType();
+    else {
+        if (D)
+            Diags.report(Loc, diag::err_assignment_requires_variable);
+        return;
+    }
+    if (E && Ty != E->getType()) {
+        Diags.report(
+                Loc, diag::err_types_for_operator_not_compatible,
+                tok::getPunctuatorSpelling(tok::colonequal));
     }
+    Stmts.push_back(Context.create<AssignmentStatement>(D, E));
 }
 
 void Sema::actOnProcCall(StmtList &Stmts, SMLoc Loc,
                          Decl *D, ExprList &Params) {
+    SubPhaseScope Timer("Sema");
 
-    if (auto Proc = dyn_cast<ProcedureDeclaration>(D)) {
+    if (auto Proc = dyn_cast_or_null<ProcedureDeclaration>(D)) {
 
         checkFormalAndActualParameters(Loc, Proc->getFormalParams(), Params);
         if (Proc->getRetType())
             Diags.report(Loc, diag::err_procedure_call_on_nonprocedure);
 
-        Stmts.push_back(new ProcedureCallStatement(Proc, Params));
+        Stmts.push_back(Context.create<ProcedureCallStatement>(
+                Proc, Context.copyArray<Expr *>(Params)));
     } else if (D) {
         Diags.report(Loc, diag::err_procedure_call_on_nonprocedure);
     }
@@ -208,6 +225,7 @@ void Sema::actOnProcCall(StmtList &Stmts, SMLoc Loc,
 
 void Sema::actOnIfStatement(StmtList &Stmts, SMLoc Loc, Expr *Cond,
                             StmtList &IfStmts, StmtList &ElseStmts) {
+    SubPhaseScope Timer("Sema");
     if (!Cond)
         Cond = FalseLiteral;
 
@@ -215,37 +233,45 @@ void Sema::actOnIfStatement(StmtList &Stmts, SMLoc Loc, Expr *Cond,
         Diags.report(Loc, diag::err_if_expr_must_be_bool);
     }
     Stmts.push_back(
-            new IfStatement(Cond, IfStmts, ElseStmts)
+            Context.create<IfStatement>(Cond,
+                                        Context.copyArray<Stmt *>(IfStmts),
+                                        Context.copyArray<Stmt *>(ElseStmts))
     );
 }
 
 void Sema::actOnWhileStatement(StmtList &Stmts, SMLoc Loc,
                                Expr *Cond, StmtList &WhileStmts) {
+    SubPhaseScope Timer("Sema");
     if (!Cond)
         Cond = FalseLiteral;
     if (Cond->getType() != BooleanType) {
         Diags.report(Loc, diag::err_while_expr_must_be_bool);
     }
     Stmts.push_back(
-            new WhileStatement(Cond, WhileStmts)
+            Context.create<WhileStatement>(Cond,
+                                           Context.copyArray<Stmt *>(WhileStmts))
     );
 
 }
 
 void Sema::actOnReturnStatement(StmtList &Stmts, SMLoc Loc, Expr *RetVal) {
-    auto *Proc = cast<ProcedureDeclaration>(CurrentDecl);
-    if (Proc->getRetType() && !RetVal) {
+    SubPhaseScope Timer("Sema");
+    // A RETURN in the module body behaves like one in a proper procedure.
+    auto *Proc = dyn_cast<ProcedureDeclaration>(CurrentDecl);
+    TypeDeclaration *RetType = Proc ? Proc->getRetType() : nullptr;
+    if (RetType && !RetVal) {
         Diags.report(Loc, diag::err_function_requires_return);
-    } else if (!Proc->getRetType() && RetVal) {
+    } else if (!RetType && RetVal) {
         Diags.report(Loc, diag::err_procedure_requires_empty_return);
-    } else if (Proc->getRetType() && RetVal) {
-        if (Proc->getRetType() != RetVal->getType())
+    } else if (RetType && RetVal) {
+        if (RetType != RetVal->getType())
             Diags.report(Loc, diag::err_function_and_return_type);
     }
-    Stmts.push_back(new ReturnStatement(RetVal));
+    Stmts.push_back(Context.create<ReturnStatement>(RetVal));
 }
 
 Expr *Sema::actOnExpression(Expr *Left, Expr *Right, const OperatorInfo &Op) {
+    SubPhaseScope Timer("Sema");
     if (!Left)
         return Right;
     if (!Right)
@@ -255,34 +281,37 @@ Expr *Sema::actOnExpression(Expr *Left, Expr *Right, const OperatorInfo &Op) {
         Diags.report(Op.getLocation(),
                      diag::err_types_for_operator_not_compatible,
                      tok::getPunctuatorSpelling(Op.getKind()));
-        bool IsConst = Left->isConst() && Right->isConst();
-        return new InfixExpression(Left, Right, Op, BooleanType, IsConst);
     }
+    bool IsConst = Left->isConst() && Right->isConst();
+    return Context.create<InfixExpression>(Left, Right, Op, BooleanType, IsConst);
 }
 
 Expr *Sema::actOnSimpleExpression(Expr *Left, Expr *Right, const OperatorInfo &Op) {
+    SubPhaseScope Timer("Sema");
     if (!Left)
         return Right;
     if (!Right)
         return Left;
 
-    if (Left->getType() != Right->getType()) {
+    if (Left->getType() != Right->getType() || !isOperatorForType(Op.getKind(), Left->getType())) {
         Diags.report(Op.getLocation(),
                      diag::err_types_for_operator_not_compatible,
                      tok::getPunctuatorSpelling(Op.getKind()));
-        TypeDeclaration *Ty = Left->getType();
-        bool IsConst = Left->isConst() && Right->isConst();
+    }
+    TypeDeclaration *Ty = Left->getType();
+    bool IsConst = Left->isConst() && Right->isConst();
 
-        if (IsConst && Op.getKind() == tok::kw_OR) {
-            auto *L = dyn_cast<BooleanLiteral>(Left);
-            auto *R = dyn_cast<BooleanLiteral>(Right);
+    if (IsConst && Op.getKind() == tok::kw_OR) {
+        auto *L = dyn_cast<BooleanLiteral>(Left);
+        auto *R = dyn_cast<BooleanLiteral>(Right);
+        if (L && R)
             return L->getValue() || R->getValue() ? TrueLiteral : FalseLiteral;
-        }
-        return new InfixExpression(Left, Right, Op, BooleanType, IsConst);
     }
+    return Context.create<InfixExpression>(Left, Right, Op, Ty, IsConst);
 }
 
 Expr *Sema::actOnTerm(Expr *Left, Expr *Right, const OperatorInfo &Op) {
+    SubPhaseScope Timer("Sema");
     if (!Left)
         return Right;
     if (!Right)
@@ -292,21 +321,21 @@ Expr *Sema::actOnTerm(Expr *Left, Expr *Right, const OperatorInfo &Op) {
         Diags.report(Op.getLocation(),
                      diag::err_types_for_operator_not_compatible,
                      tok::getPunctuatorSpelling(Op.getKind()));
-
-        TypeDeclaration *Ty = Left->getType();
-        bool IsConst = Left->isConst() && Right->isConst();
-
-
-        if (IsConst && Op.getKind() == tok::kw_AND) {
-            auto *L = dyn_cast<BooleanLiteral>(Left);
-            auto *R = dyn_cast<BooleanLiteral>(Right);
-            return L->getValue() || R->getValue() ? TrueLiteral : FalseLiteral;
-        }
-        return new InfixExpression(Left, Right, Op, BooleanType, IsConst);
     }
+    TypeDeclaration *Ty = Left->getType();
+    bool IsConst = Left->isConst() && Right->isConst();
+
+    if (IsConst && Op.getKind() == tok::kw_AND) {
+        auto *L = dyn_cast<BooleanLiteral>(Left);
+        auto *R = dyn_cast<BooleanLiteral>(Right);
+        if (L && R)
+            return L->getValue() && R->getValue() ? TrueLiteral : FalseLiteral;
+    }
+    return Context.create<InfixExpression>(Left, Right, Op, Ty, IsConst);
 }
 
 Expr *Sema::actOnPrefixExpression(Expr *E, const OperatorInfo &Op) {
+    SubPhaseScope Timer("Sema");
     if (!E)
         return nullptr;
     if (!isOperatorForType(Op.getKind(), E->getType())) {
@@ -315,8 +344,8 @@ Expr *Sema::actOnPrefixExpression(Expr *E, const OperatorInfo &Op) {
                      tok::getPunctuatorSpelling(Op.getKind()));
     }
     if (E->isConst() && Op.getKind() == tok::kw_NOT) {
-        auto *L = dyn_cast<BooleanLiteral>(E);
-        return L->getValue() ? FalseLiteral : TrueLiteral;
+        if (auto *L = dyn_cast<BooleanLiteral>(E))
+            return L->getValue() ? FalseLiteral : TrueLiteral;
     }
     if (Op.getKind() == tok::minus) {
         bool Ambiguous{true};
@@ -332,37 +361,46 @@ Expr *Sema::actOnPrefixExpression(Expr *E, const OperatorInfo &Op) {
                          diag::warn_ambigous_negation);
         }
     }
-    return new PrefixExpression(E, Op, E->getType(), E->isConst());
+    return Context.create<PrefixExpression>(E, Op, E->getType(), E->isConst());
 }
 
-Expr *Sema::actOnIntegerLiteral(SMLoc Loc, StringRef Literal) {
+Expr *Sema::actOnIntegerLiteral(SMLoc Loc, StringRef Literal, int64_t Value) {
+    SubPhaseScope Timer("Sema");
+    if (Value >= 0)
+        return Context.create<IntegerLiteral>(Loc, Value, IntegerType);
     uint8_t Radix{10};
     if (Literal.endswith("H")) {
         Literal = Literal.drop_back();
         Radix = 16;
     }
-    llvm::APInt Value(64, Literal, Radix);
-    return new IntegerLiteral(Loc, llvm::APSInt(Value, false), IntegerType);
+    // Signed and at least 64 bits wide, like the values of small literals.
+    // getBitsNeeded does not count a sign bit.
+    unsigned NumBits = std::max(64u, llvm::APInt::getBitsNeeded(Literal, Radix) + 1);
+    llvm::APInt LargeValue(NumBits, Literal, Radix);
+    return Context.create<IntegerLiteral>(Loc, Context.create<llvm::APSInt>(LargeValue, false), IntegerType);
 }
 
-Expr *Sema::actOnVariable(Decl *D) {
+Expr *Sema::actOnVariable(SMLoc Loc, Decl *D) {
+    SubPhaseScope Timer("Sema");
     if (!D)
         return nullptr;
     if (auto *V = dyn_cast<VariableDeclaration>(D))
-        return new VariableAccess(V);
+        return Context.create<VariableAccess>(V);
     else if (auto *P = dyn_cast<FormalParameterDeclaration>(D))
-        return new VariableAccess(P);
+        return Context.create<VariableAccess>(P);
     else if (auto *C = dyn_cast<ConstantDeclaration>(D)) {
         if (C == TrueConst)
             return TrueLiteral;
         if (C == FalseConst)
             return FalseLiteral;
-        return new ConstantAccess(C);
+        return Context.create<ConstantAccess>(C);
     }
+    Diags.report(Loc, diag::err_expression_requires_value);
     return nullptr;
 }
 
 Expr *Sema::actOnFunctionCall(Decl *D, ExprList &Params) {
+    SubPhaseScope Timer("Sema");
     if (!D)
         return nullptr;
     if (auto *P = dyn_cast<ProcedureDeclaration>(D)) {
@@ -371,28 +409,33 @@ Expr *Sema::actOnFunctionCall(Decl *D, ExprList &Params) {
             Diags.report(D->getLocation(),
                          diag::err_function_call_on_nonfunction);
         }
-        return new FunctionCallExpr(P, Params);
+        return Context.create<FunctionCallExpr>(P, Context.copyArray<Expr *>(Params));
     }
     Diags.report(D->getLocation(),
                  diag::err_function_call_on_nonfunction);
     return nullptr;
 }
 
-Decl *Sema::actOnQualIdentPart(Decl *Prev, SMLoc Loc, StringRef Name) {
+Decl *Sema::actOnQualIdentPart(Decl *Prev, const Ident &Name) {
+    SubPhaseScope Timer("Sema");
     if (!Prev) {
-        if (Decl *D = CurrentScope->lookup(Name))
+        if (Decl *D = Scopes.lookup(Name.getID())) {
+            // There are no static links, so a nested procedure can only use
+            // its own locals and the module variables.
+            if ((isa<VariableDeclaration>(D) || isa<FormalParameterDeclaration>(D)) &&
+                isa<ProcedureDeclaration>(D->getEnclosingDecl()) &&
+                D->getEnclosingDecl() != CurrentDecl)
+                Diags.report(Name.getLocation(), diag::err_nested_access_not_supported,
+                             Name.getName());
             return D;
-    } else if (auto *Mod = dyn_cast<ModuleDeclaration>(Prev)) {
-        auto Decls = Mod->getDecls();
-        for (auto I = Decls.begin(), E = Decls.end(); I != E; ++I) {
-            if ((*I)->getName() == Name) {
-                return *I;
-            }
         }
+    } else if (auto *Mod = dyn_cast<ModuleDeclaration>(Prev)) {
+        if (Decl *D = Mod->lookupExport(Name.getID()))
+            return D;
     } else {
         llvm_unreachable("actOnQualIdentPart only callable with module delclarations");
     }
-    Diags.report(Loc, diag::err_undeclared_name, Name);
+    Diags.report(Name.getLocation(), diag::err_undeclared_name, Name.getName());
     return nullptr;
 }
 
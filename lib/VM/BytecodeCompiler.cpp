@@ -0,0 +1,621 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#include "tinylang/VM/BytecodeCompiler.h"
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/ErrorHandling.h"
+#include <limits>
+#include <unordered_map>
+
+using namespace tinylang;
+using namespace tinylang::vm;
+
+namespace {
+    // Evaluates a constant expression. A division by zero is not folded, it
+    // is left to the runtime.
+    bool evaluateConstant(Expr *E, int64_t &Val) {
+        assert(E && "Expression is nullptr, the module has errors");
+        if (auto *IntLit = llvm::dyn_cast<IntegerLiteral>(E)) {
+            Val = IntLit->isSmall() ? IntLit->getSmallValue()
+                                    : static_cast<int64_t>(IntLit->getValue().zextOrTrunc(64).getZExtValue());
+            return true;
+        }
+        if (auto *BoolLit = llvm::dyn_cast<BooleanLiteral>(E)) {
+            Val = BoolLit->getValue();
+            return true;
+        }
+        if (auto *Const = llvm::dyn_cast<ConstantAccess>(E))
+            return evaluateConstant(Const->getDecl()->getExpr(), Val);
+        if (auto *Prefix = llvm::dyn_cast<PrefixExpression>(E)) {
+            if (!evaluateConstant(Prefix->getExpr(), Val))
+                return false;
+            switch (Prefix->getOperatorInfo().getKind()) {
+                case tok::minus:
+                    Val = subWrap(0, Val);
+                    break;
+                case tok::kw_NOT:
+                    Val ^= 1;
+                    break;
+                default:
+                    break;
+            }
+            return true;
+        }
+        if (auto *Infix = llvm::dyn_cast<InfixExpression>(E)) {
+            int64_t L, R;
+            if (!evaluateConstant(Infix->getLeft(), L) || !evaluateConstant(Infix->getRight(), R))
+                return false;
+            switch (Infix->getOperatorInfo().getKind()) {
+                case tok::plus:
+                    Val = addWrap(L, R);
+                    return true;
+                case tok::minus:
+                    Val = subWrap(L, R);
+                    return true;
+                case tok::star:
+                    Val = mulWrap(L, R);
+                    return true;
+                case tok::slash:
+                case tok::kw_DIV:
+                    if (R == 0)
+                        return false;
+                    Val = divWrap(L, R);
+                    return true;
+                case tok::kw_MOD:
+                    if (R == 0)
+                        return false;
+                    Val = modWrap(L, R);
+                    return true;
+                case tok::kw_AND:
+                    Val = L & R;
+                    return true;
+                case tok::kw_OR:
+                    Val = L | R;
+                    return true;
+                case tok::equal:
+                    Val = L == R;
+                    return true;
+                case tok::hash:
+                    Val = L != R;
+                    return true;
+                case tok::less:
+                    Val = L < R;
+                    return true;
+                case tok::lessequal:
+                    Val = L <= R;
+                    return true;
+                case tok::greater:
+                    Val = L > R;
+                    return true;
+                case tok::greaterequal:
+                    Val = L >= R;
+                    return true;
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    bool hasCall(Expr *E) {
+        assert(E && "Expression is nullptr, the module has errors");
+        if (auto *Infix = llvm::dyn_cast<InfixExpression>(E))
+            return hasCall(Infix->getLeft()) || hasCall(Infix->getRight());
+        if (auto *Prefix = llvm::dyn_cast<PrefixExpression>(E))
+            return hasCall(Prefix->getExpr());
+        return llvm::isa<FunctionCallExpr>(E);
+    }
+
+    // The jump instructions which wait for the position of the label.
+    struct Label {
+        int Target{-1};
+        llvm::SmallVector<unsigned, 4> Uses;
+    };
+
+    class FunctionCompiler {
+        Program &P;
+        Function &Fn;
+
+        // Registers of the parameters and local variables.
+        llvm::DenseMap<Decl *, unsigned> Regs;
+        // Not a DenseMap, which reserves two int64_t keys for itself. Any
+        // value can be a constant.
+        std::unordered_map<int64_t, unsigned> ConstRegs;
+        unsigned NextTemp{0};
+
+        void addConstant(int64_t Val) {
+            if (ConstRegs.try_emplace(Val, Fn.ConstBase + Fn.Constants.size()).second)
+                Fn.Constants.push_back(Val);
+        }
+
+        void collectConstants(Expr *E);
+
+        void collectConstants(ArrayRef<Stmt *> Stmts);
+
+        unsigned allocTemp() {
+            unsigned Reg = NextTemp++;
+            if (NextTemp > Fn.NumRegs)
+                Fn.NumRegs = NextTemp;
+            return Reg;
+        }
+
+        unsigned getTarget(int Dest) { return Dest < 0 ? allocTemp() : Dest; }
+
+        void emit(Opcode Op, unsigned A, unsigned B, uint32_t C) {
+            if (A > std::numeric_limits<uint16_t>::max() || B > std::numeric_limits<uint16_t>::max())
+                llvm::report_fatal_error("Procedure needs too many registers");
+            Fn.Code.emplace_back(Op, A, B, C);
+        }
+
+        void emitJump(Opcode Op, unsigned A, unsigned B, Label &L);
+
+        void bind(Label &L);
+
+        unsigned moveTo(unsigned Reg, int Dest);
+
+        unsigned getGlobal(Decl *D);
+
+        unsigned getReg(Decl *D);
+
+        bool isVarParam(Decl *D) {
+            auto *FP = llvm::dyn_cast<FormalParameterDeclaration>(D);
+            return FP && FP->isVar();
+        }
+
+        unsigned compileExpr(Expr *E, int Dest = -1);
+
+        unsigned compileLogicalExpr(InfixExpression *E, int Dest);
+
+        void compileCondJump(Expr *E, bool JumpIfTrue, Label &L);
+
+        unsigned compileCall(ProcedureDeclaration *Callee, ArrayRef<Expr *> Args, int Dest);
+
+        void compileStmt(AssignmentStatement *Stmt);
+
+        void compileStmt(IfStatement *Stmt);
+
+        void compileStmt(WhileStatement *Stmt);
+
+        void compileStmt(ReturnStatement *Stmt);
+
+        void compile(ArrayRef<Stmt *> Stmts);
+
+    public:
+        FunctionCompiler(Program &P, Function &Fn) : P(P), Fn(Fn) {}
+
+        void run(ProcedureDeclaration *Proc);
+
+        void run(ModuleDeclaration *Mod);
+
+    private:
+        void run(ArrayRef<FormalParameterDeclaration *> Params, ArrayRef<Decl *> Decls,
+                 ArrayRef<Stmt *> Stmts, bool HasResult);
+    };
+}
+
+void FunctionCompiler::collectConstants(Expr *E) {
+    assert(E && "Expression is nullptr, the module has errors");
+    int64_t Val;
+    if (E->isConst() && evaluateConstant(E, Val))
+        addConstant(Val);
+    else if (auto *Infix = llvm::dyn_cast<InfixExpression>(E)) {
+        collectConstants(Infix->getLeft());
+        collectConstants(Infix->getRight());
+    } else if (auto *Prefix = llvm::dyn_cast<PrefixExpression>(E))
+        collectConstants(Prefix->getExpr());
+    else if (auto *Call = llvm::dyn_cast<FunctionCallExpr>(E)) {
+        for (Expr *Arg : Call->getParams())
+            collectConstants(Arg);
+    } else if (auto *Const = llvm::dyn_cast<ConstantAccess>(E))
+        collectConstants(Const->getDecl()->getExpr());
+}
+
+void FunctionCompiler::collectConstants(ArrayRef<Stmt *> Stmts) {
+    for (Stmt *S : Stmts) {
+        if (auto *Assign = llvm::dyn_cast<AssignmentStatement>(S))
+            collectConstants(Assign->getExpr());
+        else if (auto *Call = llvm::dyn_cast<ProcedureCallStatement>(S)) {
+            for (Expr *Arg : Call->getParams())
+                collectConstants(Arg);
+        } else if (auto *If = llvm::dyn_cast<IfStatement>(S)) {
+            collectConstants(If->getCond());
+            collectConstants(If->getIfStmts());
+            collectConstants(If->getElseStmts());
+        } else if (auto *While = llvm::dyn_cast<WhileStatement>(S)) {
+            collectConstants(While->getCond());
+            collectConstants(While->getWhileStmts());
+        } else if (auto *Return = llvm::dyn_cast<ReturnStatement>(S)) {
+            if (Return->getRetVal())
+                collectConstants(Return->getRetVal());
+        }
+    }
+}
+
+void FunctionCompiler::emitJump(Opcode Op, unsigned A, unsigned B, Label &L) {
+    unsigned Pos = Fn.Code.size();
+    if (L.Target >= 0)
+        emit(Op, A, B, static_cast<uint32_t>(L.Target - static_cast<int>(Pos)));
+    else {
+        emit(Op, A, B, 0);
+        L.Uses.push_back(Pos);
+    }
+}
+
+void FunctionCompiler::bind(Label &L) {
+    L.Target = Fn.Code.size();
+    for (unsigned Pos : L.Uses)
+        Fn.Code[Pos].C = static_cast<uint32_t>(L.Target - static_cast<int>(Pos));
+    L.Uses.clear();
+}
+
+unsigned FunctionCompiler::moveTo(unsigned Reg, int Dest) {
+    if (Dest < 0 || static_cast<unsigned>(Dest) == Reg)
+        return Reg;
+    emit(Move, Dest, Reg, 0);
+    return Dest;
+}
+
+unsigned FunctionCompiler::getGlobal(Decl *D) {
+    auto I = P.GlobalIndex.find(D);
+    return I == P.GlobalIndex.end() ? ~0U : I->second;
+}
+
+unsigned FunctionCompiler::getReg(Decl *D) {
+    auto I = Regs.find(D);
+    if (I == Regs.end())
+        llvm::report_fatal_error("Access to variables of enclosing procedures not yet supported");
+    return I->second;
+}
+
+unsigned FunctionCompiler::compileExpr(Expr *E, int Dest) {
+    assert(E && "Expression is nullptr, the module has errors");
+    int64_t Val;
+    if (E->isConst() && evaluateConstant(E, Val)) {
+        assert(ConstRegs.count(Val) && "Constant was not collected");
+        return moveTo(ConstRegs[Val], Dest);
+    }
+    if (auto *Var = llvm::dyn_cast<VariableAccess>(E)) {
+        Decl *D = Var->getDecl();
+        unsigned G = getGlobal(D);
+        if (G != ~0U) {
+            unsigned Reg = getTarget(Dest);
+            emit(LoadGlobal, Reg, 0, G);
+            return Reg;
+        }
+        if (isVarParam(D)) {
+            unsigned Reg = getTarget(Dest);
+            emit(LoadRef, Reg, getReg(D), 0);
+            return Reg;
+        }
+        return moveTo(getReg(D), Dest);
+    }
+    if (auto *Call = llvm::dyn_cast<FunctionCallExpr>(E))
+        return compileCall(Call->getDecl(), Call->getParams(), Dest);
+    if (auto *Const = llvm::dyn_cast<ConstantAccess>(E))
+        return compileExpr(Const->getDecl()->getExpr(), Dest);
+    if (auto *Prefix = llvm::dyn_cast<PrefixExpression>(E)) {
+        unsigned Val = compileExpr(Prefix->getExpr());
+        switch (Prefix->getOperatorInfo().getKind()) {
+            case tok::plus:
+                return moveTo(Val, Dest);
+            case tok::minus: {
+                unsigned Reg = getTarget(Dest);
+                emit(Neg, Reg, Val, 0);
+                return Reg;
+            }
+            case tok::kw_NOT: {
+                unsigned Reg = getTarget(Dest);
+                emit(Not, Reg, Val, 0);
+                return Reg;
+            }
+            default:
+                llvm_unreachable("Wrong operator");
+        }
+    }
+    if (auto *Infix = llvm::dyn_cast<InfixExpression>(E)) {
+        Opcode Op;
+        switch (Infix->getOperatorInfo().getKind()) {
+            case tok::kw_AND:
+            case tok::kw_OR:
+                return compileLogicalExpr(Infix, Dest);
+            case tok::plus:
+                Op = Add;
+                break;
+            case tok::minus:
+                Op = Sub;
+                break;
+            case tok::star:
+                Op = Mul;
+                break;
+            case tok::slash:
+            case tok::kw_DIV:
+                Op = Div;
+                break;
+            case tok::kw_MOD:
+                Op = Mod;
+                break;
+            case tok::equal:
+                Op = Eq;
+                break;
+            case tok::hash:
+                Op = Ne;
+                break;
+            case tok::less:
+                Op = Lt;
+                break;
+            case tok::lessequal:
+                Op = Le;
+                break;
+            case tok::greater:
+                Op = Gt;
+                break;
+            case tok::greaterequal:
+                Op = Ge;
+                break;
+            default:
+                llvm_unreachable("Wrong operator");
+        }
+        unsigned Left = compileExpr(Infix->getLeft());
+        // A call on the right may change the variable through a VAR
+        // parameter, so the left operand must be read before.
+        if (Left < Fn.ConstBase && hasCall(Infix->getRight())) {
+            unsigned Tmp = allocTemp();
+            emit(Move, Tmp, Left, 0);
+            Left = Tmp;
+        }
+        unsigned Right = compileExpr(Infix->getRight());
+        unsigned Reg = getTarget(Dest);
+        emit(Op, Reg, Left, Right);
+        return Reg;
+    }
+    llvm::report_fatal_error("Unsupported expression");
+}
+
+// The value of AND and OR is only materialized after the branches, so that
+// Dest may be one of the operands.
+unsigned FunctionCompiler::compileLogicalExpr(InfixExpression *E, int Dest) {
+    Label False, End;
+    compileCondJump(E, false, False);
+    unsigned Reg = getTarget(Dest);
+    emit(Move, Reg, ConstRegs[1], 0);
+    emitJump(Jump, 0, 0, End);
+    bind(False);
+    emit(Move, Reg, ConstRegs[0], 0);
+    bind(End);
+    return Reg;
+}
+
+// Comparisons in a condition become a single compare-and-branch, and AND
+// and OR turn into control flow.
+void FunctionCompiler::compileCondJump(Expr *E, bool JumpIfTrue, Label &L) {
+    assert(E && "Expression is nullptr, the module has errors");
+    int64_t Val;
+    if (E->isConst() && evaluateConstant(E, Val)) {
+        if ((Val != 0) == JumpIfTrue)
+            emitJump(Jump, 0, 0, L);
+        return;
+    }
+    if (auto *Prefix = llvm::dyn_cast<PrefixExpression>(E)) {
+        if (Prefix->getOperatorInfo().getKind() == tok::kw_NOT) {
+            compileCondJump(Prefix->getExpr(), !JumpIfTrue, L);
+            return;
+        }
+    }
+    if (auto *Infix = llvm::dyn_cast<InfixExpression>(E)) {
+        tok::TokenKind Kind = Infix->getOperatorInfo().getKind();
+        if (Kind == tok::kw_AND || Kind == tok::kw_OR) {
+            // The right operand decides if the left one does not.
+            bool IsAnd = Kind == tok::kw_AND;
+            if (JumpIfTrue == IsAnd) {
+                Label Skip;
+                compileCondJump(Infix->getLeft(), !IsAnd, Skip);
+                compileCondJump(Infix->getRight(), JumpIfTrue, L);
+                bind(Skip);
+            } else {
+                compileCondJump(Infix->getLeft(), JumpIfTrue, L);
+                compileCondJump(Infix->getRight(), JumpIfTrue, L);
+            }
+            return;
+        }
+        Opcode Op;
+        switch (Kind) {
+            case tok::equal:
+                Op = JumpIfTrue ? JumpIfEq : JumpIfNe;
+                break;
+            case tok::hash:
+                Op = JumpIfTrue ? JumpIfNe : JumpIfEq;
+                break;
+            case tok::less:
+                Op = JumpIfTrue ? JumpIfLt : JumpIfGe;
+                break;
+            case tok::lessequal:
+                Op = JumpIfTrue ? JumpIfLe : JumpIfGt;
+                break;
+            case tok::greater:
+                Op = JumpIfTrue ? JumpIfGt : JumpIfLe;
+                break;
+            case tok::greaterequal:
+                Op = JumpIfTrue ? JumpIfGe : JumpIfLt;
+                break;
+            default:
+                Op = NUM_OPCODES;
+                break;
+        }
+        if (Op != NUM_OPCODES) {
+            unsigned Left = compileExpr(Infix->getLeft());
+            if (Left < Fn.ConstBase && hasCall(Infix->getRight())) {
+                unsigned Tmp = allocTemp();
+                emit(Move, Tmp, Left, 0);
+                Left = Tmp;
+            }
+            unsigned Right = compileExpr(Infix->getRight());
+            emitJump(Op, Left, Right, L);
+            return;
+        }
+    }
+    unsigned Reg = compileExpr(E);
+    emitJump(JumpIfTrue ? vm::JumpIfTrue : vm::JumpIfFalse, Reg, 0, L);
+}
+
+// The arguments are placed in the topmost registers, where the frame of
+// the callee starts.
+unsigned FunctionCompiler::compileCall(ProcedureDeclaration *Callee, ArrayRef<Expr *> Args, int Dest) {
+    auto FnIndex = P.FunctionIndex.find(Callee);
+    if (FnIndex == P.FunctionIndex.end())
+        llvm::report_fatal_error("Calls of procedures from other modules not yet supported");
+    auto Formals = Callee->getFormalParams();
+    unsigned ArgStart = NextTemp;
+    for (size_t I = 0, E = Args.size(); I != E; ++I)
+        allocTemp();
+    for (size_t I = 0, E = Args.size(); I != E; ++I) {
+        unsigned ArgReg = ArgStart + I;
+        if (!Formals[I]->isVar()) {
+            compileExpr(Args[I], ArgReg);
+            continue;
+        }
+        Decl *D = llvm::cast<VariableAccess>(Args[I])->getDecl();
+        unsigned G = getGlobal(D);
+        if (G != ~0U)
+            emit(AddrGlobal, ArgReg, 0, G);
+        else if (isVarParam(D))
+            emit(Move, ArgReg, getReg(D), 0);
+        else
+            emit(AddrOf, ArgReg, getReg(D), 0);
+    }
+    // Without a destination, the result replaces the first argument.
+    NextTemp = ArgStart;
+    unsigned Reg = Dest < 0 ? allocTemp() : Dest;
+    emit(Call, ArgStart, Reg, FnIndex->second);
+    return Reg;
+}
+
+void FunctionCompiler::compileStmt(AssignmentStatement *Stmt) {
+    Decl *D = Stmt->getVar();
+    unsigned G = getGlobal(D);
+    if (G != ~0U)
+        emit(StoreGlobal, compileExpr(Stmt->getExpr()), 0, G);
+    else if (isVarParam(D))
+        emit(StoreRef, getReg(D), compileExpr(Stmt->getExpr()), 0);
+    else
+        compileExpr(Stmt->getExpr(), getReg(D));
+}
+
+void FunctionCompiler::compileStmt(IfStatement *Stmt) {
+    Label Else;
+    compileCondJump(Stmt->getCond(), false, Else);
+    compile(Stmt->getIfStmts());
+    if (Stmt->getElseStmts().empty()) {
+        bind(Else);
+        return;
+    }
+    Label End;
+    emitJump(Jump, 0, 0, End);
+    bind(Else);
+    compile(Stmt->getElseStmts());
+    bind(End);
+}
+
+// The condition is at the bottom of the loop, so that each iteration only
+// executes one branch.
+void FunctionCompiler::compileStmt(WhileStatement *Stmt) {
+    Label Cond, Body;
+    emitJump(Jump, 0, 0, Cond);
+    bind(Body);
+    compile(Stmt->getWhileStmts());
+    bind(Cond);
+    compileCondJump(Stmt->getCond(), true, Body);
+}
+
+void FunctionCompiler::compileStmt(ReturnStatement *Stmt) {
+    if (Stmt->getRetVal())
+        emit(Ret, compileExpr(Stmt->getRetVal()), 0, 0);
+    else
+        emit(RetVoid, 0, 0, 0);
+}
+
+void FunctionCompiler::compile(ArrayRef<Stmt *> Stmts) {
+    for (Stmt *S : Stmts) {
+        // Temporaries do not live across statements.
+        NextTemp = Fn.ConstBase + Fn.Constants.size();
+        if (auto *Assign = llvm::dyn_cast<AssignmentStatement>(S))
+            compileStmt(Assign);
+        else if (auto *Call = llvm::dyn_cast<ProcedureCallStatement>(S))
+            compileCall(Call->getProc(), Call->getParams(), -1);
+        else if (auto *If = llvm::dyn_cast<IfStatement>(S))
+            compileStmt(If);
+        else if (auto *While = llvm::dyn_cast<WhileStatement>(S))
+            compileStmt(While);
+        else if (auto *Return = llvm::dyn_cast<ReturnStatement>(S))
+            compileStmt(Return);
+        else
+            llvm_unreachable("Unknown statement");
+    }
+}
+
+void FunctionCompiler::run(ArrayRef<FormalParameterDeclaration *> Params, ArrayRef<Decl *> Decls,
+                           ArrayRef<Stmt *> Stmts, bool HasResult) {
+    unsigned Reg = 0;
+    for (FormalParameterDeclaration *FP : Params)
+        Regs[FP] = Reg++;
+    Fn.NumParams = Reg;
+    for (Decl *D : Decls)
+        if (llvm::isa<VariableDeclaration>(D))
+            Regs[D] = Reg++;
+    Fn.ConstBase = Reg;
+    // FALSE and TRUE, which also serve as the default result.
+    addConstant(0);
+    addConstant(1);
+    collectConstants(Stmts);
+    Fn.NumRegs = Fn.ConstBase + Fn.Constants.size();
+
+    compile(Stmts);
+    if (HasResult)
+        emit(Ret, ConstRegs[0], 0, 0);
+    else
+        emit(RetVoid, 0, 0, 0);
+}
+
+void FunctionCompiler::run(ProcedureDeclaration *Proc) {
+    Fn.Proc = Proc;
+    Fn.Name = Proc->getName().str();
+    run(Proc->getFormalParams(), Proc->getDecls(), Proc->getStmts(), Proc->getRetType() != nullptr);
+}
+
+void FunctionCompiler::run(ModuleDeclaration *Mod) {
+    Fn.Proc = Mod;
+    Fn.Name = Mod->getName().str();
+    // The variables of the module are globals, there are no locals.
+    run({}, {}, Mod->getStmts(), false);
+}
+
+namespace {
+    void collectProcedures(ArrayRef<Decl *> Decls, llvm::SmallVectorImpl<ProcedureDeclaration *> &Procs) {
+        for (Decl *D : Decls) {
+            if (auto *Proc = llvm::dyn_cast<ProcedureDeclaration>(D)) {
+                Procs.push_back(Proc);
+                collectProcedures(Proc->getDecls(), Procs);
+            }
+        }
+    }
+}
+
+std::unique_ptr<Program> BytecodeCompiler::compile(ModuleDeclaration *Mod) {
+    auto P = std::make_unique<Program>();
+    for (Decl *D : Mod->getDecls())
+        if (llvm::isa<VariableDeclaration>(D))
+            P->GlobalIndex[D] = P->NumGlobals++;
+
+    // All functions are numbered first, so that calls can refer to them.
+    llvm::SmallVector<ProcedureDeclaration *, 16> Procs;
+    collectProcedures(Mod->getDecls(), Procs);
+    P->Functions.resize(Procs.size() + 1);
+    P->FunctionIndex[Mod] = 0;
+    for (size_t I = 0, E = Procs.size(); I != E; ++I)
+        P->FunctionIndex[Procs[I]] = I + 1;
+
+    FunctionCompiler(*P, P->Functions[0]).run(Mod);
+    for (size_t I = 0, E = Procs.size(); I != E; ++I)
+        FunctionCompiler(*P, P->Functions[I + 1]).run(Procs[I]);
+    return P;
+}
@@ -0,0 +1,276 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+#include "tinylang/VM/Interpreter.h"
+#include "llvm/Support/ErrorHandling.h"
+#include <algorithm>
+#include <limits>
+
+// Threaded dispatch jumps from the end of each handler directly to the
+// next one, which needs the labels-as-values extension.
+#if defined(__GNUC__)
+#define TINYLANG_VM_COMPUTED_GOTO 1
+#else
+#define TINYLANG_VM_COMPUTED_GOTO 0
+#endif
+
+using namespace tinylang;
+using namespace tinylang::vm;
+
+namespace {
+    llvm::Error runtimeError(const char *Msg) {
+        return llvm::createStringError(llvm::inconvertibleErrorCode(), Msg);
+    }
+
+    // Zeroes the local variables and loads the constants.
+    void enterFunction(const Function &Fn, int64_t *Base) {
+        std::fill(Base + Fn.NumParams, Base + Fn.ConstBase, 0);
+        std::copy(Fn.Constants.begin(), Fn.Constants.end(), Base + Fn.ConstBase);
+    }
+}
+
+Interpreter::Interpreter(const Program &P, size_t StackSize) :
+        P(P), Globals(P.NumGlobals), Stack(new int64_t[StackSize]),
+        StackSize(StackSize), MaxFrames(StackSize / 2),
+        Budgets(P.Functions.size(), std::numeric_limits<int32_t>::max()),
+        NativeEntries(new std::atomic<NativeEntry>[P.Functions.size()]()) {
+    // Every frame has at least the registers for FALSE and TRUE.
+    Frames.reset(new Frame[MaxFrames]);
+}
+
+void Interpreter::setHotThreshold(unsigned Threshold, std::function<void(unsigned FnIndex)> OnHot) {
+    int32_t Budget = std::min<unsigned>(std::max(Threshold, 1U), std::numeric_limits<int32_t>::max());
+    std::fill(Budgets.begin(), Budgets.end(), Budget);
+    this->OnHot = std::move(OnHot);
+    CountBudgets = true;
+}
+
+// A function is only reported once.
+void Interpreter::reportHot(unsigned FnIndex) {
+    Budgets[FnIndex] = std::numeric_limits<int32_t>::max();
+    if (OnHot)
+        OnHot(FnIndex);
+}
+
+llvm::Error Interpreter::run() {
+    llvm::Expected<int64_t> Result = call(0, {});
+    return Result ? llvm::Error::success() : Result.takeError();
+}
+
+llvm::Expected<int64_t> Interpreter::call(unsigned FnIndex, ArrayRef<int64_t> Args) {
+    const Function &Fn = P.Functions[FnIndex];
+    assert(Args.size() == Fn.NumParams && "Wrong number of arguments");
+    if (Fn.NumRegs > StackSize)
+        return runtimeError("stack overflow");
+    int64_t *Base = Stack.get();
+    std::copy(Args.begin(), Args.end(), Base);
+    if (NativeEntry Entry = NativeEntries[FnIndex].load(std::memory_order_acquire))
+        return Entry(Base);
+    enterFunction(Fn, Base);
+    if (!CountBudgets)
+        return execute<false>(FnIndex, Base);
+    if (--Budgets[FnIndex] == 0)
+        reportHot(FnIndex);
+    return execute<true>(FnIndex, Base);
+}
+
+template <bool Count>
+llvm::Expected<int64_t> Interpreter::execute(unsigned FnIndex, int64_t *Base) {
+    const Instruction *PC = P.Functions[FnIndex].Code.data();
+    // The budget of the current function, which also identifies it.
+    int32_t *BudgetsBegin = Budgets.data();
+    int32_t *Budget = BudgetsBegin + FnIndex;
+    int64_t *G = Globals.data();
+    int64_t *StackEnd = Stack.get() + StackSize;
+    Frame *FramesBegin = Frames.get();
+    Frame *FramesEnd = FramesBegin + MaxFrames;
+    Frame *Top = FramesBegin;
+    const Function *Functions = P.Functions.data();
+    const Instruction *I;
+
+#define R(Op) Base[I->Op]
+// Only loop back edges jump backwards.
+#define JUMP() \
+    do { \
+        int32_t Offset = static_cast<int32_t>(I->C); \
+        PC = I + Offset; \
+        if (Count && Offset < 0 && --*Budget == 0) \
+            reportHot(Budget - BudgetsBegin); \
+    } while (0)
+
+#if TINYLANG_VM_COMPUTED_GOTO
+    static const void *DispatchTable[] = {
+#define OPCODE(ID) &&L_##ID,
+
+#include "tinylang/VM/Opcodes.def"
+    };
+#define CASE(ID) L_##ID:
+#define DISPATCH() \
+    do { \
+        I = PC++; \
+        goto *DispatchTable[I->Op]; \
+    } while (0)
+
+    DISPATCH();
+#else
+#define CASE(ID) case ID:
+#define DISPATCH() continue
+    for (;;) {
+        I = PC++;
+        switch (I->Op) {
+#endif
+    CASE(Move)
+    R(A) = R(B);
+    DISPATCH();
+    CASE(LoadGlobal)
+    R(A) = G[I->C];
+    DISPATCH();
+    CASE(StoreGlobal)
+    G[I->C] = R(A);
+    DISPATCH();
+    CASE(LoadRef)
+    R(A) = *reinterpret_cast<int64_t *>(R(B));
+    DISPATCH();
+    CASE(StoreRef)
+    *reinterpret_cast<int64_t *>(R(A)) = R(B);
+    DISPATCH();
+    CASE(AddrOf)
+    R(A) = reinterpret_cast<int64_t>(&R(B));
+    DISPATCH();
+    CASE(AddrGlobal)
+    R(A) = reinterpret_cast<int64_t>(&G[I->C]);
+    DISPATCH();
+
+    CASE(Add)
+    R(A) = addWrap(R(B), Base[I->C]);
+    DISPATCH();
+    CASE(Sub)
+    R(A) = subWrap(R(B), Base[I->C]);
+    DISPATCH();
+    CASE(Mul)
+    R(A) = mulWrap(R(B), Base[I->C]);
+    DISPATCH();
+    CASE(Div)
+    if (Base[I->C] == 0)
+        return runtimeError("division by zero");
+    R(A) = divWrap(R(B), Base[I->C]);
+    DISPATCH();
+    CASE(Mod)
+    if (Base[I->C] == 0)
+        return runtimeError("division by zero");
+    R(A) = modWrap(R(B), Base[I->C]);
+    DISPATCH();
+    CASE(Neg)
+    R(A) = subWrap(0, R(B));
+    DISPATCH();
+    CASE(Not)
+    R(A) = R(B) ^ 1;
+    DISPATCH();
+
+    CASE(Eq)
+    R(A) = R(B) == Base[I->C];
+    DISPATCH();
+    CASE(Ne)
+    R(A) = R(B) != Base[I->C];
+    DISPATCH();
+    CASE(Lt)
+    R(A) = R(B) < Base[I->C];
+    DISPATCH();
+    CASE(Le)
+    R(A) = R(B) <= Base[I->C];
+    DISPATCH();
+    CASE(Gt)
+    R(A) = R(B) > Base[I->C];
+    DISPATCH();
+    CASE(Ge)
+    R(A) = R(B) >= Base[I->C];
+    DISPATCH();
+
+    CASE(Jump)
+    JUMP();
+    DISPATCH();
+    CASE(JumpIfTrue)
+    if (R(A))
+        JUMP();
+    DISPATCH();
+    CASE(JumpIfFalse)
+    if (!R(A))
+        JUMP();
+    DISPATCH();
+    CASE(JumpIfEq)
+    if (R(A) == R(B))
+        JUMP();
+    DISPATCH();
+    CASE(JumpIfNe)
+    if (R(A) != R(B))
+        JUMP();
+    DISPATCH();
+    CASE(JumpIfLt)
+    if (R(A) < R(B))
+        JUMP();
+    DISPATCH();
+    CASE(JumpIfLe)
+    if (R(A) <= R(B))
+        JUMP();
+    DISPATCH();
+    CASE(JumpIfGt)
+    if (R(A) > R(B))
+        JUMP();
+    DISPATCH();
+    CASE(JumpIfGe)
+    if (R(A) >= R(B))
+        JUMP();
+    DISPATCH();
+
+    CASE(Call) {
+        unsigned CalleeIndex = I->C;
+        if (NativeEntry Entry = NativeEntries[CalleeIndex].load(std::memory_order_acquire)) {
+            R(B) = Entry(Base + I->A);
+            DISPATCH();
+        }
+        const Function &Callee = Functions[CalleeIndex];
+        int64_t *CalleeBase = Base + I->A;
+        if (CalleeBase + Callee.NumRegs > StackEnd || Top == FramesEnd)
+            return runtimeError("stack overflow");
+        *Top++ = Frame{PC, Base, Budget};
+        enterFunction(Callee, CalleeBase);
+        Base = CalleeBase;
+        PC = Callee.Code.data();
+        Budget = BudgetsBegin + CalleeIndex;
+        if (Count && --*Budget == 0)
+            reportHot(CalleeIndex);
+        DISPATCH();
+    }
+    CASE(Ret) {
+        int64_t Val = R(A);
+        if (Top == FramesBegin)
+            return Val;
+        --Top;
+        PC = Top->ReturnPC;
+        Base = Top->Base;
+        Budget = Top->Budget;
+        // The call instruction names the register for the result.
+        Base[PC[-1].B] = Val;
+        DISPATCH();
+    }
+    CASE(RetVoid)
+    if (Top == FramesBegin)
+        return 0;
+    --Top;
+    PC = Top->ReturnPC;
+    Base = Top->Base;
+    Budget = Top->Budget;
+    DISPATCH();
+
+#if !TINYLANG_VM_COMPUTED_GOTO
+        default:
+            llvm_unreachable("Unknown opcode");
+        }
+    }
+#endif
+#undef R
+#undef JUMP
+#undef CASE
+#undef DISPATCH
+}
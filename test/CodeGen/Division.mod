@@ -0,0 +1,43 @@
+MODULE Division;
+
+(* A divisor which is not a constant is checked for 0 and -1. The error
+   block is shared by all divisions of a function.
+
+CHECK-LABEL: define i64 @_t8Division3Div(i64 %a, i64 %b)
+CHECK: [[ZERO:%[0-9]+]] = icmp eq i64 %b, 0
+CHECK-NEXT: br i1 [[ZERO]], label %div.zero, label %div.cont
+CHECK: div.zero:
+CHECK-NEXT: call void @tinylang_runtime_error(i8* getelementptr
+CHECK-NEXT: unreachable
+CHECK: div.cont:
+CHECK-NEXT: [[MINUS:%[0-9]+]] = icmp eq i64 %b, -1
+CHECK-NEXT: [[SAFE:%[0-9]+]] = select i1 [[MINUS]], i64 1, i64 %b
+CHECK-NEXT: [[QUOT:%[0-9]+]] = sdiv i64 %a, [[SAFE]]
+CHECK-NEXT: [[NEG:%[0-9]+]] = sub i64 0, %a
+CHECK-NEXT: select i1 [[MINUS]], i64 [[NEG]], i64 [[QUOT]]
+CHECK: br i1 {{%[0-9]+}}, label %div.zero, label %div.cont
+CHECK: srem i64 %a,
+CHECK-NOT: div.zero{{[0-9]+}}:
+
+CHECK: declare void @tinylang_runtime_error(i8*{{[)]}} [[ATTRS:#[0-9]+]]
+
+Constant divisors need no checks.
+CHECK-LABEL: define void @_t8Division()
+CHECK-NOT: div.zero
+CHECK: sdiv i64 {{%[0-9]+}}, 2
+CHECK: srem i64 {{%[0-9]+}}, 3
+
+CHECK: attributes [[ATTRS]] = { cold noreturn nounwind }
+*)
+
+VAR q, r: INTEGER;
+
+PROCEDURE Div(a, b: INTEGER): INTEGER;
+BEGIN
+    RETURN a DIV b + a MOD b
+END Div;
+
+BEGIN
+    q := Div(7, 2) DIV 2;
+    r := q MOD 3
+END Division.
@@ -0,0 +1,22 @@
+MODULE Literals;
+
+(* Literals which do not fit into 64 bits are truncated.
+
+CHECK-LABEL: define void @_t8Literals()
+CHECK-NEXT: entry:
+CHECK-NEXT: store i64 9223372036854775807, i64* @_t8Literals1a
+CHECK-NEXT: store i64 -4362896299872285998, i64* @_t8Literals1b
+CHECK-NEXT: store i64 -1, i64* @_t8Literals1c
+CHECK-NEXT: store i64 0, i64* @_t8Literals1d
+*)
+
+CONST Huge = 123456789012345678901234567890;
+
+VAR a, b, c, d: INTEGER;
+
+BEGIN
+    a := 9223372036854775807;
+    b := Huge;
+    c := 0FFFFFFFFFFFFFFFFH;
+    d := 18446744073709551616
+END Literals.
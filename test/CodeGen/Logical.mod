@@ -0,0 +1,47 @@
+MODULE Logical;
+
+(* AND and OR evaluate the right operand in a block of its own, which is
+   skipped when the left operand decides the result.
+
+CHECK-LABEL: define i1 @_t7Logical4Both(i1 %x, i1 %y)
+CHECK-NEXT: entry:
+CHECK-NEXT: br i1 %x, label %and.rhs, label %and.end
+CHECK: and.rhs:
+CHECK: [[RHS:%[0-9]+]] = call i1 @_t7Logical5Check(i1 %y)
+CHECK-NEXT: br label %and.end
+CHECK: and.end:
+CHECK-NEXT: phi i1 [ false, %entry ], [ [[RHS]], %and.rhs ]
+
+CHECK-LABEL: define i1 @_t7Logical6Either(i1 %x, i1 %y)
+CHECK-NEXT: entry:
+CHECK-NEXT: br i1 %x, label %or.end, label %or.rhs
+CHECK: or.rhs:
+CHECK: [[RHS:%[0-9]+]] = call i1 @_t7Logical5Check(i1 %y)
+CHECK-NEXT: br label %or.end
+CHECK: or.end:
+CHECK-NEXT: phi i1 [ true, %entry ], [ [[RHS]], %or.rhs ]
+*)
+
+VAR n: INTEGER;
+    a, b: BOOLEAN;
+
+PROCEDURE Check(x: BOOLEAN): BOOLEAN;
+BEGIN
+    n := n + 1;
+    RETURN x
+END Check;
+
+PROCEDURE Both(x, y: BOOLEAN): BOOLEAN;
+BEGIN
+    RETURN x AND Check(y)
+END Both;
+
+PROCEDURE Either(x, y: BOOLEAN): BOOLEAN;
+BEGIN
+    RETURN x OR Check(y)
+END Either;
+
+BEGIN
+    a := Both(TRUE, n > 0);
+    b := Either(a, n < 0)
+END Logical.
@@ -0,0 +1,53 @@
+MODULE Procedures;
+
+(* A VAR parameter is a pointer. A local variable passed to one lives in
+   a stack slot, the others stay in registers. A nested procedure is
+   mangled with the names of the enclosing ones.
+
+CHECK: @_t10Procedures1g = private global i64 0
+
+CHECK-LABEL: define void @_t10Procedures3Inc(i64* %x, i64 %d)
+CHECK-NEXT: entry:
+CHECK-NEXT: [[OLD:%[0-9]+]] = load i64, i64* %x
+CHECK-NEXT: [[NEW:%[0-9]+]] = add i64 [[OLD]], %d
+CHECK-NEXT: store i64 [[NEW]], i64* %x
+
+CHECK-LABEL: define i64 @_t10Procedures5Local(i64 %n)
+CHECK-NEXT: entry:
+CHECK-NEXT: %t = alloca i64
+CHECK-NOT: alloca
+CHECK: call void @_t10Procedures3Inc(i64* %t, i64 %n)
+CHECK: call i64 @_t10Procedures5Local5Inner(i64 %n)
+
+CHECK-LABEL: define i64 @_t10Procedures5Local5Inner(i64 %m)
+
+CHECK-LABEL: define void @_t10Procedures()
+CHECK: call void @_t10Procedures3Inc(i64* @_t10Procedures1g, i64 1)
+*)
+
+VAR g: INTEGER;
+
+PROCEDURE Inc(VAR x: INTEGER; d: INTEGER);
+BEGIN
+    x := x + d
+END Inc;
+
+PROCEDURE Local(n: INTEGER): INTEGER;
+VAR t, u: INTEGER;
+
+    PROCEDURE Inner(m: INTEGER): INTEGER;
+    BEGIN
+        RETURN m * 2
+    END Inner;
+
+BEGIN
+    t := 1;
+    u := 2;
+    Inc(t, n);
+    RETURN t + u + Inner(n)
+END Local;
+
+BEGIN
+    Inc(g, 1);
+    g := Local(g)
+END Procedures.
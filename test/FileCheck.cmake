@@ -0,0 +1,34 @@
+# Runs tinylang on INPUT and checks the output with the CHECK lines of
+# INPUT. A CodeGen test must compile, and its IR at -O0 is checked. A Sema
+# test must fail, and its diagnostics are checked. A line starting with
+# FLAGS: adds options.
+get_filename_component(Name ${INPUT} NAME_WE)
+file(STRINGS ${INPUT} Flags REGEX "^FLAGS:")
+string(REGEX REPLACE "^FLAGS: *" "" Flags "${Flags}")
+separate_arguments(Flags)
+file(MAKE_DIRECTORY ${WORK_DIR})
+# The IR is written next to the input.
+file(COPY ${INPUT} DESTINATION ${WORK_DIR})
+set(Copy ${WORK_DIR}/${Name}.mod)
+
+if (KIND STREQUAL "CodeGen")
+    execute_process(COMMAND ${TINYLANG} -emit-llvm -O0 ${Flags} ${Copy}
+            RESULT_VARIABLE Result ERROR_VARIABLE Errors OUTPUT_QUIET)
+    if (NOT Result EQUAL 0)
+        message(FATAL_ERROR "${Name}.mod does not compile:\n${Errors}")
+    endif ()
+    set(Output ${WORK_DIR}/${Name}.ll)
+else ()
+    set(Output ${WORK_DIR}/${Name}.err)
+    execute_process(COMMAND ${TINYLANG} ${Flags} ${Copy}
+            RESULT_VARIABLE Result ERROR_FILE ${Output} OUTPUT_QUIET)
+    if (Result EQUAL 0)
+        message(FATAL_ERROR "${Name}.mod compiles without errors")
+    endif ()
+endif ()
+
+execute_process(COMMAND ${FILECHECK} ${INPUT} --input-file ${Output}
+        RESULT_VARIABLE Result)
+if (NOT Result EQUAL 0)
+    message(FATAL_ERROR "FileCheck failed for ${Name}.mod")
+endif ()
@@ -0,0 +1,20 @@
+MODULE ErrorLimit;
+
+(* The limit message names only the file.
+FLAGS: -ferror-limit=2
+
+CHECK: ErrorLimit.mod:17:10: error: undeclared name y1
+CHECK: ErrorLimit.mod:18:10: error: undeclared name y2
+CHECK-NEXT: x := y2;
+CHECK-NEXT: ^
+CHECK-NEXT: ErrorLimit.mod: error: too many errors emitted, stopping now [-ferror-limit=]
+CHECK-NOT: y3
+*)
+
+VAR x: INTEGER;
+
+BEGIN
+    x := y1;
+    x := y2;
+    x := y3
+END ErrorLimit.
@@ -0,0 +1,29 @@
+MODULE Types;
+
+(*
+CHECK: Types.mod:19:16: error: access to n of an enclosing procedure is not supported
+CHECK: Types.mod:26:12: error: types not compatible for operator +
+CHECK: Types.mod:27:5: error: expression of IF statement must have type BOOLEAN
+CHECK: Types.mod:28:5: error: left side of assignment must be a variable
+CHECK-NOT: error
+*)
+
+CONST One = 1;
+
+VAR b: BOOLEAN;
+    i: INTEGER;
+
+PROCEDURE Outer(n: INTEGER): INTEGER;
+    PROCEDURE Inner(): INTEGER;
+    BEGIN
+        RETURN n
+    END Inner;
+BEGIN
+    RETURN Inner()
+END Outer;
+
+BEGIN
+    i := 1 + TRUE;
+    IF i THEN i := 2 END;
+    One := 2
+END Types.
@@ -0,0 +1,22 @@
+MODULE Undeclared;
+
+(* An undeclared type is reported once, and not again as a missing type.
+
+CHECK: Undeclared.mod:13:8: error: undeclared name Foo
+CHECK-NOT: requires type
+CHECK: Undeclared.mod:15:16: error: undeclared name Bar
+CHECK-NOT: requires type
+CHECK: Undeclared.mod:21:10: error: undeclared name y
+CHECK-NOT: error
+*)
+
+VAR x: Foo;
+
+PROCEDURE P(a: Bar; VAR c: INTEGER);
+END P;
+
+VAR n: INTEGER;
+
+BEGIN
+    n := y
+END Undeclared.
@@ -0,0 +1,117 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+// Measures qualified lookup: builds a module with N variables through
+// Sema, then resolves N references M.v<i> in a scattered order with
+// actOnQualIdentPart. For comparison, the same lookups are also done with
+// a scan of the module's declarations, which is what actOnQualIdentPart
+// did before modules had an export index.
+
+#include "tinylang/Sema/Sema.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace tinylang;
+
+static llvm::cl::list<unsigned> Sizes(
+        "n",
+        llvm::cl::desc("Numbers of declarations and references"),
+        llvm::cl::CommaSeparated);
+
+static llvm::cl::opt<unsigned> ScanLimit(
+        "scan-limit",
+        llvm::cl::desc("Largest N for which the scan is timed, it is quadratic"),
+        llvm::cl::init(10000));
+
+namespace {
+    struct Result {
+        unsigned Found{0};
+        double IndexMs{0};
+        double ScanMs{-1};
+    };
+
+    Result run(unsigned N, bool Scan) {
+        llvm::SourceMgr SrcMgr;
+        DiagnosticEngine Diags(SrcMgr);
+        IdentifierTable Idents;
+        ASTContext Context;
+        Sema Actions(Context, Diags, Idents);
+
+        std::vector<std::string> Names(N);
+        std::vector<Ident> Refs;
+        Refs.reserve(N);
+        for (unsigned I = 0; I < N; ++I) {
+            Names[I] = 'v';
+            Names[I] += std::to_string(I);
+        }
+        // A prime stride, so that the references are not in the order of
+        // the declarations.
+        for (unsigned I = 0; I < N; ++I) {
+            const std::string &Name = Names[(I * 7919u) % N];
+            Refs.emplace_back(SMLoc(), Name, Idents.get(Name));
+        }
+
+        Ident ModName(SMLoc(), "M", Idents.get("M"));
+        ModuleDeclaration *Mod = Actions.actOnModuleDeclaration(ModName);
+        Decl *IntegerType = Actions.actOnQualIdentPart(nullptr, Ident(SMLoc(), "INTEGER", Idents.get("INTEGER")));
+        DeclList Decls;
+        StmtList Stmts;
+        {
+            EnterDeclScope Scope(Actions, Mod);
+            for (unsigned I = 0; I < N; ++I) {
+                IdentList Ids{Ident(SMLoc(), Names[I], Idents.get(Names[I]))};
+                Actions.actOnVariableDeclaration(Decls, Ids, IntegerType);
+            }
+        }
+        Actions.actOnModuleDeclaration(Mod, ModName, Decls, Stmts);
+
+        Result R;
+        auto Start = std::chrono::steady_clock::now();
+        for (const Ident &Ref : Refs)
+            R.Found += Actions.actOnQualIdentPart(Mod, Ref) != nullptr;
+        R.IndexMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+
+        if (Scan) {
+            unsigned Found = 0;
+            Start = std::chrono::steady_clock::now();
+            for (const Ident &Ref : Refs) {
+                for (Decl *D : Mod->getDecls()) {
+                    if (D->getNameID() == Ref.getID()) {
+                        ++Found;
+                        break;
+                    }
+                }
+            }
+            R.ScanMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+            if (Found != R.Found)
+                llvm::errs() << "scan found " << Found << " declarations, the index " << R.Found << "\n";
+        }
+        return R;
+    }
+}
+
+int main(int argc_, const char **argv_) {
+    llvm::InitLLVM X(argc_, argv_);
+    llvm::cl::ParseCommandLineOptions(argc_, argv_, "tinylang qualified lookup benchmark\n");
+
+    std::vector<unsigned> Ns{1000, 10000, 100000};
+    if (!Sizes.empty())
+        Ns.assign(Sizes.begin(), Sizes.end());
+    llvm::outs() << "         N      found   export index (ms)   scan (ms)\n";
+    for (unsigned N : Ns) {
+        Result R = run(N, N <= ScanLimit);
+        llvm::outs() << llvm::format("  %8u   %8u   %17.2f   ", N, R.Found, R.IndexMs);
+        if (R.ScanMs >= 0)
+            llvm::outs() << llvm::format("%9.2f\n", R.ScanMs);
+        else
+            llvm::outs() << "        -\n";
+    }
+    return 0;
+}
@@ -0,0 +1,305 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+// Compares the bytecode interpreter with a naive AST walker, which keeps
+// the variables of each frame in an unordered_map and evaluates the tree
+// recursively. Runs the built-in programs, or the given files, and checks
+// that both end with the same module variables.
+
+#include "tinylang/AST/ASTContext.h"
+#include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/IdentifierTable.h"
+#include "tinylang/Lexer/Lexer.h"
+#include "tinylang/Parser/Parser.h"
+#include "tinylang/Sema/Sema.h"
+#include "tinylang/VM/Bytecode.h"
+#include "tinylang/VM/BytecodeCompiler.h"
+#include "tinylang/VM/Interpreter.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace tinylang;
+
+static llvm::cl::list<std::string> InputFiles(llvm::cl::Positional,
+                                              llvm::cl::desc("[input-files]"));
+
+static llvm::cl::opt<unsigned> Iterations(
+        "iterations",
+        llvm::cl::desc("Number of runs of each program and interpreter"),
+        llvm::cl::init(3));
+
+// Calls, loops over locals, and loops over module variables only.
+static const char *const Programs[][2] = {
+        {"Gcd.mod", "MODULE Gcd;\n"
+                    "VAR i, s: INTEGER;\n"
+                    "PROCEDURE GCD(a, b: INTEGER): INTEGER;\n"
+                    "VAR t: INTEGER;\n"
+                    "BEGIN\n"
+                    "    WHILE b # 0 DO t := a MOD b; a := b; b := t END;\n"
+                    "    RETURN a\n"
+                    "END GCD;\n"
+                    "BEGIN\n"
+                    "    i := 0;\n"
+                    "    WHILE i < 3000000 DO s := s + GCD(i, 360360); i := i + 1 END\n"
+                    "END Gcd.\n"},
+        {"Loop.mod", "MODULE Loop;\n"
+                     "VAR r, f: INTEGER;\n"
+                     "PROCEDURE Sum(n: INTEGER): INTEGER;\n"
+                     "VAR i, s: INTEGER;\n"
+                     "BEGIN\n"
+                     "    i := 0; s := 0;\n"
+                     "    WHILE i < n DO s := s + i; i := i + 1 END;\n"
+                     "    RETURN s\n"
+                     "END Sum;\n"
+                     "PROCEDURE Fib(n: INTEGER): INTEGER;\n"
+                     "BEGIN\n"
+                     "    IF n < 2 THEN RETURN n END;\n"
+                     "    RETURN Fib(n - 1) + Fib(n - 2)\n"
+                     "END Fib;\n"
+                     "BEGIN\n"
+                     "    r := Sum(20000000);\n"
+                     "    f := Fib(27)\n"
+                     "END Loop.\n"},
+        {"Collatz.mod", "MODULE Collatz;\n"
+                        "VAR i, n, Steps, Total: INTEGER;\n"
+                        "BEGIN\n"
+                        "    i := 1;\n"
+                        "    WHILE i < 300000 DO\n"
+                        "        n := i; Steps := 0;\n"
+                        "        WHILE n # 1 DO\n"
+                        "            IF n MOD 2 = 0 THEN n := n DIV 2 ELSE n := 3 * n + 1 END;\n"
+                        "            Steps := Steps + 1\n"
+                        "        END;\n"
+                        "        Total := Total + Steps;\n"
+                        "        i := i + 1\n"
+                        "    END\n"
+                        "END Collatz.\n"},
+};
+
+namespace {
+    // Evaluates the AST directly. Every access to a variable is a hash
+    // lookup, every value passes through the recursion.
+    class ASTWalker {
+        struct Frame {
+            std::unordered_map<Decl *, int64_t> Vars;
+            // The VAR parameters.
+            std::unordered_map<Decl *, int64_t *> Refs;
+        };
+
+        std::unordered_map<Decl *, int64_t> Globals;
+        Frame *Top{nullptr};
+        bool Returning{false};
+        int64_t RetVal{0};
+        const char *Error{nullptr};
+
+        int64_t *lookup(Decl *D) {
+            if (Top) {
+                auto Ref = Top->Refs.find(D);
+                if (Ref != Top->Refs.end())
+                    return Ref->second;
+                auto Var = Top->Vars.find(D);
+                if (Var != Top->Vars.end())
+                    return &Var->second;
+            }
+            return &Globals[D];
+        }
+
+        int64_t call(ProcedureDeclaration *Proc, ArrayRef<Expr *> Args) {
+            Frame F;
+            ArrayRef<FormalParameterDeclaration *> Params = Proc->getFormalParams();
+            for (size_t I = 0; I != Params.size(); ++I) {
+                if (Params[I]->isVar())
+                    F.Refs[Params[I]] = lookup(llvm::cast<VariableAccess>(Args[I])->getDecl());
+                else
+                    F.Vars[Params[I]] = eval(Args[I]);
+            }
+            for (Decl *D : Proc->getDecls())
+                if (llvm::isa<VariableDeclaration>(D))
+                    F.Vars[D] = 0;
+            Frame *Caller = Top;
+            Top = &F;
+            exec(Proc->getStmts());
+            Top = Caller;
+            Returning = false;
+            return RetVal;
+        }
+
+        int64_t evalInfix(InfixExpression *E) {
+            tok::TokenKind Kind = E->getOperatorInfo().getKind();
+            int64_t L = eval(E->getLeft());
+            if (Kind == tok::kw_AND)
+                return L ? eval(E->getRight()) : 0;
+            if (Kind == tok::kw_OR)
+                return L ? 1 : eval(E->getRight());
+            int64_t R = eval(E->getRight());
+            switch (Kind) {
+                case tok::plus:
+                    return vm::addWrap(L, R);
+                case tok::minus:
+                    return vm::subWrap(L, R);
+                case tok::star:
+                    return vm::mulWrap(L, R);
+                case tok::slash:
+                case tok::kw_DIV:
+                case tok::kw_MOD:
+                    if (R == 0) {
+                        Error = "division by zero";
+                        return 0;
+                    }
+                    return Kind == tok::kw_MOD ? vm::modWrap(L, R) : vm::divWrap(L, R);
+                case tok::equal:
+                    return L == R;
+                case tok::hash:
+                    return L != R;
+                case tok::less:
+                    return L < R;
+                case tok::lessequal:
+                    return L <= R;
+                case tok::greater:
+                    return L > R;
+                case tok::greaterequal:
+                    return L >= R;
+                default:
+                    llvm_unreachable("Wrong operator");
+            }
+        }
+
+        int64_t eval(Expr *E) {
+            if (auto *Infix = llvm::dyn_cast<InfixExpression>(E))
+                return evalInfix(Infix);
+            if (auto *Prefix = llvm::dyn_cast<PrefixExpression>(E)) {
+                int64_t Val = eval(Prefix->getExpr());
+                switch (Prefix->getOperatorInfo().getKind()) {
+                    case tok::minus:
+                        return vm::subWrap(0, Val);
+                    case tok::kw_NOT:
+                        return !Val;
+                    default:
+                        return Val;
+                }
+            }
+            if (auto *Var = llvm::dyn_cast<VariableAccess>(E))
+                return *lookup(Var->getDecl());
+            if (auto *Const = llvm::dyn_cast<ConstantAccess>(E))
+                return eval(Const->getDecl()->getExpr());
+            if (auto *IntLit = llvm::dyn_cast<IntegerLiteral>(E))
+                return IntLit->isSmall() ? IntLit->getSmallValue()
+                                         : static_cast<int64_t>(IntLit->getValue().zextOrTrunc(64).getZExtValue());
+            if (auto *BoolLit = llvm::dyn_cast<BooleanLiteral>(E))
+                return BoolLit->getValue();
+            auto *Call = llvm::cast<FunctionCallExpr>(E);
+            return call(Call->getDecl(), Call->getParams());
+        }
+
+        void exec(ArrayRef<Stmt *> Stmts) {
+            for (Stmt *S : Stmts) {
+                if (Returning || Error)
+                    return;
+                if (auto *Assign = llvm::dyn_cast<AssignmentStatement>(S)) {
+                    int64_t Val = eval(Assign->getExpr());
+                    *lookup(Assign->getVar()) = Val;
+                } else if (auto *Call = llvm::dyn_cast<ProcedureCallStatement>(S)) {
+                    call(Call->getProc(), Call->getParams());
+                } else if (auto *If = llvm::dyn_cast<IfStatement>(S)) {
+                    exec(eval(If->getCond()) ? If->getIfStmts() : If->getElseStmts());
+                } else if (auto *While = llvm::dyn_cast<WhileStatement>(S)) {
+                    while (!Returning && !Error && eval(While->getCond()))
+                        exec(While->getWhileStmts());
+                } else if (auto *Return = llvm::dyn_cast<ReturnStatement>(S)) {
+                    RetVal = Return->getRetVal() ? eval(Return->getRetVal()) : 0;
+                    Returning = true;
+                }
+            }
+        }
+
+    public:
+        // Returns the runtime error, or nullptr.
+        const char *run(ModuleDeclaration *Mod) {
+            exec(Mod->getStmts());
+            return Error;
+        }
+
+        int64_t getGlobal(Decl *D) { return Globals[D]; }
+    };
+
+    double msSince(std::chrono::steady_clock::time_point Start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+    }
+}
+
+// Runs the module with both interpreters. Returns false if the module has
+// errors or the interpreters disagree.
+static bool benchmark(std::unique_ptr<llvm::MemoryBuffer> Buffer) {
+    std::string Name = Buffer->getBufferIdentifier().str();
+    llvm::SourceMgr SrcMgr;
+    DiagnosticEngine Diags(SrcMgr);
+    SrcMgr.AddNewSourceBuffer(std::move(Buffer), llvm::SMLoc());
+    IdentifierTable Idents;
+    ASTContext Context;
+    Lexer Lex(SrcMgr, Diags, Idents);
+    Sema Actions(Context, Diags, Idents);
+    Parser P(Lex, Actions);
+    ModuleDeclaration *Mod = P.parse();
+    Diags.flush();
+    if (!Mod || Diags.numErrors())
+        return false;
+
+    std::vector<double> WalkTimes, VMTimes;
+    bool Same = true;
+    for (unsigned I = 0; I < std::max(1u, unsigned(Iterations)); ++I) {
+        ASTWalker Walker;
+        auto Start = std::chrono::steady_clock::now();
+        const char *WalkError = Walker.run(Mod);
+        WalkTimes.push_back(msSince(Start));
+
+        // Like --interpret, the time includes the compilation to bytecode.
+        Start = std::chrono::steady_clock::now();
+        std::unique_ptr<vm::Program> Program = vm::BytecodeCompiler::compile(Mod);
+        vm::Interpreter Interp(*Program);
+        llvm::Error VMError = Interp.run();
+        VMTimes.push_back(msSince(Start));
+
+        Same &= !WalkError == !VMError;
+        llvm::consumeError(std::move(VMError));
+        for (auto &G : Program->GlobalIndex)
+            Same &= Walker.getGlobal(G.first) == Interp.getGlobals()[G.second];
+    }
+    std::sort(WalkTimes.begin(), WalkTimes.end());
+    std::sort(VMTimes.begin(), VMTimes.end());
+    double Walk = WalkTimes[WalkTimes.size() / 2];
+    double VM = VMTimes[VMTimes.size() / 2];
+    llvm::outs() << llvm::format("%-12s AST walker %9.1f ms, bytecode %8.1f ms, %5.1fx%s\n",
+                                 Name.c_str(), Walk, VM, Walk / VM,
+                                 Same ? "" : ", DIFFERENT RESULTS");
+    return Same;
+}
+
+int main(int argc_, const char **argv_) {
+    llvm::InitLLVM X(argc_, argv_);
+    llvm::cl::ParseCommandLineOptions(argc_, argv_, "tinylang interpreter benchmark\n");
+
+    llvm::outs() << "median of " << std::max(1u, unsigned(Iterations)) << " runs\n";
+    bool Ok = true;
+    if (InputFiles.empty()) {
+        for (const auto &Program : Programs)
+            Ok &= benchmark(llvm::MemoryBuffer::getMemBuffer(Program[1], Program[0]));
+    }
+    for (const std::string &F : InputFiles) {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr = llvm::MemoryBuffer::getFile(F);
+        if (std::error_code BufferError = FileOrErr.getError()) {
+            llvm::errs() << "Error reading " << F << ": " << BufferError.message() << "\n";
+            return 1;
+        }
+        Ok &= benchmark(std::move(*FileOrErr));
+    }
+    return Ok ? 0 : 1;
+}
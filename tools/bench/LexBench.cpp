@@ -0,0 +1,125 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+// Measures the throughput of Lexer::next on a generated module with long
+// runs of indentation, blank lines and banner comments, or on the given
+// file. Each iteration lexes the whole buffer with a fresh Lexer.
+
+#include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/IdentifierTable.h"
+#include "tinylang/Lexer/Lexer.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace tinylang;
+
+static llvm::cl::opt<std::string> InputFile(llvm::cl::Positional,
+                                            llvm::cl::desc("[input-file]"),
+                                            llvm::cl::init(""));
+
+static llvm::cl::opt<unsigned> SizeMB(
+        "size",
+        llvm::cl::desc("Size of the generated module in MB"),
+        llvm::cl::init(32));
+
+static llvm::cl::opt<unsigned> Iterations(
+        "iterations",
+        llvm::cl::desc("Number of times the buffer is lexed"),
+        llvm::cl::init(5));
+
+static llvm::cl::opt<std::string> OutputFile(
+        "o",
+        llvm::cl::desc("Write the generated module to this file"),
+        llvm::cl::value_desc("file"),
+        llvm::cl::init(""));
+
+// Four kinds of blocks, each with mostly white space and comment bodies,
+// and a few statements in between.
+static std::string generate(size_t Size) {
+    const std::string Banner = "(*" + std::string(72, '*') + "*)\n";
+    std::string Buf = "MODULE LexBench;\n\nVAR x : INTEGER;\n\nBEGIN\n";
+    for (unsigned Block = 0; Buf.size() < Size; ++Block) {
+        switch (Block % 4) {
+            case 0:
+                Buf += Banner;
+                Buf += "(* Block " + std::to_string(Block) + " (* with a nested comment *) *)\n";
+                Buf += Banner;
+                break;
+            case 1:
+                Buf += std::string(Block % 48 + 8, ' ') + "x := x + " + std::to_string(Block) + ";\n";
+                break;
+            case 2:
+                Buf += "\t\t\t\t" + std::string(16, ' ') + "(*" + std::string(40, ' ') + "*)\n\n\n";
+                break;
+            case 3:
+                Buf += std::string(32, ' ') + "x := x - 1;   \t   (* trailing comment *)\n";
+                break;
+        }
+    }
+    Buf += "    x := 0\nEND LexBench.\n";
+    return Buf;
+}
+
+int main(int argc_, const char **argv_) {
+    llvm::InitLLVM X(argc_, argv_);
+    llvm::cl::ParseCommandLineOptions(argc_, argv_, "tinylang lexer benchmark\n");
+
+    std::unique_ptr<llvm::MemoryBuffer> Buffer;
+    if (InputFile.empty()) {
+        Buffer = llvm::MemoryBuffer::getMemBufferCopy(generate(size_t(SizeMB) << 20), "LexBench.mod");
+        if (!OutputFile.empty()) {
+            std::error_code EC;
+            llvm::raw_fd_ostream Out(OutputFile, EC, llvm::sys::fs::OF_None);
+            if (EC) {
+                llvm::errs() << "Error writing " << OutputFile << ": " << EC.message() << "\n";
+                return 1;
+            }
+            Out << Buffer->getBuffer();
+        }
+    } else {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr = llvm::MemoryBuffer::getFile(InputFile);
+        if (std::error_code BufferError = FileOrErr.getError()) {
+            llvm::errs() << "Error reading " << InputFile << ": " << BufferError.message() << "\n";
+            return 1;
+        }
+        Buffer = std::move(*FileOrErr);
+    }
+    double MB = static_cast<double>(Buffer->getBufferSize()) / (1 << 20);
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(std::move(Buffer), llvm::SMLoc());
+
+    std::vector<double> Times;
+    size_t NumTokens = 0;
+    for (unsigned I = 0; I < std::max(1u, unsigned(Iterations)); ++I) {
+        DiagnosticEngine Diags(SrcMgr);
+        IdentifierTable Idents;
+        Lexer Lex(SrcMgr, Diags, Idents);
+        Token Tok;
+        NumTokens = 0;
+        auto Start = std::chrono::steady_clock::now();
+        do {
+            Lex.next(Tok);
+            ++NumTokens;
+        } while (!Tok.is(tok::eof));
+        Times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count());
+        // The diagnostics are the same every time.
+        if (I == 0)
+            Diags.flush();
+    }
+
+    std::sort(Times.begin(), Times.end());
+    double Median = Times[Times.size() / 2];
+    llvm::outs() << llvm::format("%.1f MB, %zu tokens, %zu iterations\n", MB, NumTokens, Times.size())
+                 << llvm::format("best %.2f ms, median %.2f ms, %.1f MB/s\n", Times.front(), Median,
+                                 MB * 1000 / Median);
+    return 0;
+}
@@ -0,0 +1,156 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+// Measures the parser on a generated module of expression-heavy
+// statements, or on the given file. The buffer is lexed into a
+// TokenStream first, so each iteration times only Parser::parse and the
+// actions of Sema, like the Parse timer of the driver with --prelex.
+
+#include "tinylang/AST/ASTContext.h"
+#include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/IdentifierTable.h"
+#include "tinylang/Lexer/Lexer.h"
+#include "tinylang/Lexer/TokenStream.h"
+#include "tinylang/Parser/Parser.h"
+#include "tinylang/Sema/Sema.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace tinylang;
+
+static llvm::cl::opt<std::string> InputFile(llvm::cl::Positional,
+                                            llvm::cl::desc("[input-file]"),
+                                            llvm::cl::init(""));
+
+static llvm::cl::opt<unsigned> SizeMB(
+        "size",
+        llvm::cl::desc("Size of the generated module in MB"),
+        llvm::cl::init(50));
+
+static llvm::cl::opt<unsigned> Iterations(
+        "iterations",
+        llvm::cl::desc("Number of times the tokens are parsed"),
+        llvm::cl::init(5));
+
+static llvm::cl::opt<std::string> OutputFile(
+        "o",
+        llvm::cl::desc("Write the generated module to this file"),
+        llvm::cl::value_desc("file"),
+        llvm::cl::init(""));
+
+// Procedures of about 64 KB each, whose statements are mostly long
+// expressions with every precedence level, calls and parentheses. The
+// module is free of errors, so that no time goes to diagnostics.
+static std::string generate(size_t Size) {
+    std::string Buf = "MODULE ParseBench;\n\n"
+                      "VAR a, b, c, d: INTEGER;\n"
+                      "    p, q: BOOLEAN;\n\n"
+                      "PROCEDURE F(x: INTEGER): INTEGER;\n"
+                      "BEGIN\n"
+                      "    RETURN x * 2\n"
+                      "END F;\n\n";
+    for (unsigned Proc = 0; Buf.size() < Size; ++Proc) {
+        std::string Name = "P";
+        Name += std::to_string(Proc);
+        Buf += "PROCEDURE " + Name + "(VAR x: INTEGER; y: INTEGER);\n";
+        Buf += "VAR t: INTEGER;\nBEGIN\n";
+        size_t End = Buf.size() + (64 << 10);
+        for (unsigned Stmt = 0; Buf.size() < End; ++Stmt) {
+            std::string N = std::to_string(Stmt % 997 + 1);
+            switch (Stmt % 5) {
+                case 0:
+                    Buf += "    t := (a + " + N + ") * (b - c) DIV (d + 1) + F(x MOD " + N + ") - y;\n";
+                    break;
+                case 1:
+                    Buf += "    x := a * b + c * d - (a + b) * (c - d) + " + N + " * y MOD 7;\n";
+                    break;
+                case 2:
+                    Buf += "    IF (a < b) AND (c # d) OR NOT p AND (x >= " + N + ") THEN\n"
+                           "        y := F(a) - (x + y) * t\n"
+                           "    ELSE\n"
+                           "        t := F(F(x) + F(y)) DIV " + N + "\n"
+                           "    END;\n";
+                    break;
+                case 3:
+                    Buf += "    WHILE (t > " + N + ") AND q DO\n"
+                           "        t := t - (a + b + c + d) DIV " + N + " - 1\n"
+                           "    END;\n";
+                    break;
+                case 4:
+                    Buf += "    p := (a + b = c - d) OR (x * y < t + " + N + ");\n";
+                    break;
+            }
+        }
+        Buf += "    x := t\nEND " + Name + ";\n\n";
+    }
+    Buf += "BEGIN\n    a := 1\nEND ParseBench.\n";
+    return Buf;
+}
+
+int main(int argc_, const char **argv_) {
+    llvm::InitLLVM X(argc_, argv_);
+    llvm::cl::ParseCommandLineOptions(argc_, argv_, "tinylang parser benchmark\n");
+
+    std::unique_ptr<llvm::MemoryBuffer> Buffer;
+    if (InputFile.empty()) {
+        Buffer = llvm::MemoryBuffer::getMemBufferCopy(generate(size_t(SizeMB) << 20), "ParseBench.mod");
+        if (!OutputFile.empty()) {
+            std::error_code EC;
+            llvm::raw_fd_ostream Out(OutputFile, EC, llvm::sys::fs::OF_None);
+            if (EC) {
+                llvm::errs() << "Error writing " << OutputFile << ": " << EC.message() << "\n";
+                return 1;
+            }
+            Out << Buffer->getBuffer();
+        }
+    } else {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr = llvm::MemoryBuffer::getFile(InputFile);
+        if (std::error_code BufferError = FileOrErr.getError()) {
+            llvm::errs() << "Error reading " << InputFile << ": " << BufferError.message() << "\n";
+            return 1;
+        }
+        Buffer = std::move(*FileOrErr);
+    }
+    double MB = static_cast<double>(Buffer->getBufferSize()) / (1 << 20);
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(std::move(Buffer), llvm::SMLoc());
+
+    std::vector<double> Times;
+    size_t NumTokens = 0;
+    for (unsigned I = 0; I < std::max(1u, unsigned(Iterations)); ++I) {
+        DiagnosticEngine Diags(SrcMgr);
+        IdentifierTable Idents;
+        ASTContext Context;
+        Lexer Lex(SrcMgr, Diags, Idents);
+        Sema Actions(Context, Diags, Idents);
+        TokenStream Tokens(Lex.getBuffer());
+        Lex.lex(Tokens);
+        NumTokens = Tokens.size();
+        auto Start = std::chrono::steady_clock::now();
+        Parser P(Lex, Tokens, Actions);
+        ModuleDeclaration *Mod = P.parse();
+        Times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count());
+        // The diagnostics are the same every time.
+        if (I == 0) {
+            Diags.flush();
+            if (!Mod || Diags.numErrors())
+                llvm::errs() << "The module has errors, the recovery paths are timed as well\n";
+        }
+    }
+
+    std::sort(Times.begin(), Times.end());
+    double Median = Times[Times.size() / 2];
+    llvm::outs() << llvm::format("%.1f MB, %zu tokens, %zu iterations\n", MB, NumTokens, Times.size())
+                 << llvm::format("best %.2f ms, median %.2f ms, %.1f MB/s\n", Times.front(), Median,
+                                 MB * 1000 / Median);
+    return 0;
+}
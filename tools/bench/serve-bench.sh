@@ -0,0 +1,76 @@
+#!/bin/sh
+#
+# Created by jewoo on 2021-06-28.
+#
+
+# Compiles each file once with a new tinylang process (cold) and once
+# through tinylang-client and a server started with --serve (warm), and
+# prints the mean and median latency per file. The corpus is compiled
+# ROUNDS times (default 3) with FLAGS (default "-O0 -filetype=obj").
+#
+# Usage: serve-bench.sh <build-dir> <file.mod>...
+
+set -e
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <build-dir> <file.mod>..." >&2
+    exit 1
+fi
+BUILD=$1
+shift
+TINYLANG=$BUILD/tools/driver/tinylang
+CLIENT=$BUILD/tools/client/tinylang-client
+FLAGS=${FLAGS:--O0 -filetype=obj}
+ROUNDS=${ROUNDS:-3}
+for Tool in "$TINYLANG" "$CLIENT"; do
+    if [ ! -x "$Tool" ]; then
+        echo "$0: $Tool not found" >&2
+        exit 1
+    fi
+done
+
+TMP=$(mktemp -d)
+SOCKET=$TMP/tinylang.sock
+"$TINYLANG" --serve="$SOCKET" 2>"$TMP/server.log" &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null; rm -rf "$TMP"' EXIT INT TERM
+while [ ! -S "$SOCKET" ]; do
+    if ! kill -0 $SERVER 2>/dev/null; then
+        cat "$TMP/server.log" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+# The first request is not counted.
+"$CLIENT" "$SOCKET" $FLAGS "$1" >/dev/null
+
+now_ns() {
+    date +%s%N
+}
+
+# Runs the command given in the arguments on every file, one process per
+# file, and prints the mean and median latency in ms. A failed compile
+# stops the benchmark, as it would time the diagnostics instead.
+measure() {
+    : >"$TMP/times"
+    for File in $FILES; do
+        Start=$(now_ns)
+        if ! "$@" "$File" >/dev/null; then
+            echo "$0: $* $File failed" >&2
+            exit 1
+        fi
+        echo $(( $(now_ns) - Start )) >>"$TMP/times"
+    done
+    sort -n "$TMP/times" | awk '{ T[NR] = $1; Sum += $1 }
+        END { printf "mean %8.2f ms  median %8.2f ms", Sum / NR / 1e6, T[int((NR + 1) / 2)] / 1e6 }'
+}
+
+FILES="$*"
+echo "$# files, $FLAGS"
+Round=1
+while [ $Round -le "$ROUNDS" ]; do
+    Cold=$(measure "$TINYLANG" $FLAGS)
+    Warm=$(measure "$CLIENT" "$SOCKET" $FLAGS)
+    echo "round $Round  cold: $Cold  |  warm: $Warm"
+    Round=$((Round + 1))
+done
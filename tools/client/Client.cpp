@@ -0,0 +1,103 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+// A thin client for `tinylang --serve`. It forwards its arguments to the
+// server and copies the output back, so a compile costs no process start
+// of the compiler. It does not link LLVM, so it starts quickly itself.
+
+#include "tinylang/Basic/ServerProtocol.h"
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <vector>
+
+using namespace tinylang;
+
+namespace {
+    bool writeString(int FD, const char *Str) {
+        uint32_t Size = std::strlen(Str);
+        return server::writeAll(FD, &Size, sizeof(Size)) &&
+               server::writeAll(FD, Str, Size);
+    }
+
+    int connectTo(const char *Path) {
+        sockaddr_un Addr{};
+        Addr.sun_family = AF_UNIX;
+        if (std::strlen(Path) >= sizeof(Addr.sun_path)) {
+            std::fprintf(stderr, "tinylang-client: socket path too long: %s\n", Path);
+            return -1;
+        }
+        std::strcpy(Addr.sun_path, Path);
+        int FD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (FD < 0 || ::connect(FD, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) < 0) {
+            std::fprintf(stderr, "tinylang-client: cannot connect to %s: %s\n", Path, std::strerror(errno));
+            if (FD >= 0)
+                ::close(FD);
+            return -1;
+        }
+        return FD;
+    }
+}
+
+int main(int argc, const char **argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: tinylang-client <socket> [tinylang options] <input-files>\n");
+        return 1;
+    }
+    int FD = connectTo(argv[1]);
+    if (FD < 0)
+        return 1;
+
+    char Cwd[PATH_MAX];
+    if (!::getcwd(Cwd, sizeof(Cwd))) {
+        std::fprintf(stderr, "tinylang-client: cannot get the working directory\n");
+        return 1;
+    }
+
+    // The server sees the arguments as if it had been started with them.
+    server::RequestHeader Header;
+    Header.Flags = ::isatty(2) ? static_cast<uint32_t>(server::ColorsFlag) : 0u;
+    Header.NumStrings = argc;
+    bool Sent = server::writeAll(FD, &Header, sizeof(Header)) &&
+                writeString(FD, Cwd) && writeString(FD, "tinylang");
+    for (int I = 2; Sent && I < argc; ++I)
+        Sent = writeString(FD, argv[I]);
+    if (!Sent) {
+        std::fprintf(stderr, "tinylang-client: cannot send the request\n");
+        return 1;
+    }
+
+    std::vector<char> Payload;
+    for (;;) {
+        char FrameHeader[server::FrameHeaderSize];
+        uint32_t Size;
+        if (!server::readAll(FD, FrameHeader, sizeof(FrameHeader)))
+            break;
+        std::memcpy(&Size, FrameHeader + 1, sizeof(Size));
+        Payload.resize(Size);
+        if (!server::readAll(FD, Payload.data(), Size))
+            break;
+        switch (FrameHeader[0]) {
+            case server::Stdout:
+                server::writeAll(1, Payload.data(), Size);
+                break;
+            case server::Stderr:
+                server::writeAll(2, Payload.data(), Size);
+                break;
+            case server::Exit: {
+                int32_t Code = 1;
+                if (Size == sizeof(Code))
+                    std::memcpy(&Code, Payload.data(), sizeof(Code));
+                return Code;
+            }
+            default:
+                break;
+        }
+    }
+    std::fprintf(stderr, "tinylang-client: the server closed the connection\n");
+    return 1;
+}
@@ -3,32 +3,844 @@
 //
 
 #include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/TimeReport.h"
 #include "tinylang/Basic/Version.h"
+#include "tinylang/CodeGen/CodeGen.h"
+#include "tinylang/JIT/JIT.h"
+#include "tinylang/JIT/TieredEngine.h"
 #include "tinylang/Parser/Parser.h"
+#include "tinylang/VM/BytecodeCompiler.h"
+#include "tinylang/VM/Interpreter.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/CodeGen/CommandFlags.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Host.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/WithColor.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <array>
+#include <chrono>
+#include <mutex>
+
+#if LLVM_ON_UNIX
+#include "tinylang/Basic/ServerProtocol.h"
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
 using namespace tinylang;
 
-int main(int argc_, const char **argv_) {
-    llvm::InitLLVM X(argc_, argv_);
-    llvm::SmallVector<const char *, 256> argv(argv_ + 1, argv_ + argc_);
+static llvm::cl::list<std::string> InputFiles(llvm::cl::Positional,
+                                              llvm::cl::desc("<input-files>"));
 
-    llvm::outs() << "Tinylang " << tinylang::getTinylangVersion() << "\n";
+static llvm::cl::opt<bool> PreLex(
+        "prelex",
+        llvm::cl::desc("Lex each input file completely before parsing it"));
 
-    for (const char *F :argv) {
-        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr = llvm::MemoryBuffer::getFile(F);
-        if (std::error_code BufferError = FileOrErr.getError()) {
-            llvm::errs() << "Error reading " << F << ": " << BufferError.message() << "\n";
-            continue;
+static llvm::cl::opt<unsigned> LexThreads(
+        "lex-threads",
+        llvm::cl::desc("Number of threads for lexing large files (implies -prelex)"),
+        llvm::cl::init(1));
+
+static llvm::cl::opt<unsigned> Jobs(
+        "j",
+        llvm::cl::desc("Number of input files to compile in parallel (0 for all cores)"),
+        llvm::cl::value_desc("N"),
+        llvm::cl::Prefix,
+        llvm::cl::init(1));
+
+static llvm::cl::opt<std::string> MTriple(
+        "mtriple",
+        llvm::cl::desc("Override target triple for module"));
+
+static llvm::cl::opt<bool> EmitLLVM(
+        "emit-llvm",
+        llvm::cl::desc("Emit IR code instead of assembler"),
+        llvm::cl::init(false));
+
+// Positive values are the usual levels, negative ones optimize for size.
+static llvm::cl::opt<signed char> OptLevel(
+        llvm::cl::desc("Setting the optimization level:"),
+        llvm::cl::ZeroOrMore,
+        llvm::cl::values(
+                clEnumValN(3, "O", "Equivalent to -O3"),
+                clEnumValN(0, "O0", "Optimization level 0"),
+                clEnumValN(1, "O1", "Optimization level 1"),
+                clEnumValN(2, "O2", "Optimization level 2"),
+                clEnumValN(3, "O3", "Optimization level 3"),
+                clEnumValN(-1, "Os", "Like -O2 with extra optimizations for size")),
+        llvm::cl::init(0));
+
+static llvm::cl::opt<bool> Run(
+        "run",
+        llvm::cl::desc("Run the module body with the JIT instead of writing a file"),
+        llvm::cl::init(false));
+
+static llvm::cl::opt<bool> Lazy(
+        "lazy",
+        llvm::cl::desc("With --run, generate and compile each procedure on its first call"),
+        llvm::cl::init(false));
+
+static llvm::cl::opt<bool> Speculate(
+        "speculate",
+        llvm::cl::desc("With --lazy, compile the callees of a procedure in the background"),
+        llvm::cl::init(false));
+
+static llvm::cl::opt<bool> Interpret(
+        "interpret",
+        llvm::cl::desc("Run the module body with the bytecode interpreter instead of writing a file"),
+        llvm::cl::init(false));
+
+static llvm::cl::opt<bool> Tiered(
+        "tiered",
+        llvm::cl::desc("Run the module body with the interpreter and compile hot procedures in the background"),
+        llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned> TierThreshold(
+        "tier-threshold",
+        llvm::cl::desc("Number of calls and loop iterations after which --tiered compiles a procedure"),
+        llvm::cl::init(1000));
+
+static llvm::cl::opt<unsigned> ErrorLimit(
+        "ferror-limit",
+        llvm::cl::desc("Stop after this many errors in a file (0 = no limit)"),
+        llvm::cl::init(20));
+
+static llvm::cl::opt<bool> PrintTimeReport(
+        "ftime-report",
+        llvm::cl::desc("Print the time spent in each phase and by the slowest procedures. Implies -prelex"),
+        llvm::cl::init(false));
+
+static llvm::cl::opt<std::string> TimeTraceFile(
+        "ftime-trace",
+        llvm::cl::desc("Write the time spent in each phase and procedure as a Chrome trace"),
+        llvm::cl::value_desc("file"),
+        llvm::cl::init(""));
+
+static llvm::cl::opt<unsigned> TimeTraceGranularity(
+        "ftime-trace-granularity",
+        llvm::cl::desc("Minimum time in microseconds of a scope written to the trace"),
+        llvm::cl::init(0));
+
+static llvm::cl::opt<bool> PrintMemReport(
+        "fmem-report",
+        llvm::cl::desc("Print the memory used by each phase, the AST nodes and the symbol tables"),
+        llvm::cl::init(false));
+
+static llvm::cl::opt<std::string> Serve(
+        "serve",
+        llvm::cl::desc("Keep running and compile the requests of tinylang-client on a Unix domain socket"),
+        llvm::cl::value_desc("socket"));
+
+static llvm::codegen::RegisterCodeGenFlags CGF;
+
+static llvm::OptimizationLevel getOptimizationLevel() {
+    switch (OptLevel) {
+        case 0:
+            return llvm::OptimizationLevel::O0;
+        case 1:
+            return llvm::OptimizationLevel::O1;
+        case 2:
+            return llvm::OptimizationLevel::O2;
+        case -1:
+            return llvm::OptimizationLevel::Os;
+        default:
+            return llvm::OptimizationLevel::O3;
+    }
+}
+
+static llvm::CodeGenOpt::Level getCodeGenOptLevel() {
+    switch (OptLevel) {
+        case 0:
+            return llvm::CodeGenOpt::None;
+        case 1:
+            return llvm::CodeGenOpt::Less;
+        case 3:
+            return llvm::CodeGenOpt::Aggressive;
+        default:
+            return llvm::CodeGenOpt::Default;
+    }
+}
+
+// The target machine is created once and shared by all input files, or
+// once per worker with -j. Without -mcpu, code is generated for the CPU of
+// the host.
+static llvm::TargetMachine *createTargetMachine(const char *Argv0, llvm::raw_ostream &Errs) {
+    llvm::Triple Triple = llvm::Triple(
+            !MTriple.empty()
+            ? llvm::Triple::normalize(MTriple)
+            : llvm::sys::getDefaultTargetTriple());
+
+    llvm::TargetOptions TargetOptions =
+            llvm::codegen::InitTargetOptionsFromCodeGenFlags(Triple);
+    std::string CPUStr = llvm::codegen::getCPUStr();
+    std::string FeatureStr = llvm::codegen::getFeaturesStr();
+    if (llvm::codegen::getMCPU().empty() && MTriple.empty()) {
+        CPUStr = llvm::sys::getHostCPUName().str();
+        llvm::SubtargetFeatures Features;
+        llvm::StringMap<bool> HostFeatures;
+        if (llvm::sys::getHostCPUFeatures(HostFeatures))
+            for (auto &F : HostFeatures)
+                Features.AddFeature(F.first(), F.second);
+        for (const std::string &Attr : llvm::codegen::getMAttrs())
+            Features.AddFeature(Attr);
+        FeatureStr = Features.getString();
+    }
+
+    std::string Error;
+    const llvm::Target *Target = llvm::TargetRegistry::lookupTarget(
+            llvm::codegen::getMArch(), Triple, Error);
+    if (!Target) {
+        llvm::WithColor::error(Errs, Argv0) << Error << "\n";
+        return nullptr;
+    }
+
+    // Default to PIC, so the objects link into position independent
+    // executables, which most hosts build by default.
+    llvm::Optional<llvm::Reloc::Model> RM = llvm::codegen::getExplicitRelocModel();
+    if (!RM)
+        RM = llvm::Reloc::PIC_;
+    llvm::TargetMachine *TM = Target->createTargetMachine(
+            Triple.getTriple(), CPUStr, FeatureStr, TargetOptions, RM,
+            llvm::codegen::getExplicitCodeModel(), getCodeGenOptLevel());
+    // -O0 is for quick edit-compile cycles, so select instructions fast.
+    TM->setO0WantsFastISel(true);
+    return TM;
+}
+
+static void optimize(llvm::TargetMachine *TM, llvm::Module *M) {
+    llvm::OptimizationLevel Level = getOptimizationLevel();
+
+    llvm::PipelineTuningOptions PTO;
+    bool Vectorize = Level == llvm::OptimizationLevel::O2 ||
+                     Level == llvm::OptimizationLevel::O3;
+    PTO.LoopUnrolling = Level != llvm::OptimizationLevel::Os;
+    PTO.LoopInterleaving = Vectorize;
+    PTO.LoopVectorization = Vectorize;
+    PTO.SLPVectorization = Vectorize;
+    llvm::PassBuilder PB(TM, PTO);
+
+    llvm::LoopAnalysisManager LAM;
+    llvm::FunctionAnalysisManager FAM;
+    llvm::CGSCCAnalysisManager CGAM;
+    llvm::ModuleAnalysisManager MAM;
+
+    FAM.registerPass([&] { return PB.buildDefaultAAPipeline(); });
+
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    llvm::ModulePassManager MPM;
+    if (Level == llvm::OptimizationLevel::O0)
+        MPM = PB.buildO0DefaultPipeline(Level);
+    else
+        MPM = PB.buildPerModuleDefaultPipeline(Level);
+    MPM.run(*M, MAM);
+}
+
+static bool emit(StringRef Argv0, llvm::Module *M, llvm::TargetMachine *TM,
+                 StringRef InputFilename, llvm::raw_ostream &Errs) {
+    llvm::CodeGenFileType FileType = llvm::codegen::getFileType();
+    llvm::SmallString<128> OutputFilename(InputFilename);
+    switch (FileType) {
+        case llvm::CGFT_AssemblyFile:
+            llvm::sys::path::replace_extension(OutputFilename, EmitLLVM ? "ll" : "s");
+            break;
+        case llvm::CGFT_ObjectFile:
+            llvm::sys::path::replace_extension(OutputFilename, EmitLLVM ? "bc" : "o");
+            break;
+        case llvm::CGFT_Null:
+            llvm::sys::path::replace_extension(OutputFilename, "null");
+            break;
+    }
+
+    std::error_code EC;
+    llvm::sys::fs::OpenFlags OpenFlags = llvm::sys::fs::OF_None;
+    if (FileType == llvm::CGFT_AssemblyFile)
+        OpenFlags |= llvm::sys::fs::OF_Text;
+    auto Out = std::make_unique<llvm::ToolOutputFile>(OutputFilename, EC, OpenFlags);
+    if (EC) {
+        llvm::WithColor::error(Errs, Argv0) << EC.message() << "\n";
+        return false;
+    }
+
+    if (EmitLLVM) {
+        if (FileType == llvm::CGFT_AssemblyFile)
+            M->print(Out->os(), nullptr);
+        else
+            llvm::WriteBitcodeToFile(*M, Out->os());
+    } else {
+        llvm::legacy::PassManager CodeGenPM;
+        CodeGenPM.add(llvm::createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
+        if (TM->addPassesToEmitFile(CodeGenPM, Out->os(), nullptr, FileType)) {
+            llvm::WithColor::error(Errs, Argv0)
+                    << "No support for file type\n";
+            return false;
         }
-        llvm::SourceMgr SrcMgr;
-        DiagnosticEngine Diags(SrcMgr);
-        SrcMgr.AddNewSourceBuffer(std::move(*FileOrErr), llvm::SMLoc());
+        CodeGenPM.run(*M);
+    }
+    Out->keep();
+    return true;
+}
 
-        auto lexer = Lexer(SrcMgr, Diags);
-        auto sema = Sema(Diags);
+static double msSince(std::chrono::steady_clock::time_point Start) {
+    return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - Start).count();
+}
+
+// Adds the module to the JIT and calls the module body.
+static bool runJIT(StringRef Argv0, JIT &J, ModuleDeclaration *Mod, StringRef FileName, llvm::raw_ostream &Errs) {
+    auto Start = std::chrono::steady_clock::now();
+    auto Init = J.add(Mod, FileName);
+    if (!Init) {
+        llvm::WithColor::error(Errs, Argv0) << toString(Init.takeError()) << "\n";
+        return false;
+    }
+    double CompileTime = msSince(Start);
+
+    Start = std::chrono::steady_clock::now();
+    llvm::Error Err = JIT::runNative([MainFn = *Init] {
+        MainFn();
+        return llvm::Error::success();
+    });
+    double ExecTime = msSince(Start);
+    // Background compilation still refers to the AST.
+    J.waitForCompiles();
+    if (Err) {
+        llvm::WithColor::error(Errs, Argv0) << FileName << ": " << toString(std::move(Err)) << "\n";
+        return false;
+    }
+
+    Errs << llvm::format("%s: compile %.3f ms, execution %.3f ms\n",
+                                 FileName.str().c_str(), CompileTime, ExecTime);
+    return true;
+}
+
+// Compiles the module to bytecode and interprets the module body.
+static bool runInterpreter(StringRef Argv0, ModuleDeclaration *Mod, StringRef FileName, llvm::raw_ostream &Errs) {
+    auto Start = std::chrono::steady_clock::now();
+    std::unique_ptr<vm::Program> P = vm::BytecodeCompiler::compile(Mod);
+    vm::Interpreter Interp(*P);
+    double CompileTime = msSince(Start);
+
+    Start = std::chrono::steady_clock::now();
+    llvm::Error Err = Interp.run();
+    double ExecTime = msSince(Start);
+    if (Err) {
+        llvm::WithColor::error(Errs, Argv0) << FileName << ": " << toString(std::move(Err)) << "\n";
+        return false;
+    }
+
+    Errs << llvm::format("%s: compile %.3f ms, execution %.3f ms\n",
+                                 FileName.str().c_str(), CompileTime, ExecTime);
+    return true;
+}
+
+// Interprets the module body and moves hot procedures to native code.
+static bool runTiered(StringRef Argv0, JIT &J, ModuleDeclaration *Mod, StringRef FileName, llvm::raw_ostream &Errs) {
+    auto Start = std::chrono::steady_clock::now();
+    auto Engine = TieredEngine::create(J, Mod, FileName, TierThreshold);
+    if (!Engine) {
+        llvm::WithColor::error(Errs, Argv0) << toString(Engine.takeError()) << "\n";
+        return false;
+    }
+    double CompileTime = msSince(Start);
+
+    Start = std::chrono::steady_clock::now();
+    llvm::Error Err = (*Engine)->run();
+    double ExecTime = msSince(Start);
+    if (Err) {
+        llvm::WithColor::error(Errs, Argv0) << FileName << ": " << toString(std::move(Err)) << "\n";
+        return false;
+    }
+
+    Errs << llvm::format("%s: compile %.3f ms, execution %.3f ms, %u procedures compiled\n",
+                                 FileName.str().c_str(), CompileTime, ExecTime,
+                                 (*Engine)->getNumCompiled());
+    return true;
+}
+
+static void printDiagnostic(const llvm::SMDiagnostic &Diag, void *Context) {
+    Diag.print(nullptr, *static_cast<llvm::raw_ostream *>(Context));
+}
+
+// Records the AST nodes and the symbol tables of a file for -fmem-report.
+static void reportObjects(const ASTContext &Context, const Sema &Actions, const IdentifierTable &Idents) {
+    TimeReport *Report = TimeReport::getCurrent();
+    if (!Report || !Report->tracksMemory())
+        return;
+    for (unsigned I = 0; I != ASTContext::NUM_NODE_CLASSES; ++I) {
+        auto Class = static_cast<ASTContext::NodeClass>(I);
+        const ASTContext::AllocationStats &Stats = Context.getNodeStats(Class);
+        if (Stats.Count)
+            Report->addObjects(ASTContext::getNodeClassName(Class), Stats.Count, Stats.Bytes);
+    }
+    Report->addObjects("AST lists", Context.getListStats().Count, Context.getListStats().Bytes);
+    Report->addObjects("AST arena (reserved)", 1, Context.getTotalMemory());
+    Report->addObjects("Identifier table", Idents.size(), Idents.getMemorySize());
+    Report->addObjects("Scope bindings", Actions.getScope().getNumBindings(),
+                       Actions.getScope().getMemorySize());
+}
+
+// Runs the whole pipeline for one input file. All messages go to Errs.
+// Returns false if the file has errors, or if it cannot be emitted or run.
+static bool compileFile(StringRef Argv0, const std::string &F, llvm::TargetMachine *TM, JIT *J,
+                        llvm::raw_ostream &Errs) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr = llvm::MemoryBuffer::getFile(F);
+    if (std::error_code BufferError = FileOrErr.getError()) {
+        Errs << "Error reading " << F << ": " << BufferError.message() << "\n";
+        return false;
+    }
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.setDiagHandler(printDiagnostic, &Errs);
+    DiagnosticEngine Diags(SrcMgr);
+    Diags.setErrorLimit(ErrorLimit);
+    SrcMgr.AddNewSourceBuffer(std::move(*FileOrErr), llvm::SMLoc());
+
+    auto FileName = [&F] { return F; };
+    IdentifierTable Idents;
+    ASTContext Context;
+    auto lexer = Lexer(SrcMgr, Diags, Idents);
+    auto sema = Sema(Context, Diags, Idents);
+    ModuleDeclaration *Mod;
+    // A report lexes up front, so that the lexer has a row of its own
+    // instead of being timed as part of the parser.
+    if (PreLex || LexThreads > 1 || TimeReport::getCurrent()) {
+        TokenStream Tokens(lexer.getBuffer());
+        {
+            TimeScope Timer("Lex", FileName);
+            if (LexThreads > 1)
+                lexer.lexParallel(Tokens, LexThreads);
+            else
+                lexer.lex(Tokens);
+        }
+        TimeScope Timer("Parse", FileName);
+        auto parser = Parser(lexer, Tokens, sema);
+        Mod = parser.parse();
+    } else {
         auto parser = Parser(lexer, sema);
-        parser.parse();
+        Mod = parser.parse();
+    }
+    reportObjects(Context, sema, Idents);
+    Diags.flush();
+    if (!Mod || Diags.numErrors())
+        return false;
+    if (Interpret)
+        return runInterpreter(Argv0, Mod, F, Errs);
+    if (Tiered)
+        return runTiered(Argv0, *J, Mod, F, Errs);
+    if (Run)
+        return runJIT(Argv0, *J, Mod, F, Errs);
+    llvm::LLVMContext Ctx;
+    std::unique_ptr<CodeGenerator> CG(CodeGenerator::create(Ctx, TM));
+    std::unique_ptr<llvm::Module> M;
+    {
+        TimeScope Timer("CodeGen", FileName);
+        M = CG->run(Mod, F);
+    }
+    {
+        TimeScope Timer("Optimize", FileName);
+        optimize(TM, M.get());
+    }
+    TimeScope Timer("Emit", FileName);
+    return emit(Argv0, M.get(), TM, F, Errs);
+}
+
+// Compiles all input files, and returns false if any of them failed. A
+// failed file does not stop the others. With Reports, the time of the
+// phases of each file is recorded into its own report.
+static bool compileInputs(const char *Argv0, llvm::TargetMachine *TM, JIT *J, llvm::raw_ostream &Errs,
+                          TimeReport *Report) {
+    bool Ok = true;
+    // The module bodies run one after another, in the order of the files.
+    if (Jobs == 1 || InputFiles.size() <= 1 || Interpret || Tiered || Run) {
+        if (Report)
+            Report->install();
+        for (const std::string &F : InputFiles) {
+            Ok &= compileFile(Argv0, F, TM, J, Errs);
+            Errs.flush();
+        }
+        TimeReport::uninstall();
+        return Ok;
+    }
+
+    // Each worker writes the diagnostics of a file into its own buffer,
+    // which is printed once all files before it are done. The time
+    // reports are merged in the same order.
+    std::vector<std::string> Outputs(InputFiles.size());
+    std::vector<TimeReport> Reports(Report ? InputFiles.size() : 0);
+    std::vector<char> Results(InputFiles.size());
+    std::vector<std::shared_future<void>> Done;
+    llvm::ThreadPool Pool(llvm::hardware_concurrency(Jobs));
+
+    // The target machine caches subtargets without locking, so each task
+    // takes one which no other task uses. There are as many as threads,
+    // created before any task runs.
+    std::vector<std::unique_ptr<llvm::TargetMachine>> WorkerTMs;
+    std::vector<llvm::TargetMachine *> FreeTMs{TM};
+    for (unsigned I = 1, E = Pool.getThreadCount(); I < E; ++I) {
+        WorkerTMs.emplace_back(createTargetMachine(Argv0, Errs));
+        if (!WorkerTMs.back())
+            return false;
+        FreeTMs.push_back(WorkerTMs.back().get());
+    }
+    std::mutex FreeTMsLock;
+
+    bool ShowColors = Errs.has_colors();
+    for (size_t I = 0, E = InputFiles.size(); I != E; ++I) {
+        Done.push_back(Pool.async([&, I] {
+            llvm::TargetMachine *WorkerTM;
+            {
+                std::lock_guard<std::mutex> Lock(FreeTMsLock);
+                WorkerTM = FreeTMs.back();
+                FreeTMs.pop_back();
+            }
+            if (Report) {
+                Reports[I].setTrackMemory(Report->tracksMemory());
+                Reports[I].install();
+            }
+            if (!TimeTraceFile.empty())
+                llvm::timeTraceProfilerInitialize(TimeTraceGranularity, Argv0);
+            llvm::raw_string_ostream WorkerErrs(Outputs[I]);
+            WorkerErrs.enable_colors(ShowColors);
+            Results[I] = compileFile(Argv0, InputFiles[I], WorkerTM, nullptr, WorkerErrs);
+            if (!TimeTraceFile.empty())
+                llvm::timeTraceProfilerFinishThread();
+            TimeReport::uninstall();
+            std::lock_guard<std::mutex> Lock(FreeTMsLock);
+            FreeTMs.push_back(WorkerTM);
+        }));
     }
-}
\ No newline at end of file
+    for (size_t I = 0, E = InputFiles.size(); I != E; ++I) {
+        Done[I].wait();
+        Errs << Outputs[I];
+        Errs.flush();
+        Outputs[I].clear();
+        if (Report)
+            Report->merge(Reports[I]);
+        Ok &= Results[I];
+    }
+    return Ok;
+}
+
+// Compiles the input files named on the command line. Out receives what
+// the driver prints to stdout, Errs the diagnostics.
+static int compileFiles(const char *Argv0, llvm::TargetMachine *TM, llvm::raw_ostream &Out,
+                        llvm::raw_ostream &Errs) {
+    Out << "Tinylang " << tinylang::getTinylangVersion() << "\n";
+
+    std::unique_ptr<JIT> J;
+    if (Run || Tiered) {
+        JIT::Mode Mode = JIT::Mode::Eager;
+        if (Tiered)
+            Mode = JIT::Mode::Tiered;
+        else if (Lazy)
+            Mode = Speculate ? JIT::Mode::Speculative : JIT::Mode::Lazy;
+        auto JITOrErr = JIT::create(*TM, [TM](llvm::Module &M) { optimize(TM, &M); }, Mode);
+        if (!JITOrErr) {
+            llvm::WithColor::error(Errs, Argv0) << toString(JITOrErr.takeError()) << "\n";
+            return 1;
+        }
+        J = std::move(*JITOrErr);
+    }
+
+    // The scopes only record into a report, so tracing needs one too.
+    bool Trace = !TimeTraceFile.empty();
+    if (Trace)
+        llvm::timeTraceProfilerInitialize(TimeTraceGranularity, Argv0);
+    TimeReport Report;
+    Report.setTrackMemory(PrintMemReport);
+    bool Ok = compileInputs(Argv0, TM, J.get(), Errs,
+                            PrintTimeReport || PrintMemReport || Trace ? &Report : nullptr);
+    if (PrintTimeReport)
+        Report.print(Errs);
+    if (PrintMemReport)
+        Report.printMemory(Errs);
+    if (Trace) {
+        llvm::Error Err = llvm::timeTraceProfilerWrite(TimeTraceFile, Argv0);
+        llvm::timeTraceProfilerCleanup();
+        if (Err) {
+            llvm::WithColor::error(Errs, Argv0) << toString(std::move(Err)) << "\n";
+            return 1;
+        }
+    }
+    return Ok ? 0 : 1;
+}
+
+#if LLVM_ON_UNIX
+namespace {
+    // Sends everything written to it as frames on one channel of a client
+    // connection.
+    class ChannelStream : public llvm::raw_ostream {
+        int FD;
+        server::Channel Chan;
+        uint64_t Pos{0};
+
+        void write_impl(const char *Ptr, size_t Size) override {
+            // A client which went away is not an error of the server.
+            server::writeFrame(FD, Chan, Ptr, Size);
+            Pos += Size;
+        }
+
+        uint64_t current_pos() const override { return Pos; }
+
+    public:
+        ChannelStream(int FD, server::Channel Chan) : FD(FD), Chan(Chan) {}
+
+        ~ChannelStream() override { flush(); }
+    };
+
+    bool readString(int FD, std::string &Str) {
+        uint32_t Size;
+        if (!server::readAll(FD, &Size, sizeof(Size)) || Size > server::MaxStringSize)
+            return false;
+        Str.resize(Size);
+        return server::readAll(FD, Str.data(), Size);
+    }
+}
+
+// The target machines of the server, one for each code generation level.
+// A target machine cannot switch levels once it has generated code.
+using ServerTargets = std::array<std::unique_ptr<llvm::TargetMachine>, llvm::CodeGenOpt::Aggressive + 1>;
+
+// Whether an option of a request needs another target machine than the
+// ones created by the server.
+static bool changesTarget(StringRef Arg) {
+    StringRef Name = Arg.ltrim('-').split('=').first;
+    StringRef Count = Name;
+    if (Count.consume_front("j") && llvm::all_of(Count, llvm::isDigit))
+        return false;
+    return llvm::StringSwitch<bool>(Name)
+            .Cases("O", "O0", "O1", "O2", "O3", "Os", false)
+            .Cases("prelex", "lex-threads", "emit-llvm", "filetype", false)
+            .Cases("ftime-report", "ftime-trace", "ftime-trace-granularity", "fmem-report", false)
+            .Case("ferror-limit", false)
+            .Default(true);
+}
+
+// Parses the command line of one request and compiles its files.
+static int serveRequest(const char *Argv0, const ServerTargets &TMs, ArrayRef<std::string> Args,
+                        llvm::raw_ostream &Out, llvm::raw_ostream &Errs) {
+    std::vector<const char *> Argv;
+    for (const std::string &Arg : Args)
+        Argv.push_back(Arg.c_str());
+    llvm::cl::ResetAllOptionOccurrences();
+    if (!llvm::cl::ParseCommandLineOptions(Argv.size(), Argv.data(), "", &Errs))
+        return 1;
+    if (Serve.getNumOccurrences() || Run || Interpret || Tiered) {
+        llvm::WithColor::error(Errs, Argv0) << "the server only compiles files\n";
+        return 1;
+    }
+
+    std::unique_ptr<llvm::TargetMachine> TM;
+    for (const std::string &Arg : Args.drop_front())
+        if (llvm::find(InputFiles, Arg) == InputFiles.end() && changesTarget(Arg)) {
+            TM.reset(createTargetMachine(Argv0, Errs));
+            if (!TM)
+                return 1;
+            return compileFiles(Argv0, TM.get(), Out, Errs);
+        }
+    return compileFiles(Argv0, TMs[getCodeGenOptLevel()].get(), Out, Errs);
+}
+
+static int serveClient(const char *Argv0, const ServerTargets &TMs, int FD) {
+    server::RequestHeader Header;
+    if (!server::readAll(FD, &Header, sizeof(Header)) || Header.NumStrings < 2 ||
+        Header.NumStrings > server::MaxStrings)
+        return 1;
+    std::string Cwd;
+    std::vector<std::string> Args(Header.NumStrings - 1);
+    if (!readString(FD, Cwd))
+        return 1;
+    for (std::string &Arg : Args)
+        if (!readString(FD, Arg))
+            return 1;
+
+    int32_t Code;
+    {
+        ChannelStream Out(FD, server::Stdout);
+        ChannelStream Errs(FD, server::Stderr);
+        Errs.enable_colors(Header.Flags & server::ColorsFlag);
+        // Relative paths are resolved in the directory of the client.
+        if (std::error_code EC = llvm::sys::fs::set_current_path(Cwd)) {
+            llvm::WithColor::error(Errs, Argv0) << Cwd << ": " << EC.message() << "\n";
+            Code = 1;
+        } else
+            Code = serveRequest(Argv0, TMs, Args, Out, Errs);
+    }
+    server::writeFrame(FD, server::Exit, &Code, sizeof(Code));
+    return Code;
+}
+
+// Creates the target machines of the server and runs a small module through
+// the pipeline at -O0 and -O2. LLVM creates much of its state on first use,
+// so the children of the server find it ready instead of creating it for
+// every request.
+static bool createServerTargets(const char *Argv0, ServerTargets &TMs) {
+    static const char Source[] =
+            "MODULE WarmUp;\n"
+            "VAR G : INTEGER;\n"
+            "PROCEDURE F(A : INTEGER; VAR B : INTEGER) : INTEGER;\n"
+            "BEGIN\n"
+            "  WHILE A > 0 DO IF A MOD 2 = 0 THEN B := B + A ELSE A := A - 1 END; A := A DIV 2 END;\n"
+            "  RETURN B\n"
+            "END F;\n"
+            "BEGIN\n"
+            "  G := F(10, G)\n"
+            "END WarmUp.\n";
+    llvm::SourceMgr SrcMgr;
+    DiagnosticEngine Diags(SrcMgr);
+    SrcMgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(Source, "WarmUp.mod"), llvm::SMLoc());
+    IdentifierTable Idents;
+    ASTContext Context;
+    auto lexer = Lexer(SrcMgr, Diags, Idents);
+    auto sema = Sema(Context, Diags, Idents);
+    auto parser = Parser(lexer, sema);
+    ModuleDeclaration *Mod = parser.parse();
+    assert(Mod && !Diags.numErrors() && "Broken warm-up module");
+
+    signed char SavedOptLevel = OptLevel;
+    for (signed char Level : {0, 1, 2, 3}) {
+        OptLevel = Level;
+        llvm::TargetMachine *TM = createTargetMachine(Argv0, llvm::errs());
+        if (!TM)
+            return false;
+        TMs[getCodeGenOptLevel()].reset(TM);
+        if (Level == 1 || Level == 3)
+            continue;
+        llvm::LLVMContext Ctx;
+        std::unique_ptr<CodeGenerator> CG(CodeGenerator::create(Ctx, TM));
+        std::unique_ptr<llvm::Module> M = CG->run(Mod, "WarmUp.mod");
+        optimize(TM, M.get());
+        llvm::raw_null_ostream Null;
+        llvm::legacy::PassManager CodeGenPM;
+        CodeGenPM.add(llvm::createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
+        if (!TM->addPassesToEmitFile(CodeGenPM, Null, nullptr, llvm::CGFT_ObjectFile))
+            CodeGenPM.run(*M);
+    }
+    OptLevel = SavedOptLevel;
+    return true;
+}
+
+// The socket is not a regular file, which RemoveFileOnSignal would remove.
+static char SocketFile[sizeof(sockaddr_un::sun_path)];
+
+static void removeSocketFile() {
+    ::unlink(SocketFile);
+    ::_exit(1);
+}
+
+// Answers the requests of tinylang-client on a Unix domain socket. The
+// server initializes LLVM and creates the target machines once, then forks
+// a child for each request. The children start from this warm state, see
+// no options of earlier requests, run in parallel, and a crash while
+// compiling does not take the server down.
+static int serve(const char *Argv0, const std::string &SocketPath) {
+    sockaddr_un Addr{};
+    Addr.sun_family = AF_UNIX;
+    if (SocketPath.size() >= sizeof(Addr.sun_path)) {
+        llvm::WithColor::error(llvm::errs(), Argv0) << "socket path too long: " << SocketPath << "\n";
+        return 1;
+    }
+    std::strcpy(Addr.sun_path, SocketPath.c_str());
+
+    ServerTargets TMs;
+    if (!createServerTargets(Argv0, TMs))
+        return 1;
+
+    int ListenFD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (ListenFD < 0) {
+        llvm::WithColor::error(llvm::errs(), Argv0) << "cannot create socket: " << strerror(errno) << "\n";
+        return 1;
+    }
+    // A socket file without a server behind it is left over from a server
+    // which did not exit cleanly.
+    if (::connect(ListenFD, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) == 0) {
+        llvm::WithColor::error(llvm::errs(), Argv0) << "a server is already listening on " << SocketPath << "\n";
+        return 1;
+    }
+    ::unlink(SocketPath.c_str());
+    if (::bind(ListenFD, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) < 0 ||
+        ::listen(ListenFD, SOMAXCONN) < 0) {
+        llvm::WithColor::error(llvm::errs(), Argv0) << SocketPath << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    std::strcpy(SocketFile, SocketPath.c_str());
+    llvm::sys::SetInterruptFunction(removeSocketFile);
+    // Writing to a client which went away must not kill the server, and
+    // the children need not be waited for.
+    ::signal(SIGPIPE, SIG_IGN);
+    ::signal(SIGCHLD, SIG_IGN);
+
+    for (;;) {
+        int FD = ::accept(ListenFD, nullptr, nullptr);
+        if (FD < 0) {
+            if (errno == EINTR)
+                continue;
+            llvm::WithColor::error(llvm::errs(), Argv0) << "accept: " << strerror(errno) << "\n";
+            return 1;
+        }
+        pid_t Child = ::fork();
+        if (Child == 0) {
+            // Only the server removes the socket.
+            llvm::sys::SetInterruptFunction(nullptr);
+            ::close(ListenFD);
+            ::_exit(serveClient(Argv0, TMs, FD));
+        }
+        if (Child < 0)
+            llvm::WithColor::error(llvm::errs(), Argv0) << "fork: " << strerror(errno) << "\n";
+        ::close(FD);
+    }
+}
+#else
+static int serve(const char *Argv0, const std::string &SocketPath) {
+    llvm::WithColor::error(llvm::errs(), Argv0) << "--serve needs Unix domain sockets\n";
+    return 1;
+}
+#endif
+
+int main(int argc_, const char **argv_) {
+    llvm::InitLLVM X(argc_, argv_);
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmPrinters();
+    llvm::InitializeAllAsmParsers();
+    llvm::cl::ParseCommandLineOptions(argc_, argv_, "tinylang - the cool modula-2 compiler\n");
+
+    if (!Serve.empty()) {
+        if (!InputFiles.empty()) {
+            llvm::WithColor::error(llvm::errs(), argv_[0]) << "--serve takes no input files\n";
+            return 1;
+        }
+        return serve(argv_[0], Serve);
+    }
+
+    std::unique_ptr<llvm::TargetMachine> TM(createTargetMachine(argv_[0], llvm::errs()));
+    if (!TM)
+        return 1;
+    return compileFiles(argv_[0], TM.get(), llvm::outs(), llvm::errs());
+}
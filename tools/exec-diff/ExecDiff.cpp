@@ -0,0 +1,267 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+// Checks that native code computes the same as the bytecode interpreter.
+// Each file is run by the interpreter, by the JIT at every optimization
+// level given, and by the tiered engine, and the module variables and the
+// runtime error at the end must be the same. The eager JIT compiles the
+// module variables as private globals, so only its runtime error is
+// compared; the lazy JIT has them by name.
+
+#include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/IdentifierTable.h"
+#include "tinylang/JIT/JIT.h"
+#include "tinylang/JIT/TieredEngine.h"
+#include "tinylang/Parser/Parser.h"
+#include "tinylang/VM/BytecodeCompiler.h"
+#include "tinylang/VM/Interpreter.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <vector>
+
+using namespace tinylang;
+
+static llvm::cl::list<std::string> InputFiles(llvm::cl::Positional,
+                                              llvm::cl::desc("<input-files>"),
+                                              llvm::cl::OneOrMore);
+
+static llvm::cl::list<unsigned> OptLevels(
+        "opt-levels",
+        llvm::cl::desc("Optimization levels of the native code to compare against the interpreter"),
+        llvm::cl::CommaSeparated);
+
+static llvm::cl::opt<unsigned> TierThreshold(
+        "tier-threshold",
+        llvm::cl::desc("Number of calls and loop iterations after which the tiered engine compiles a procedure"),
+        llvm::cl::init(100));
+
+static llvm::cl::opt<bool> PrintVariables(
+        "print-variables",
+        llvm::cl::desc("Print the module variables at the end of the interpreted run"),
+        llvm::cl::init(false));
+
+namespace {
+    // How a run ended: the module variables in the order of declaration,
+    // if they can be read, and the runtime error, if any.
+    struct Outcome {
+        std::vector<int64_t> Values;
+        std::string Error;
+        bool HasValues{true};
+    };
+
+    std::string takeMessage(llvm::Error Err) {
+        return Err ? toString(std::move(Err)) : std::string();
+    }
+
+    // The errors of a JIT refer to its symbols, so they are turned into
+    // text before the JIT goes away.
+    llvm::Error detach(llvm::Error Err) {
+        return llvm::createStringError(llvm::inconvertibleErrorCode(), takeMessage(std::move(Err)));
+    }
+
+    llvm::OptimizationLevel getOptimizationLevel(unsigned Level) {
+        switch (Level) {
+            case 0:
+                return llvm::OptimizationLevel::O0;
+            case 1:
+                return llvm::OptimizationLevel::O1;
+            case 2:
+                return llvm::OptimizationLevel::O2;
+            default:
+                return llvm::OptimizationLevel::O3;
+        }
+    }
+
+    void optimize(llvm::TargetMachine &TM, unsigned Level, llvm::Module &M) {
+        llvm::PassBuilder PB(&TM);
+        llvm::LoopAnalysisManager LAM;
+        llvm::FunctionAnalysisManager FAM;
+        llvm::CGSCCAnalysisManager CGAM;
+        llvm::ModuleAnalysisManager MAM;
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+        llvm::ModulePassManager MPM;
+        if (Level == 0)
+            MPM = PB.buildO0DefaultPipeline(llvm::OptimizationLevel::O0);
+        else
+            MPM = PB.buildPerModuleDefaultPipeline(getOptimizationLevel(Level));
+        MPM.run(M, MAM);
+    }
+
+    llvm::Expected<std::unique_ptr<llvm::TargetMachine>> createTargetMachine(unsigned Level) {
+        auto JTMB = llvm::orc::JITTargetMachineBuilder::detectHost();
+        if (!JTMB)
+            return JTMB.takeError();
+        JTMB->setCodeGenOptLevel(Level == 0 ? llvm::CodeGenOpt::None : llvm::CodeGenOpt::Default);
+        return JTMB->createTargetMachine();
+    }
+
+    class ExecDiff {
+        ModuleDeclaration *Mod;
+        StringRef FileName;
+        std::vector<VariableDeclaration *> Vars;
+
+        // A BOOLEAN variable of the native code is a single byte.
+        int64_t readVariable(VariableDeclaration *Var, void *Addr) {
+            if (Var->getType()->getName() == "BOOLEAN")
+                return *static_cast<uint8_t *>(Addr);
+            return *static_cast<int64_t *>(Addr);
+        }
+
+    public:
+        ExecDiff(ModuleDeclaration *Mod, StringRef FileName) : Mod(Mod), FileName(FileName) {
+            for (Decl *D : Mod->getDecls())
+                if (auto *Var = llvm::dyn_cast<VariableDeclaration>(D))
+                    Vars.push_back(Var);
+        }
+
+        Outcome interpret() {
+            std::unique_ptr<vm::Program> P = vm::BytecodeCompiler::compile(Mod);
+            vm::Interpreter Interp(*P);
+            Outcome Result;
+            Result.Error = takeMessage(Interp.run());
+            for (VariableDeclaration *Var : Vars)
+                Result.Values.push_back(Interp.getGlobals()[P->GlobalIndex.lookup(Var)]);
+            return Result;
+        }
+
+        llvm::Expected<Outcome> runNative(JIT::Mode Kind, unsigned Level) {
+            auto TM = createTargetMachine(Level);
+            if (!TM)
+                return TM.takeError();
+            llvm::TargetMachine &TMRef = **TM;
+            auto J = JIT::create(TMRef, [&TMRef, Level](llvm::Module &M) { optimize(TMRef, Level, M); }, Kind);
+            if (!J)
+                return detach(J.takeError());
+            auto Init = (*J)->add(Mod, FileName);
+            if (!Init)
+                return detach(Init.takeError());
+            Outcome Result;
+            Result.Error = takeMessage(JIT::runNative([MainFn = *Init] {
+                MainFn();
+                return llvm::Error::success();
+            }));
+            if (Kind == JIT::Mode::Eager) {
+                Result.HasValues = false;
+                return Result;
+            }
+            for (VariableDeclaration *Var : Vars) {
+                auto Addr = (*J)->getVariableAddress(Mod, Var);
+                if (!Addr)
+                    return detach(Addr.takeError());
+                Result.Values.push_back(readVariable(Var, *Addr));
+            }
+            return Result;
+        }
+
+        // Which calls run as native code depends on the background
+        // compilation, but the result must not.
+        llvm::Expected<Outcome> runTiered() {
+            auto TM = createTargetMachine(2);
+            if (!TM)
+                return TM.takeError();
+            llvm::TargetMachine &TMRef = **TM;
+            auto J = JIT::create(TMRef, [&TMRef](llvm::Module &M) { optimize(TMRef, 2, M); }, JIT::Mode::Tiered);
+            if (!J)
+                return detach(J.takeError());
+            auto Engine = TieredEngine::create(**J, Mod, FileName, TierThreshold);
+            if (!Engine)
+                return detach(Engine.takeError());
+            Outcome Result;
+            Result.Error = takeMessage((*Engine)->run());
+            for (VariableDeclaration *Var : Vars)
+                Result.Values.push_back(*(*Engine)->getVariable(Var));
+            return Result;
+        }
+
+        void print(const Outcome &Result) {
+            for (size_t I = 0; I != Vars.size(); ++I)
+                llvm::outs() << "  " << Vars[I]->getName() << " = " << Result.Values[I] << "\n";
+        }
+
+        // Prints the first difference to the interpreter.
+        bool compare(const Outcome &Expected, const Outcome &Actual) {
+            if (Expected.Error != Actual.Error) {
+                llvm::errs() << "runtime error differs: \"" << Expected.Error << "\" interpreted, \""
+                             << Actual.Error << "\" native\n";
+                return false;
+            }
+            for (size_t I = 0; Actual.HasValues && I != Vars.size(); ++I) {
+                if (Expected.Values[I] != Actual.Values[I]) {
+                    llvm::errs() << Vars[I]->getName() << " differs: " << Expected.Values[I]
+                                 << " interpreted, " << Actual.Values[I] << " native\n";
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+}
+
+static bool checkFile(const std::string &F) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr = llvm::MemoryBuffer::getFile(F);
+    if (std::error_code BufferError = FileOrErr.getError()) {
+        llvm::errs() << "Error reading " << F << ": " << BufferError.message() << "\n";
+        return false;
+    }
+    llvm::SourceMgr SrcMgr;
+    DiagnosticEngine Diags(SrcMgr);
+    SrcMgr.AddNewSourceBuffer(std::move(*FileOrErr), llvm::SMLoc());
+    IdentifierTable Idents;
+    ASTContext Context;
+    Lexer Lex(SrcMgr, Diags, Idents);
+    Sema Actions(Context, Diags, Idents);
+    Parser P(Lex, Actions);
+    ModuleDeclaration *Mod = P.parse();
+    Diags.flush();
+    if (!Mod || Diags.numErrors())
+        return false;
+
+    ExecDiff Diff(Mod, F);
+    Outcome Expected = Diff.interpret();
+    llvm::outs() << F << ": " << (Expected.Error.empty() ? "no runtime error" : Expected.Error) << "\n";
+    if (PrintVariables)
+        Diff.print(Expected);
+
+    bool Failed = false;
+    auto check = [&](const std::string &Name, llvm::Expected<Outcome> Actual) {
+        if (!Actual) {
+            llvm::errs() << Name << ": " << toString(Actual.takeError()) << "\n";
+            Failed = true;
+            return;
+        }
+        bool Same = Diff.compare(Expected, *Actual);
+        llvm::outs() << "  " << Name << ": " << (Same ? "same" : "DIFFERENT") << "\n";
+        Failed |= !Same;
+    };
+    std::vector<unsigned> Levels{0, 2};
+    if (!OptLevels.empty())
+        Levels.assign(OptLevels.begin(), OptLevels.end());
+    for (unsigned Level : Levels) {
+        check("eager -O" + std::to_string(Level), Diff.runNative(JIT::Mode::Eager, Level));
+        check("lazy -O" + std::to_string(Level), Diff.runNative(JIT::Mode::Lazy, Level));
+    }
+    check("tiered", Diff.runTiered());
+    return !Failed;
+}
+
+int main(int argc_, const char **argv_) {
+    llvm::InitLLVM X(argc_, argv_);
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::cl::ParseCommandLineOptions(argc_, argv_, "tinylang interpreter and native code check\n");
+
+    bool Ok = true;
+    for (const std::string &F : InputFiles)
+        Ok &= checkFile(F);
+    return Ok ? 0 : 1;
+}
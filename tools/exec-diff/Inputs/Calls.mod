@@ -0,0 +1,69 @@
+MODULE Calls;
+
+(* VAR parameters of module variables, locals, value parameters and other
+   VAR parameters, and nested procedures. *)
+
+VAR g, h, r, s: INTEGER;
+
+PROCEDURE Swap(VAR x, y: INTEGER);
+VAR t: INTEGER;
+BEGIN
+    t := x;
+    x := y;
+    y := t
+END Swap;
+
+PROCEDURE AddTo(VAR x: INTEGER; d: INTEGER);
+BEGIN
+    x := x + d
+END AddTo;
+
+PROCEDURE Twice(VAR x: INTEGER);
+BEGIN
+    AddTo(x, x)
+END Twice;
+
+PROCEDURE Sum(n: INTEGER): INTEGER;
+VAR i, Total: INTEGER;
+
+    PROCEDURE Square(m: INTEGER): INTEGER;
+        PROCEDURE Id(k: INTEGER): INTEGER;
+        BEGIN
+            RETURN k
+        END Id;
+    BEGIN
+        RETURN Id(m) * Id(m)
+    END Square;
+
+BEGIN
+    i := 0;
+    Total := 0;
+    WHILE i < n DO
+        AddTo(Total, Square(i));
+        i := i + 1
+    END;
+    Twice(n);
+    Swap(n, Total);
+    RETURN Total - n
+END Sum;
+
+PROCEDURE Fib(n: INTEGER): INTEGER;
+BEGIN
+    IF n < 2 THEN
+        RETURN n
+    END;
+    RETURN Fib(n - 1) + Fib(n - 2)
+END Fib;
+
+BEGIN
+    g := 3;
+    h := 4;
+    Swap(g, h);
+    Twice(g);
+    r := 0;
+    WHILE r < 2000 DO
+        s := s + Sum(r);
+        r := r + 1
+    END;
+    r := Fib(25)
+END Calls.
@@ -0,0 +1,33 @@
+MODULE Division;
+
+(* DIV and MOD with every sign, MIN DIV -1, which wraps around, and a
+   division by zero in a procedure which is hot by then. *)
+
+VAR i, n, q, r, Min, Sum: INTEGER;
+
+PROCEDURE D(a, b: INTEGER): INTEGER;
+BEGIN
+    RETURN a DIV b
+END D;
+
+PROCEDURE M(a, b: INTEGER): INTEGER;
+BEGIN
+    RETURN a MOD b
+END M;
+
+BEGIN
+    Sum := 0;
+    i := -300000;
+    WHILE i < 300000 DO
+        Sum := Sum + D(i, 7) - D(i, -3) + M(i, 5) - M(i, -11) + i DIV 4 - i MOD 6;
+        i := i + 1
+    END;
+    Min := 0 - 9223372036854775807 - 1;
+    n := -1;
+    q := D(Min, n);
+    r := M(Min, n);
+    q := q + Min DIV n;
+    r := r + Min MOD n;
+    n := 0;
+    q := D(1, n)
+END Division.
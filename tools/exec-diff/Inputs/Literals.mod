@@ -0,0 +1,18 @@
+MODULE Literals;
+
+(* Literals which do not fit into 64 bits are truncated, and arithmetic
+   wraps around. *)
+
+CONST Max = 9223372036854775807;
+      Huge = 123456789012345678901234567890;
+
+VAR a, b, c, d, e, f: INTEGER;
+
+BEGIN
+    a := Max;
+    b := a + 1;
+    c := Huge;
+    d := 0FFFFFFFFFFFFFFFFH;
+    e := 1FFFFFFFFFFFFFFFFFFFFH + Huge * 3;
+    f := (Max * Max) DIV 7 + 18446744073709551616
+END Literals.
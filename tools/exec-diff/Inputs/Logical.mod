@@ -0,0 +1,31 @@
+MODULE Logical;
+
+(* AND and OR evaluate the right operand only when it decides the result.
+   Calls counts the evaluations of the right operands. *)
+
+VAR i, Calls, Taken: INTEGER;
+    a, b, c: BOOLEAN;
+
+PROCEDURE Count(Result: BOOLEAN): BOOLEAN;
+BEGIN
+    Calls := Calls + 1;
+    RETURN Result
+END Count;
+
+PROCEDURE Test(x: INTEGER): BOOLEAN;
+BEGIN
+    RETURN (x MOD 3 = 0) AND Count(x MOD 2 = 0) OR (x MOD 5 = 0) AND NOT Count(x > 100)
+END Test;
+
+BEGIN
+    i := 0;
+    WHILE i < 100000 DO
+        IF Test(i) OR Count(i MOD 7 = 0) THEN
+            Taken := Taken + 1
+        END;
+        i := i + 1
+    END;
+    a := (Calls > 0) OR Count(FALSE);
+    b := (Calls < 0) AND Count(TRUE);
+    c := NOT a OR NOT b AND (Taken # 0)
+END Logical.
@@ -0,0 +1,311 @@
+//
+// Created by jewoo on 2021-06-28.
+//
+
+// Checks that Lexer::lexParallel produces the same tokens, identifier IDs,
+// integer values and diagnostics as Lexer::lex. The input is a generated
+// buffer with comments that span chunk boundaries, strings containing
+// comment delimiters and lexer errors, or the given file.
+
+#include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/IdentifierTable.h"
+#include "tinylang/Lexer/Lexer.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace tinylang;
+
+static llvm::cl::opt<std::string> InputFile(llvm::cl::Positional,
+                                            llvm::cl::desc("[input-file]"),
+                                            llvm::cl::init(""));
+
+static llvm::cl::opt<unsigned> SizeMB(
+        "size",
+        llvm::cl::desc("Size of the generated buffer in MB"),
+        llvm::cl::init(8));
+
+static llvm::cl::opt<unsigned> Seed(
+        "seed",
+        llvm::cl::desc("Seed of the generator. With an odd seed, the buffer ends in an unterminated comment"),
+        llvm::cl::init(1));
+
+static llvm::cl::list<unsigned> Threads(
+        "lex-threads",
+        llvm::cl::desc("Number of threads to compare against the serial lexer"),
+        llvm::cl::CommaSeparated);
+
+static llvm::cl::opt<std::string> OutputFile(
+        "o",
+        llvm::cl::desc("Write the generated buffer to this file"),
+        llvm::cl::value_desc("file"),
+        llvm::cl::init(""));
+
+namespace {
+    // Generates lines of statements with the occasional long comment, so
+    // that chunk boundaries fall both inside and outside of comments.
+    class CorpusGenerator {
+        std::mt19937 Rng;
+        bool Unterminated;
+        // Inside a comment, a comment delimiter in a string is not part of
+        // the string, so such strings are not generated.
+        bool InComment{false};
+        std::string Buf;
+
+        unsigned pick(unsigned N) { return Rng() % N; }
+
+        void identifier() {
+            Buf += 'v';
+            Buf += std::to_string(pick(5000));
+        }
+
+        void number() {
+            switch (pick(8)) {
+                case 0:
+                    Buf += '0';
+                    Buf += std::to_string(pick(100000));
+                    Buf += "AFH";
+                    break;
+                case 1:
+                    // Needs more than 64 bits.
+                    Buf += "123456789012345678901234567890";
+                    break;
+                default:
+                    Buf += std::to_string(pick(1000000));
+            }
+        }
+
+        void string() {
+            static const char *const Texts[] = {"text", "$", "(*", "*)", "(* not a comment *)"};
+            char Quote = pick(2) ? '"' : '\'';
+            Buf += Quote;
+            Buf += Texts[pick(InComment ? 2 : std::size(Texts))];
+            Buf += Quote;
+        }
+
+        // Errors are rare, so that some chunks have none. Otherwise every
+        // chunk would be lexed again because of them.
+        void lexerError() {
+            if (pick(2)) {
+                // A hex digit without the suffix.
+                Buf += " + ";
+                Buf += std::to_string(pick(1000));
+                Buf += "BE";
+            } else {
+                // Ends at the end of the line.
+                Buf += "; \"unterminated";
+            }
+        }
+
+        void expression() {
+            for (unsigned I = 0, E = pick(4) + 1; I != E; ++I) {
+                if (I)
+                    Buf += " + ";
+                switch (pick(4)) {
+                    case 0:
+                        number();
+                        break;
+                    case 1:
+                        Buf += "(";
+                        identifier();
+                        Buf += " * ";
+                        number();
+                        Buf += ")";
+                        break;
+                    default:
+                        identifier();
+                }
+            }
+        }
+
+        void statementLine() {
+            Buf += std::string(pick(16), ' ');
+            identifier();
+            Buf += " := ";
+            expression();
+            switch (pick(16)) {
+                case 0:
+                    Buf += " (* inline (* nested *) comment *)";
+                    break;
+                case 1:
+                    Buf += "; ";
+                    string();
+                    break;
+                case 2:
+                    Buf += " $?";
+                    break;
+                default:
+                    break;
+            }
+            if (!pick(40000))
+                lexerError();
+            Buf += ";\n";
+        }
+
+        // A comment of about Size bytes whose lines look like code, with
+        // strings that are not terminated and nested comments. Some of them
+        // end in the middle of a line.
+        void comment(size_t Size) {
+            size_t End = Buf.size() + Size;
+            InComment = true;
+            Buf += "(*";
+            while (Buf.size() < End) {
+                switch (pick(8)) {
+                    case 0:
+                        Buf += "  x := \"unterminated string\n";
+                        break;
+                    case 1:
+                        Buf += "  (* nested\n";
+                        statementLine();
+                        Buf += "  *)\n";
+                        break;
+                    case 2:
+                        Buf += "*****************************************\n";
+                        break;
+                    default:
+                        statementLine();
+                }
+            }
+            InComment = false;
+            // Lexed from inside the comment, the quote starts a string which
+            // runs past the end of the comment.
+            if (pick(2)) {
+                Buf += "  x := \"text *)";
+                statementLine();
+            } else
+                Buf += "*)\n";
+        }
+
+    public:
+        explicit CorpusGenerator(unsigned Seed) : Rng(Seed), Unterminated(Seed % 2) {}
+
+        std::string generate(size_t Size) {
+            Buf = "MODULE LexDiff;\n";
+            while (Buf.size() < Size) {
+                unsigned Kind = pick(20000);
+                if (Kind == 0)
+                    comment((64 << 10) + pick(2 << 20));
+                else if (Kind < 4000)
+                    comment(pick(512));
+                else
+                    statementLine();
+            }
+            Buf += "END LexDiff.\n";
+            if (Unterminated)
+                Buf += "(* unterminated\n";
+            return std::move(Buf);
+        }
+    };
+}
+
+// Compares the tokens and the diagnostics of the two lexers. Prints the
+// first difference.
+static bool compare(const TokenStream &Serial, const DiagnosticEngine &SerialDiags,
+                    const TokenStream &Parallel, const DiagnosticEngine &ParallelDiags,
+                    const char *BufferStart) {
+    auto offset = [BufferStart](SMLoc Loc) { return Loc.getPointer() - BufferStart; };
+    for (size_t I = 0, E = std::max(Serial.size(), Parallel.size()); I != E; ++I) {
+        if (I >= Serial.size() || I >= Parallel.size()) {
+            llvm::errs() << "token count differs: " << Serial.size() << " serial, "
+                         << Parallel.size() << " parallel\n";
+            return false;
+        }
+        Token A, B;
+        Serial.get(I, A);
+        Parallel.get(I, B);
+        bool Same = A.getKind() == B.getKind() && A.getLocation() == B.getLocation() &&
+                    A.getLength() == B.getLength();
+        if (Same && A.is(tok::identifier))
+            Same = A.getIdentifierID() == B.getIdentifierID();
+        else if (Same && A.is(tok::integer_literal))
+            Same = A.getIntegerValue() == B.getIntegerValue();
+        if (!Same) {
+            llvm::errs() << "token " << I << " differs: " << A.getName() << " at "
+                         << offset(A.getLocation()) << " serial, " << B.getName() << " at "
+                         << offset(B.getLocation()) << " parallel\n";
+            return false;
+        }
+    }
+
+    ArrayRef<StoredDiagnostic> SD = SerialDiags.getDiagnostics();
+    ArrayRef<StoredDiagnostic> PD = ParallelDiags.getDiagnostics();
+    for (size_t I = 0, E = std::max(SD.size(), PD.size()); I != E; ++I) {
+        if (I >= SD.size() || I >= PD.size()) {
+            llvm::errs() << "diagnostic count differs: " << SD.size() << " serial, "
+                         << PD.size() << " parallel\n";
+            return false;
+        }
+        bool Same = SD[I].Loc == PD[I].Loc && SD[I].DiagID == PD[I].DiagID;
+        for (unsigned J = 0; Same && J < StoredDiagnostic::MaxArguments; ++J)
+            Same = SD[I].Args[J] == PD[I].Args[J];
+        if (!Same) {
+            llvm::errs() << "diagnostic " << I << " differs: " << SD[I].DiagID << " at "
+                         << offset(SD[I].Loc) << " serial, " << PD[I].DiagID << " at "
+                         << offset(PD[I].Loc) << " parallel\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc_, const char **argv_) {
+    llvm::InitLLVM X(argc_, argv_);
+    llvm::cl::ParseCommandLineOptions(argc_, argv_, "tinylang parallel lexer check\n");
+
+    std::unique_ptr<llvm::MemoryBuffer> Buffer;
+    if (InputFile.empty()) {
+        Buffer = llvm::MemoryBuffer::getMemBufferCopy(
+                CorpusGenerator(Seed).generate(size_t(SizeMB) << 20), "LexDiff.mod");
+        if (!OutputFile.empty()) {
+            std::error_code EC;
+            llvm::raw_fd_ostream Out(OutputFile, EC, llvm::sys::fs::OF_None);
+            if (EC) {
+                llvm::errs() << "Error writing " << OutputFile << ": " << EC.message() << "\n";
+                return 1;
+            }
+            Out << Buffer->getBuffer();
+        }
+    } else {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr = llvm::MemoryBuffer::getFile(InputFile);
+        if (std::error_code BufferError = FileOrErr.getError()) {
+            llvm::errs() << "Error reading " << InputFile << ": " << BufferError.message() << "\n";
+            return 1;
+        }
+        Buffer = std::move(*FileOrErr);
+    }
+    llvm::SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(std::move(Buffer), llvm::SMLoc());
+
+    DiagnosticEngine SerialDiags(SrcMgr);
+    IdentifierTable SerialIdents;
+    Lexer SerialLexer(SrcMgr, SerialDiags, SerialIdents);
+    TokenStream Serial(SerialLexer.getBuffer());
+    SerialLexer.lex(Serial);
+    llvm::outs() << "serial: " << Serial.size() << " tokens, "
+                 << SerialDiags.getDiagnostics().size() << " diagnostics\n";
+
+    std::vector<unsigned> ThreadCounts{2, 3, 4, 8};
+    if (!Threads.empty())
+        ThreadCounts.assign(Threads.begin(), Threads.end());
+    bool Failed = false;
+    for (unsigned NumThreads : ThreadCounts) {
+        DiagnosticEngine ParallelDiags(SrcMgr);
+        IdentifierTable ParallelIdents;
+        Lexer ParallelLexer(SrcMgr, ParallelDiags, ParallelIdents);
+        TokenStream Parallel(ParallelLexer.getBuffer());
+        ParallelLexer.lexParallel(Parallel, NumThreads);
+        bool Same = compare(Serial, SerialDiags, Parallel, ParallelDiags,
+                            SerialLexer.getBuffer().begin()) &&
+                    SerialIdents.size() == ParallelIdents.size();
+        llvm::outs() << NumThreads << " threads: " << (Same ? "same" : "DIFFERENT") << "\n";
+        Failed |= !Same;
+    }
+    return Failed ? 1 : 0;
+}